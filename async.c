@@ -24,6 +24,10 @@
 
 #include "qemu-common.h"
 #include "qemu-aio.h"
+#include "qemu-timer.h"
+#ifdef CONFIG_SYNC_BUILTINS
+#include "qemu-atomic.h"
+#endif
 
 /*
  * An AsyncContext protects the callbacks of AIO requests and Bottom Halves
@@ -51,6 +55,15 @@ struct AsyncContext {
     /* Anchor of the list of Bottom Halves belonging to the context */
     struct QEMUBH *first_bh;
 
+    /* Bottom Halves that have been scheduled since the last poll.  This is
+       a lock-free stack: qemu_bh_schedule pushes with compare-and-swap,
+       qemu_bh_poll detaches the whole stack at once.  Without host
+       atomics it stays empty and the poller walks first_bh instead. */
+    struct QEMUBH *pending_bh;
+
+    /* Set when a Bottom Half was deleted and first_bh needs a sweep */
+    int bh_deleted;
+
     /* Link to parent context */
     struct AsyncContext *parent;
 };
@@ -118,48 +131,118 @@ int get_async_context_id(void)
 struct QEMUBH {
     QEMUBHFunc *cb;
     void *opaque;
+    struct AsyncContext *ctx;
     int scheduled;
     int idle;
     int deleted;
+    /* on ctx->pending_bh, owned by the poller until it clears this */
+    int queued;
     QEMUBH *next;
+    QEMUBH *pending_next;
+    EventLoopStats stats;
 };
 
-QEMUBH *qemu_bh_new(QEMUBHFunc *cb, void *opaque)
+QEMUBH *qemu_bh_new_named(QEMUBHFunc *cb, void *opaque, const char *name)
 {
     QEMUBH *bh;
     bh = qemu_mallocz(sizeof(QEMUBH));
     bh->cb = cb;
     bh->opaque = opaque;
+    event_loop_stats_init(&bh->stats, "bh", name, -1);
+    bh->ctx = async_context;
     bh->next = async_context->first_bh;
     async_context->first_bh = bh;
     return bh;
 }
 
+static void qemu_bh_enqueue(QEMUBH *bh)
+{
+#ifdef CONFIG_SYNC_BUILTINS
+    struct AsyncContext *ctx = bh->ctx;
+    QEMUBH *old;
+
+    /* already on the pending stack, the poller will see bh->scheduled */
+    if (atomic_cmpxchg(&bh->queued, 0, 1) != 0) {
+        return;
+    }
+    do {
+        old = ctx->pending_bh;
+        bh->pending_next = old;
+    } while (atomic_cmpxchg(&ctx->pending_bh, old, bh) != old);
+#endif
+}
+
+/* Returns 1 if a non-idle Bottom Half ran */
+static int qemu_bh_run(QEMUBH *bh)
+{
+    int64_t start;
+    int ret = !bh->idle;
+
+    bh->idle = 0;
+    start = event_loop_stats_begin();
+    bh->cb(bh->opaque);
+    event_loop_stats_end(&bh->stats, start);
+    return ret;
+}
+
 int qemu_bh_poll(void)
 {
+    struct AsyncContext *ctx = async_context;
     QEMUBH *bh, **bhp;
     int ret;
 
     ret = 0;
-    for (bh = async_context->first_bh; bh; bh = bh->next) {
+
+#ifdef CONFIG_SYNC_BUILTINS
+    {
+        QEMUBH *list = NULL, *next;
+
+        /* Detach everything scheduled so far and restore scheduling order */
+        bh = atomic_xchg(&ctx->pending_bh, NULL);
+        while (bh) {
+            next = bh->pending_next;
+            bh->pending_next = list;
+            list = bh;
+            bh = next;
+        }
+
+        for (bh = list; bh; bh = next) {
+            next = bh->pending_next;
+            /* From here on a new qemu_bh_schedule queues it again */
+            atomic_xchg(&bh->queued, 0);
+            if (!bh->deleted && atomic_xchg(&bh->scheduled, 0)) {
+                ret |= qemu_bh_run(bh);
+            }
+        }
+    }
+#else
+    /* Scheduling is only safe under the global mutex, check every BH */
+    for (bh = ctx->first_bh; bh; bh = bh->next) {
         if (!bh->deleted && bh->scheduled) {
             bh->scheduled = 0;
-            if (!bh->idle)
-                ret = 1;
-            bh->idle = 0;
-            bh->cb(bh->opaque);
+            ret |= qemu_bh_run(bh);
         }
     }
+#endif
 
     /* remove deleted bhs */
-    bhp = &async_context->first_bh;
-    while (*bhp) {
-        bh = *bhp;
-        if (bh->deleted) {
-            *bhp = bh->next;
-            qemu_free(bh);
-        } else
-            bhp = &bh->next;
+    if (ctx->bh_deleted) {
+        ctx->bh_deleted = 0;
+        bhp = &ctx->first_bh;
+        while (*bhp) {
+            bh = *bhp;
+            if (bh->deleted && !bh->queued) {
+                *bhp = bh->next;
+                event_loop_stats_remove(&bh->stats);
+                qemu_free(bh);
+            } else {
+                if (bh->deleted) {
+                    /* still referenced from pending_bh, retry next time */
+                    ctx->bh_deleted = 1;
+                }
+                bhp = &bh->next;
+            }
+        }
     }
 
     return ret;
@@ -169,16 +252,18 @@ void qemu_bh_schedule_idle(QEMUBH *bh)
 {
     if (bh->scheduled)
         return;
-    bh->scheduled = 1;
     bh->idle = 1;
+    bh->scheduled = 1;
+    qemu_bh_enqueue(bh);
 }
 
 void qemu_bh_schedule(QEMUBH *bh)
 {
     if (bh->scheduled)
         return;
-    bh->scheduled = 1;
     bh->idle = 0;
+    bh->scheduled = 1;
+    qemu_bh_enqueue(bh);
     /* stop the currently executing CPU to execute the BH ASAP */
     qemu_notify_event();
 }
@@ -192,13 +277,19 @@ void qemu_bh_delete(QEMUBH *bh)
 {
     bh->scheduled = 0;
     bh->deleted = 1;
+    bh->ctx->bh_deleted = 1;
 }
 
 void qemu_bh_update_timeout(int *timeout)
 {
     QEMUBH *bh;
 
+#ifdef CONFIG_SYNC_BUILTINS
+    /* only the poller removes entries, so walking the stack is safe */
+    for (bh = async_context->pending_bh; bh; bh = bh->pending_next) {
+#else
     for (bh = async_context->first_bh; bh; bh = bh->next) {
+#endif
         if (!bh->deleted && bh->scheduled) {
             if (bh->idle) {
                 /* idle bottom halves will be polled at least
@@ -213,4 +304,3 @@ void qemu_bh_update_timeout(int *timeout)
         }
     }
 }
-
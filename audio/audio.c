@@ -699,6 +699,65 @@ void audio_pcm_info_clear_buf (struct audio_pcm_info *info, void *buf, int len)
     }
 }
 
+/*
+ * Whether buf holds len samples that convert to zero, the value mixing
+ * leaves alone.  For unsigned formats that is the midpoint the
+ * conversion subtracts, which for 8 bit is 0x7f rather than 0x80.
+ */
+static int audio_pcm_info_is_silence (struct audio_pcm_info *info,
+                                      const void *buf, int len)
+{
+    const uint8_t *p = buf;
+    uint8_t pattern[4] = { 0, 0, 0, 0 };
+    uint32_t word, pattern_word;
+    int i, bytes = len << info->shift;
+
+    if (!info->sign) {
+        switch (info->bits) {
+        case 8:
+            memset (pattern, 0x7f, 4);
+            break;
+
+        case 16:
+            {
+                uint16_t s = INT16_MAX;
+
+                if (info->swap_endianness) {
+                    s = bswap16 (s);
+                }
+                memcpy (pattern, &s, 2);
+                memcpy (pattern + 2, &s, 2);
+            }
+            break;
+
+        case 32:
+            {
+                uint32_t s = INT32_MAX;
+
+                if (info->swap_endianness) {
+                    s = bswap32 (s);
+                }
+                memcpy (pattern, &s, 4);
+            }
+            break;
+        }
+    }
+
+    memcpy (&pattern_word, pattern, 4);
+    for (i = 0; i + 4 <= bytes; i += 4) {
+        memcpy (&word, p + i, 4);
+        if (word != pattern_word) {
+            return 0;
+        }
+    }
+    for (; i < bytes; i++) {
+        if (p[i] != pattern[i & 3]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 /*
  * Capture
  */
@@ -874,7 +933,12 @@ int audio_pcm_hw_clip_out (HWVoiceOut *hw, void *pcm_buf,
         int samples_till_end_of_buf = hw->samples - hw->rpos;
         int samples_to_clip = audio_MIN (len, samples_till_end_of_buf);
 
-        hw->clip (dst, src, samples_to_clip);
+        /* silence in the mix buffer clips to zero bytes */
+        if (hw->info.sign && mixeng_silent (src, samples_to_clip)) {
+            audio_pcm_info_clear_buf (&hw->info, dst, samples_to_clip);
+        } else {
+            hw->clip (dst, src, samples_to_clip);
+        }
 
         hw->rpos = (hw->rpos + samples_to_clip) % hw->samples;
         len -= samples_to_clip;
@@ -1009,7 +1073,7 @@ static int audio_pcm_hw_get_live_out (HWVoiceOut *hw, int *nb_live)
 int audio_pcm_sw_write (SWVoiceOut *sw, void *buf, int size)
 {
     int hwsamples, samples, isamp, osamp, wpos, live, dead, left, swlim, blck;
-    int ret = 0, pos = 0, total = 0;
+    int ret = 0, pos = 0, total = 0, silent;
 
     if (!sw) {
         return size;
@@ -1036,7 +1100,9 @@ int audio_pcm_sw_write (SWVoiceOut *sw, void *buf, int size)
     dead = hwsamples - live;
     swlim = ((int64_t) dead << 32) / sw->ratio;
     swlim = audio_MIN (swlim, samples);
-    if (swlim) {
+    /* buf is NULL for a capture, whose samples are already in sw->buf */
+    silent = buf && audio_pcm_info_is_silence (&sw->info, buf, swlim);
+    if (swlim && !silent) {
         sw->conv (sw->buf, buf, swlim);
         mixeng_volume (sw->buf, swlim, &sw->vol);
     }
@@ -1050,13 +1116,22 @@ int audio_pcm_sw_write (SWVoiceOut *sw, void *buf, int size)
         }
         isamp = swlim;
         osamp = blck;
-        st_rate_flow_mix (
-            sw->rate,
-            sw->buf + pos,
-            sw->hw->mix_buf + wpos,
-            &isamp,
-            &osamp
-            );
+        if (silent) {
+            st_rate_flow_mix_silence (
+                sw->rate,
+                sw->hw->mix_buf + wpos,
+                &isamp,
+                &osamp
+                );
+        } else {
+            st_rate_flow_mix (
+                sw->rate,
+                sw->buf + pos,
+                sw->hw->mix_buf + wpos,
+                &isamp,
+                &osamp
+                );
+        }
         ret += isamp;
         swlim -= isamp;
         pos += isamp;
@@ -324,6 +324,93 @@ void *st_rate_start (int inrate, int outrate)
 #define OP(a, b) a = b
 #include "rate_template.h"
 
+/*
+ * Same as st_rate_flow_mix for isamp samples of silence, which need not
+ * be in any buffer.  Only output samples interpolated from the last loud
+ * input sample change obuf; after that, mixing adds nothing.
+ */
+void st_rate_flow_mix_silence (void *opaque, struct st_sample *obuf,
+                               int *isamp, int *osamp)
+{
+    struct rate *rate = opaque;
+    struct st_sample ilast = rate->ilast;
+    int i = 0, o = 0;
+#ifdef FLOAT_MIXENG
+    mixeng_real t;
+#else
+    int64_t t;
+#endif
+
+    if (rate->opos_inc == (1ULL + UINT_MAX)) {
+        int n = *isamp > *osamp ? *osamp : *isamp;
+        *isamp = n;
+        *osamp = n;
+        return;
+    }
+
+    if (!ilast.l && !ilast.r && *isamp > 0 && *osamp > 0) {
+        /*
+         * Nothing to mix at all, just move the positions as the loop
+         * below would: an output sample is made while the input sample
+         * after it, at opos >> 32, is still in the buffer.
+         */
+        uint64_t limit = (uint64_t) (rate->ipos + *isamp - 1) << 32;
+
+        if (rate->opos < limit) {
+            uint64_t n = (limit - rate->opos + rate->opos_inc - 1) /
+                rate->opos_inc;
+            o = audio_MIN (n, (uint64_t) *osamp);
+        }
+        if (o < *osamp) {
+            i = *isamp;
+        } else {
+            int64_t need = ((rate->opos + (o - 1) * rate->opos_inc) >> 32) +
+                1 - rate->ipos;
+            i = audio_MAX (need, 0);
+        }
+        rate->ipos += i;
+        rate->opos += o * rate->opos_inc;
+        *isamp = i;
+        *osamp = o;
+        return;
+    }
+
+    while (o < *osamp && i < *isamp) {
+        while (rate->ipos <= (rate->opos >> 32)) {
+            ilast.l = 0;
+            ilast.r = 0;
+            i++;
+            rate->ipos++;
+            if (i >= *isamp) {
+                goto the_end;
+            }
+        }
+
+        if (ilast.l || ilast.r) {
+#ifdef FLOAT_MIXENG
+#ifdef RECIPROCAL
+            t = (rate->opos & UINT_MAX) * (1.f / UINT_MAX);
+#else
+            t = (rate->opos & UINT_MAX) / (mixeng_real) UINT_MAX;
+#endif
+            obuf[o].l += ilast.l * (1.0 - t);
+            obuf[o].r += ilast.r * (1.0 - t);
+#else
+            t = rate->opos & 0xffffffff;
+            obuf[o].l += (ilast.l * ((int64_t) UINT_MAX - t)) >> 32;
+            obuf[o].r += (ilast.r * ((int64_t) UINT_MAX - t)) >> 32;
+#endif
+        }
+        o++;
+        rate->opos += rate->opos_inc;
+    }
+
+the_end:
+    *isamp = i;
+    *osamp = o;
+    rate->ilast = ilast;
+}
+
 void st_rate_stop (void *opaque)
 {
     qemu_free (opaque);
@@ -334,6 +421,34 @@ void mixeng_clear (struct st_sample *buf, int len)
     memset (buf, 0, len * sizeof (struct st_sample));
 }
 
+int mixeng_silent (const struct st_sample *buf, int len)
+{
+#ifdef FLOAT_MIXENG
+    while (len--) {
+        if (buf->l != 0 || buf->r != 0) {
+            return 0;
+        }
+        buf += 1;
+    }
+#else
+    /* OR blocks of samples together, with no branch inside a block */
+    while (len > 0) {
+        int i, n = audio_MIN (len, 32);
+        int64_t acc = 0;
+
+        for (i = 0; i < n; i++) {
+            acc |= buf[i].l | buf[i].r;
+        }
+        if (acc) {
+            return 0;
+        }
+        buf += n;
+        len -= n;
+    }
+#endif
+    return 1;
+}
+
 void mixeng_volume (struct st_sample *buf, int len, struct mixeng_volume *vol)
 {
 #ifdef CONFIG_MIXEMU
@@ -342,6 +457,16 @@ void mixeng_volume (struct st_sample *buf, int len, struct mixeng_volume *vol)
         return;
     }
 
+#ifdef FLOAT_MIXENG
+    if (vol->l == 1.0 && vol->r == 1.0) {
+        return;
+    }
+#else
+    if (vol->l == 1ULL << 32 && vol->r == 1ULL << 32) {
+        return;
+    }
+#endif
+
     while (len--) {
 #ifdef FLOAT_MIXENG
         buf->l = buf->l * vol->l;
@@ -15,6 +15,7 @@
 #include "block_int.h"
 #include "hw/hw.h"
 #include "qemu-queue.h"
+#include "qemu-pool.h"
 #include "qemu-timer.h"
 #include "monitor.h"
 #include "block-migration.h"
@@ -83,6 +84,25 @@ typedef struct BlkMigState {
 
 static BlkMigState block_mig_state;
 
+static MemPool blk_mig_block_pool =
+    MEM_POOL_INITIALIZER("blk-mig-block", sizeof(BlkMigBlock), 256);
+static MemPool blk_mig_buf_pool =
+    MEM_POOL_INITIALIZER("blk-mig-buf", BLOCK_SIZE, 16);
+
+static BlkMigBlock *blk_alloc(void)
+{
+    BlkMigBlock *blk = mem_pool_alloc(&blk_mig_block_pool);
+
+    blk->buf = mem_pool_alloc(&blk_mig_buf_pool);
+    return blk;
+}
+
+static void blk_free(BlkMigBlock *blk)
+{
+    mem_pool_free(&blk_mig_buf_pool, blk->buf);
+    mem_pool_free(&blk_mig_block_pool, blk);
+}
+
 static void blk_send(QEMUFile *f, BlkMigBlock * blk)
 {
     int len;
@@ -240,8 +260,7 @@ static int mig_save_device_bulk(Monitor *mon, QEMUFile *f,
         nr_sectors = total_sectors - cur_sector;
     }
 
-    blk = qemu_malloc(sizeof(BlkMigBlock));
-    blk->buf = qemu_malloc(BLOCK_SIZE);
+    blk = blk_alloc();
     blk->bmds = bmds;
     blk->sector = cur_sector;
     blk->nr_sectors = nr_sectors;
@@ -267,8 +286,7 @@ static int mig_save_device_bulk(Monitor *mon, QEMUFile *f,
 error:
     monitor_printf(mon, "Error reading sector %" PRId64 "\n", cur_sector);
     qemu_file_set_error(f);
-    qemu_free(blk->buf);
-    qemu_free(blk);
+    blk_free(blk);
     return 0;
 }
 
@@ -398,8 +416,7 @@ static int mig_save_device_dirty(Monitor *mon, QEMUFile *f,
             } else {
                 nr_sectors = BDRV_SECTORS_PER_DIRTY_CHUNK;
             }
-            blk = qemu_malloc(sizeof(BlkMigBlock));
-            blk->buf = qemu_malloc(BLOCK_SIZE);
+            blk = blk_alloc();
             blk->bmds = bmds;
             blk->sector = sector;
             blk->nr_sectors = nr_sectors;
@@ -425,8 +442,7 @@ static int mig_save_device_dirty(Monitor *mon, QEMUFile *f,
                 }
                 blk_send(f, blk);
 
-                qemu_free(blk->buf);
-                qemu_free(blk);
+                blk_free(blk);
             }
 
             bdrv_reset_dirty(bmds->bs, sector, nr_sectors);
@@ -441,8 +457,7 @@ static int mig_save_device_dirty(Monitor *mon, QEMUFile *f,
 error:
     monitor_printf(mon, "Error reading sector %" PRId64 "\n", sector);
     qemu_file_set_error(f);
-    qemu_free(blk->buf);
-    qemu_free(blk);
+    blk_free(blk);
     return 0;
 }
 
@@ -480,8 +495,7 @@ static void flush_blks(QEMUFile* f)
         blk_send(f, blk);
 
         QSIMPLEQ_REMOVE_HEAD(&block_mig_state.blk_list, entry);
-        qemu_free(blk->buf);
-        qemu_free(blk);
+        blk_free(blk);
 
         block_mig_state.read_done--;
         block_mig_state.transferred++;
@@ -548,9 +562,9 @@ static void blk_mig_cleanup(Monitor *mon)
 
     while ((blk = QSIMPLEQ_FIRST(&block_mig_state.blk_list)) != NULL) {
         QSIMPLEQ_REMOVE_HEAD(&block_mig_state.blk_list, entry);
-        qemu_free(blk->buf);
-        qemu_free(blk);
+        blk_free(blk);
     }
+    mem_pool_trim(&blk_mig_buf_pool);
 
     monitor_printf(mon, "\n");
 }
@@ -684,12 +698,12 @@ static int block_load(QEMUFile *f, void *opaque, int version_id)
                 nr_sectors = BDRV_SECTORS_PER_DIRTY_CHUNK;
             }
 
-            buf = qemu_malloc(BLOCK_SIZE);
+            buf = mem_pool_alloc(&blk_mig_buf_pool);
 
             qemu_get_buffer(f, buf, BLOCK_SIZE);
             ret = bdrv_write(bs, addr, buf, nr_sectors);
 
-            qemu_free(buf);
+            mem_pool_free(&blk_mig_buf_pool, buf);
             if (ret < 0) {
                 return ret;
             }
@@ -2517,6 +2517,7 @@ static void bdrv_aio_cancel_em(BlockDriverAIOCB *blockacb)
 static AIOPool bdrv_em_aio_pool = {
     .aiocb_size         = sizeof(BlockDriverAIOCBSync),
     .cancel             = bdrv_aio_cancel_em,
+    .name               = "bdrv-em-aiocb",
 };
 
 static void bdrv_aio_bh_cb(void *opaque)
@@ -2696,18 +2697,20 @@ void bdrv_init_with_whitelist(void)
     bdrv_init();
 }
 
+/* released AIOCBs kept per pool, enough for deep request queues */
+#define AIO_POOL_MAX_FREE 1024
+
 void *qemu_aio_get(AIOPool *pool, BlockDriverState *bs,
                    BlockDriverCompletionFunc *cb, void *opaque)
 {
     BlockDriverAIOCB *acb;
 
-    if (pool->free_aiocb) {
-        acb = pool->free_aiocb;
-        pool->free_aiocb = acb->next;
-    } else {
-        acb = qemu_mallocz(pool->aiocb_size);
-        acb->pool = pool;
+    if (!pool->mem.size) {
+        mem_pool_init(&pool->mem, pool->name ? pool->name : "aiocb",
+                      pool->aiocb_size, AIO_POOL_MAX_FREE);
     }
+    acb = mem_pool_allocz(&pool->mem);
+    acb->pool = pool;
     acb->bs = bs;
     acb->cb = cb;
     acb->opaque = opaque;
@@ -2717,9 +2720,8 @@ void *qemu_aio_get(AIOPool *pool, BlockDriverState *bs,
 void qemu_aio_release(void *p)
 {
     BlockDriverAIOCB *acb = (BlockDriverAIOCB *)p;
-    AIOPool *pool = acb->pool;
-    acb->next = pool->free_aiocb;
-    pool->free_aiocb = acb;
+
+    mem_pool_free(&acb->pool->mem, acb);
 }
 
 /**************************************************************/
@@ -511,6 +511,7 @@ static void qcow_aio_cancel(BlockDriverAIOCB *blockacb)
 static AIOPool qcow_aio_pool = {
     .aiocb_size         = sizeof(QCowAIOCB),
     .cancel             = qcow_aio_cancel,
+    .name               = "qcow-aiocb",
 };
 
 static QCowAIOCB *qcow_aio_setup(BlockDriverState *bs,
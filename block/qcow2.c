@@ -396,6 +396,7 @@ static void qcow2_aio_cancel(BlockDriverAIOCB *blockacb)
 static AIOPool qcow2_aio_pool = {
     .aiocb_size         = sizeof(QCowAIOCB),
     .cancel             = qcow2_aio_cancel,
+    .name               = "qcow2-aiocb",
 };
 
 static void qcow2_aio_read_cb(void *opaque, int ret);
@@ -31,6 +31,7 @@ static void qed_aio_cancel(BlockDriverAIOCB *blockacb)
 static AIOPool qed_aio_pool = {
     .aiocb_size         = sizeof(QEDAIOCB),
     .cancel             = qed_aio_cancel,
+    .name               = "qed-aiocb",
 };
 
 static int bdrv_qed_probe(const uint8_t *buf, int buf_size,
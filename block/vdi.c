@@ -487,6 +487,7 @@ static void vdi_aio_cancel(BlockDriverAIOCB *blockacb)
 static AIOPool vdi_aio_pool = {
     .aiocb_size = sizeof(VdiAIOCB),
     .cancel = vdi_aio_cancel,
+    .name = "vdi-aiocb",
 };
 
 static VdiAIOCB *vdi_aio_setup(BlockDriverState *bs, int64_t sector_num,
@@ -74,6 +74,17 @@ void mmap_unlock(void)
 }
 #endif
 
+/* There is no shared mode here, lookups take the lock exclusively.  */
+void mmap_read_lock(void)
+{
+    mmap_lock();
+}
+
+void mmap_read_unlock(void)
+{
+    mmap_unlock();
+}
+
 void *qemu_vmalloc(size_t size)
 {
     void *p;
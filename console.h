@@ -229,6 +229,20 @@ static inline void register_displaychangelistener(DisplayState *ds, DisplayChang
     ds->listeners = dcl;
 }
 
+static inline void unregister_displaychangelistener(DisplayState *ds,
+                                                    DisplayChangeListener *dcl)
+{
+    DisplayChangeListener **p = &ds->listeners;
+
+    while (*p != NULL) {
+        if (*p == dcl) {
+            *p = dcl->next;
+            break;
+        }
+        p = &(*p)->next;
+    }
+}
+
 static inline void dpy_update(DisplayState *s, int x, int y, int w, int h)
 {
     struct DisplayChangeListener *dcl = s->listeners;
@@ -378,4 +392,13 @@ char *vnc_display_local_addr(DisplayState *ds);
 /* curses.c */
 void curses_display_init(DisplayState *ds, int full_screen);
 
+/* shm.c */
+int shm_display_init(DisplayState *ds, const char *path);
+
+/* fbrec.c */
+int fbrec_active(void);
+int fbrec_start(DisplayState *ds, const char *filename);
+void fbrec_stop(void);
+void do_info_screenrecord(Monitor *mon);
+
 #endif
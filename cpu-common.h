@@ -49,7 +49,13 @@ ram_addr_t cpu_get_physical_page_desc(target_phys_addr_t addr);
 ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
                         ram_addr_t size, void *host);
 ram_addr_t qemu_ram_alloc(DeviceState *dev, const char *name, ram_addr_t size);
+/* Guest main memory, bound to host nodes with -numa node,hostnode=N.
+   Guest nodes are spread over the blocks in allocation order.  */
+ram_addr_t qemu_ram_alloc_main(DeviceState *dev, const char *name,
+                               ram_addr_t size);
 void qemu_ram_free(ram_addr_t addr);
+int qemu_ram_numa_policy(int node, int *host_node);
+void qemu_ram_numa_check(void);
 /* This should only be used for ram local to a device.  */
 void *qemu_get_ram_ptr(ram_addr_t addr);
 /* Same but slower, to use for migration, where the order of
@@ -34,6 +34,8 @@
 
 #include "cpus.h"
 #include "compatfd.h"
+#include "qemu-option.h"
+#include "qemu-barrier.h"
 
 #ifdef SIGRTMIN
 #define SIG_IPI (SIGRTMIN+4)
@@ -57,10 +59,41 @@
 #define PR_MCE_KILL_EARLY 1
 #endif
 
+#include <sched.h>
+
 #endif /* CONFIG_LINUX */
 
 static CPUState *next_cpu;
 
+/* upper bound of the adaptive TCG halt polling window, 0 disables it */
+int64_t halt_poll_max_ns;
+
+/* give each TCG vCPU a thread of its own (-tcg-vcpu-threads) */
+int tcg_vcpu_threads;
+
+/* host CPU affinity from -vcpu-affinity and -iothread-affinity */
+#define MAX_AFFINITY_VCPUS 256
+
+/* what sched_setaffinity can be given through a cpu_set_t */
+#ifdef CONFIG_LINUX
+#define MAX_HOST_CPUS CPU_SETSIZE
+#else
+#define MAX_HOST_CPUS 1024
+#endif
+
+typedef struct HostCPURange {
+    int set;
+    int first;
+    int last;
+} HostCPURange;
+
+static HostCPURange vcpu_affinity[MAX_AFFINITY_VCPUS];
+static HostCPURange iothread_affinity;
+
+static void qemu_set_thread_affinity(CPUState *env, bool all_vcpus,
+                                     bool iothread);
+static int tcg_cpu_exec(CPUState *env);
+
 /***********************************************************/
 void hw_error(const char *fmt, ...)
 {
@@ -153,7 +186,7 @@ static bool cpu_thread_is_idle(CPUState *env)
     return true;
 }
 
-static bool all_cpu_threads_idle(void)
+bool all_cpu_threads_idle(void)
 {
     CPUState *env;
 
@@ -541,6 +574,11 @@ void run_on_cpu(CPUState *env, void (*func)(void *data), void *data)
     func(data);
 }
 
+void async_run_on_cpu(CPUState *env, void (*func)(void *data), void *data)
+{
+    func(data);
+}
+
 void resume_all_vcpus(void)
 {
 }
@@ -612,7 +650,9 @@ static QemuCond qemu_work_cond;
 
 static void cpu_signal(int sig)
 {
-    if (cpu_single_env) {
+    /* with -tcg-vcpu-threads the running CPU may belong to another
+       thread; only that thread may unchain its TBs */
+    if (cpu_single_env && qemu_cpu_self(cpu_single_env)) {
         cpu_exit(cpu_single_env);
     }
     exit_request = 1;
@@ -729,6 +769,7 @@ void run_on_cpu(CPUState *env, void (*func)(void *data), void *data)
     env->queued_work_last = &wi;
     wi.next = NULL;
     wi.done = false;
+    wi.free = 0;
 
     qemu_cpu_kick(env);
     while (!wi.done) {
@@ -739,6 +780,31 @@ void run_on_cpu(CPUState *env, void (*func)(void *data), void *data)
     }
 }
 
+/* Like run_on_cpu, but does not wait for func to run.  The vCPU runs it
+   before it executes guest code again. */
+void async_run_on_cpu(CPUState *env, void (*func)(void *data), void *data)
+{
+    struct qemu_work_item *wi;
+
+    if (!env->thread || qemu_cpu_self(env)) {
+        func(data);
+        return;
+    }
+
+    wi = qemu_mallocz(sizeof(*wi));
+    wi->func = func;
+    wi->data = data;
+    wi->free = 1;
+    if (!env->queued_work_first) {
+        env->queued_work_first = wi;
+    } else {
+        env->queued_work_last->next = wi;
+    }
+    env->queued_work_last = wi;
+
+    qemu_cpu_kick(env);
+}
+
 static void flush_queued_work(CPUState *env)
 {
     struct qemu_work_item *wi;
@@ -750,7 +816,11 @@ static void flush_queued_work(CPUState *env)
     while ((wi = env->queued_work_first)) {
         env->queued_work_first = wi->next;
         wi->func(wi->data);
-        wi->done = true;
+        if (wi->free) {
+            qemu_free(wi);
+        } else {
+            wi->done = true;
+        }
     }
     env->queued_work_last = NULL;
     qemu_cond_broadcast(&qemu_work_cond);
@@ -767,13 +837,75 @@ static void qemu_wait_io_event_common(CPUState *env)
     env->thread_kicked = false;
 }
 
-static void qemu_tcg_wait_io_event(void)
+/*
+ * Adaptive halt polling.  Before a halted TCG thread goes to sleep on its
+ * halt condition it spins for up to halt_poll_ns with the global mutex
+ * released, so that an interrupt arriving shortly after the halt does not
+ * cost a futex wake-up and a trip through the scheduler.  The window
+ * grows while wake-ups keep arriving within halt_poll_max_ns and shrinks
+ * when the vCPU stays idle for longer than that.
+ */
+#define HALT_POLL_START_NS 10000
+
+static int64_t halt_poll_ns;
+
+static bool qemu_tcg_halt_poll(void)
 {
-    CPUState *env;
+    int64_t start = get_clock();
+    bool idle;
+
+    qemu_mutex_unlock(&qemu_global_mutex);
+    /* unlocked reads are only a hint, the state is rechecked below */
+    while ((idle = all_cpu_threads_idle()) &&
+           get_clock() - start < halt_poll_ns) {
+        cpu_relax();
+    }
+    qemu_mutex_lock(&qemu_global_mutex);
+
+    return !idle && !all_cpu_threads_idle();
+}
+
+static void halt_poll_adjust(int64_t idle_ns)
+{
+    if (idle_ns < halt_poll_max_ns) {
+        halt_poll_ns = halt_poll_ns ? halt_poll_ns * 2 : HALT_POLL_START_NS;
+        if (halt_poll_ns > halt_poll_max_ns) {
+            halt_poll_ns = halt_poll_max_ns;
+        }
+    } else {
+        halt_poll_ns /= 2;
+    }
+}
+
+static void qemu_tcg_halt_wait(void)
+{
+    int64_t start;
+
+    if (!all_cpu_threads_idle()) {
+        return;
+    }
+    if (!halt_poll_max_ns || !vm_running) {
+        while (all_cpu_threads_idle()) {
+            qemu_cond_timedwait(tcg_halt_cond, &qemu_global_mutex, 1000);
+        }
+        return;
+    }
 
+    start = get_clock();
+    if (halt_poll_ns && qemu_tcg_halt_poll()) {
+        return;
+    }
     while (all_cpu_threads_idle()) {
         qemu_cond_timedwait(tcg_halt_cond, &qemu_global_mutex, 1000);
     }
+    halt_poll_adjust(get_clock() - start);
+}
+
+static void qemu_tcg_wait_io_event(void)
+{
+    CPUState *env;
+
+    qemu_tcg_halt_wait();
 
     qemu_mutex_unlock(&qemu_global_mutex);
 
@@ -792,6 +924,22 @@ static void qemu_tcg_wait_io_event(void)
     }
 }
 
+/* Make whichever TCG vCPU holds qemu_global_mutex leave cpu_exec */
+static void qemu_tcg_kick_threads(void)
+{
+    CPUState *env;
+
+    if (!tcg_vcpu_threads) {
+        qemu_thread_signal(tcg_cpu_thread, SIG_IPI);
+        return;
+    }
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        if (env->thread && !qemu_cpu_self(env)) {
+            qemu_thread_signal(env->thread, SIG_IPI);
+        }
+    }
+}
+
 static void qemu_kvm_wait_io_event(CPUState *env)
 {
     while (cpu_thread_is_idle(env)) {
@@ -802,6 +950,30 @@ static void qemu_kvm_wait_io_event(CPUState *env)
     qemu_wait_io_event_common(env);
 }
 
+/*
+ * With -tcg-vcpu-threads guest code still runs under qemu_global_mutex,
+ * one vCPU at a time.  A vCPU that wants to run queues on the fair mutex
+ * like the iothread does and kicks the one holding the lock, which lets
+ * go at the next TB boundary.
+ */
+static void qemu_tcg_vcpu_wait_io_event(CPUState *env)
+{
+    while (cpu_thread_is_idle(env)) {
+        qemu_cond_timedwait(env->halt_cond, &qemu_global_mutex, 1000);
+    }
+
+    qemu_mutex_unlock(&qemu_global_mutex);
+
+    qemu_mutex_lock(&qemu_fair_mutex);
+    if (qemu_mutex_trylock(&qemu_global_mutex)) {
+        qemu_tcg_kick_threads();
+        qemu_mutex_lock(&qemu_global_mutex);
+    }
+    qemu_mutex_unlock(&qemu_fair_mutex);
+
+    qemu_wait_io_event_common(env);
+}
+
 static void *qemu_kvm_cpu_thread_fn(void *arg)
 {
     CPUState *env = arg;
@@ -809,6 +981,7 @@ static void *qemu_kvm_cpu_thread_fn(void *arg)
 
     qemu_mutex_lock(&qemu_global_mutex);
     qemu_thread_self(env->thread);
+    qemu_set_thread_affinity(env, false, false);
 
     r = kvm_init_vcpu(env);
     if (r < 0) {
@@ -859,6 +1032,9 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
         qemu_cond_timedwait(&qemu_system_cond, &qemu_global_mutex, 100);
     }
 
+    /* every vCPU this thread runs has been created by now */
+    qemu_set_thread_affinity(NULL, true, false);
+
     while (1) {
         cpu_exec_all();
         qemu_tcg_wait_io_event();
@@ -867,6 +1043,40 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
     return NULL;
 }
 
+static void *qemu_tcg_vcpu_thread_fn(void *arg)
+{
+    CPUState *env = arg;
+
+    qemu_tcg_init_cpu_signals();
+    qemu_mutex_lock(&qemu_global_mutex);
+    qemu_thread_self(env->thread);
+
+    /* signal CPU creation */
+    env->created = 1;
+    qemu_cond_signal(&qemu_cpu_cond);
+
+    /* and wait for machine initialization */
+    while (!qemu_system_ready) {
+        qemu_cond_timedwait(&qemu_system_cond, &qemu_global_mutex, 100);
+    }
+
+    qemu_set_thread_affinity(env, false, false);
+
+    while (1) {
+        if (cpu_can_run(env)) {
+            qemu_clock_enable(vm_clock,
+                              (env->singlestep_enabled & SSTEP_NOTIMER) == 0);
+            if (tcg_cpu_exec(env) == EXCP_DEBUG) {
+                cpu_handle_debug_exception(env);
+            }
+            exit_request = 0;
+        }
+        qemu_tcg_vcpu_wait_io_event(env);
+    }
+
+    return NULL;
+}
+
 void qemu_cpu_kick(void *_env)
 {
     CPUState *env = _env;
@@ -905,7 +1115,7 @@ void qemu_mutex_lock_iothread(void)
     } else {
         qemu_mutex_lock(&qemu_fair_mutex);
         if (qemu_mutex_trylock(&qemu_global_mutex)) {
-            qemu_thread_signal(tcg_cpu_thread, SIG_IPI);
+            qemu_tcg_kick_threads();
             qemu_mutex_lock(&qemu_global_mutex);
         }
         qemu_mutex_unlock(&qemu_fair_mutex);
@@ -967,6 +1177,17 @@ static void qemu_tcg_init_vcpu(void *_env)
 {
     CPUState *env = _env;
 
+    if (tcg_vcpu_threads) {
+        env->thread = qemu_mallocz(sizeof(QemuThread));
+        env->halt_cond = qemu_mallocz(sizeof(QemuCond));
+        qemu_cond_init(env->halt_cond);
+        qemu_thread_create(env->thread, qemu_tcg_vcpu_thread_fn, env);
+        while (env->created == 0) {
+            qemu_cond_timedwait(&qemu_cpu_cond, &qemu_global_mutex, 100);
+        }
+        return;
+    }
+
     /* share a single thread for all cpus with TCG */
     if (!tcg_cpu_thread) {
         env->thread = qemu_mallocz(sizeof(QemuThread));
@@ -1125,6 +1346,115 @@ void set_numa_modes(void)
             }
         }
     }
+
+    /* vCPU threads have been created by now and keep their own mask */
+#ifdef CONFIG_IOTHREAD
+    qemu_set_thread_affinity(NULL, false, true);
+#else
+    qemu_set_thread_affinity(NULL, true, true);
+#endif
+}
+
+static void parse_host_cpus(HostCPURange *range, const char *str)
+{
+    unsigned long first, last;
+    const char *p = str;
+    char *endptr;
+
+    first = last = strtoul(p, &endptr, 10);
+    if (endptr != p && *endptr == '-') {
+        p = endptr + 1;
+        last = strtoul(p, &endptr, 10);
+    }
+    if (endptr == p || *endptr || last < first) {
+        fprintf(stderr, "qemu: invalid host CPU range: %s\n", str);
+        exit(1);
+    }
+    if (last >= MAX_HOST_CPUS) {
+        fprintf(stderr, "qemu: host CPU %lu out of range, the limit is %d\n",
+                last, MAX_HOST_CPUS - 1);
+        exit(1);
+    }
+    range->first = first;
+    range->last = last;
+    range->set = 1;
+#ifndef CONFIG_LINUX
+    fprintf(stderr, "qemu: host CPU affinity is not supported on this host\n");
+#endif
+}
+
+void set_vcpu_affinity(const char *optarg)
+{
+    char buf[128];
+    char *endptr;
+    int vcpu;
+
+    if (!get_param_value(buf, sizeof(buf), "vcpu", optarg)) {
+        fprintf(stderr, "qemu: -vcpu-affinity needs vcpu=N\n");
+        exit(1);
+    }
+    vcpu = strtoul(buf, &endptr, 10);
+    if (endptr == buf || *endptr || vcpu >= MAX_AFFINITY_VCPUS) {
+        fprintf(stderr, "qemu: invalid vcpu index: %s\n", buf);
+        exit(1);
+    }
+    if (!get_param_value(buf, sizeof(buf), "host", optarg)) {
+        fprintf(stderr, "qemu: -vcpu-affinity needs host=cpu[-cpu]\n");
+        exit(1);
+    }
+    parse_host_cpus(&vcpu_affinity[vcpu], buf);
+}
+
+void set_iothread_affinity(const char *optarg)
+{
+    parse_host_cpus(&iothread_affinity, optarg);
+}
+
+#ifdef CONFIG_LINUX
+static void host_cpus_add(cpu_set_t *set, HostCPURange *range, int *count)
+{
+    int i;
+
+    if (!range->set) {
+        return;
+    }
+    for (i = range->first; i <= range->last; i++) {
+        CPU_SET(i, set);
+    }
+    (*count)++;
+}
+#endif
+
+/* Pin the calling thread to the host CPUs given for the vCPUs it runs
+   (env, or all of them when they share one thread), plus the iothread's
+   set if it is the iothread.  Without a matching option it is left
+   alone. */
+static void qemu_set_thread_affinity(CPUState *env, bool all_vcpus,
+                                     bool iothread)
+{
+#ifdef CONFIG_LINUX
+    CPUState *cpu;
+    cpu_set_t set;
+    int count = 0;
+
+    CPU_ZERO(&set);
+    if (iothread) {
+        host_cpus_add(&set, &iothread_affinity, &count);
+    }
+    for (cpu = first_cpu; cpu != NULL; cpu = cpu->next_cpu) {
+        if ((all_vcpus || cpu == env) &&
+            cpu->cpu_index < MAX_AFFINITY_VCPUS) {
+            host_cpus_add(&set, &vcpu_affinity[cpu->cpu_index], &count);
+        }
+    }
+    if (!count) {
+        return;
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        fprintf(stderr, "qemu: cannot set thread affinity: %s\n",
+                strerror(errno));
+    }
+#endif
 }
 
 void set_cpu_log(const char *optarg)
@@ -2,11 +2,14 @@
 #define QEMU_CPUS_H
 
 /* cpus.c */
+extern int64_t halt_poll_max_ns;
+extern int tcg_vcpu_threads;
 int qemu_init_main_loop(void);
 void qemu_main_loop_start(void);
 void resume_all_vcpus(void);
 void pause_all_vcpus(void);
 void cpu_stop_current(void);
+bool all_cpu_threads_idle(void);
 
 /* vl.c */
 extern int smp_cores;
@@ -15,6 +18,8 @@ void vm_state_notify(int running, int reason);
 bool cpu_exec_all(void);
 void set_numa_modes(void);
 void set_cpu_log(const char *optarg);
+void set_vcpu_affinity(const char *optarg);
+void set_iothread_affinity(const char *optarg);
 void list_cpus(FILE *f, fprintf_function cpu_fprintf, const char *optarg);
 
 #endif
@@ -142,6 +142,7 @@ static void dma_aio_cancel(BlockDriverAIOCB *acb)
 static AIOPool dma_aio_pool = {
     .aiocb_size         = sizeof(DMAAIOCB),
     .cancel             = dma_aio_cancel,
+    .name               = "dma-aiocb",
 };
 
 static BlockDriverAIOCB *dma_bdrv_io(
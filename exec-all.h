@@ -266,6 +266,27 @@ TranslationBlock *tb_find_pc(unsigned long pc_ptr);
 
 extern spinlock_t tb_lock;
 
+/* guards lookups, translation and TB linking */
+#if !defined(CONFIG_USER_ONLY) && defined(CONFIG_IOTHREAD)
+void tb_cache_lock(void);
+void tb_cache_unlock(void);
+void tb_cache_lock_reset(CPUState *env);
+#else
+static inline void tb_cache_lock(void)
+{
+    spin_lock(&tb_lock);
+}
+
+static inline void tb_cache_unlock(void)
+{
+    spin_unlock(&tb_lock);
+}
+
+static inline void tb_cache_lock_reset(CPUState *env)
+{
+}
+#endif
+
 extern int tb_invalidated_flag;
 
 #if !defined(CONFIG_USER_ONLY)
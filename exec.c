@@ -22,6 +22,8 @@
 #else
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <signal.h>
 #endif
 
 #include "qemu-common.h"
@@ -33,9 +35,11 @@
 #include "osdep.h"
 #include "kvm.h"
 #include "qemu-timer.h"
+#include "bitops.h"
 #if defined(CONFIG_USER_ONLY)
 #include <qemu.h>
 #include <signal.h>
+#include "interval-tree.h"
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
 #include <sys/param.h>
 #if __FreeBSD_version >= 700104
@@ -51,6 +55,12 @@
 #include <libutil.h>
 #endif
 #endif
+#else /* !CONFIG_USER_ONLY */
+#include "sysemu.h"
+#include "cpus.h"
+#ifdef CONFIG_IOTHREAD
+#include "qemu-thread.h"
+#endif
 #endif
 
 //#define DEBUG_TB_INVALIDATE
@@ -79,6 +89,39 @@ static int nb_tbs;
 /* any access to the tbs or the page table must use this lock */
 spinlock_t tb_lock = SPIN_LOCK_UNLOCKED;
 
+#if !defined(CONFIG_USER_ONLY) && defined(CONFIG_IOTHREAD)
+/* spin_lock() is empty in system emulation.  With -tcg-vcpu-threads,
+   lookups, translation and TB linking from the vCPU threads take
+   tb_mutex instead; with the single TCG thread it is skipped. */
+static QemuMutex tb_mutex;
+static CPUState *tb_mutex_owner;
+
+void tb_cache_lock(void)
+{
+    if (tcg_vcpu_threads) {
+        qemu_mutex_lock(&tb_mutex);
+        tb_mutex_owner = cpu_single_env;
+    }
+}
+
+void tb_cache_unlock(void)
+{
+    if (tcg_vcpu_threads) {
+        tb_mutex_owner = NULL;
+        qemu_mutex_unlock(&tb_mutex);
+    }
+}
+
+/* A fault while translating longjmps out of cpu_exec with the lock
+   held; only the thread running env can have taken it on its behalf. */
+void tb_cache_lock_reset(CPUState *env)
+{
+    if (tcg_vcpu_threads && tb_mutex_owner == env) {
+        tb_cache_unlock();
+    }
+}
+#endif
+
 #if defined(__arm__) || defined(__sparc_v9__)
 /* The prologue must be reachable with a direct jump. ARM and Sparc64
  have limited branch ranges (possibly also PPC) so place it in a
@@ -128,9 +171,6 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned int code_write_count;
     uint8_t *code_bitmap;
-#if defined(CONFIG_USER_ONLY)
-    unsigned long flags;
-#endif
 } PageDesc;
 
 /* In system mode we want L1_MAP to be based on ram offsets,
@@ -180,9 +220,17 @@ unsigned long qemu_host_page_size;
 unsigned long qemu_host_page_mask;
 
 /* This is a multi-level map on the virtual address space.
-   The bottom level has pointers to PageDesc.  */
+   The bottom level has pointers to PageDesc.  In user mode only the
+   pages holding translated code have one.  */
 static void *l1_map[V_L1_SIZE];
 
+#if defined(CONFIG_USER_ONLY)
+/* The page flags of the guest address space, as ranges of pages with
+   the same flags.  Changed with the mmap_lock held, looked up with at
+   least mmap_read_lock.  */
+static IntervalTree page_ranges;
+#endif
+
 #if !defined(CONFIG_USER_ONLY)
 typedef struct PhysPageDesc {
     /* offset in host memory of the page + io_index in the low bits */
@@ -442,6 +490,8 @@ static void tlb_unprotect_code_phys(CPUState *env, ram_addr_t ram_addr,
                                     target_ulong vaddr);
 #define mmap_lock() do { } while(0)
 #define mmap_unlock() do { } while(0)
+#define mmap_read_lock() do { } while(0)
+#define mmap_read_unlock() do { } while(0)
 #endif
 
 #define DEFAULT_CODE_GEN_BUFFER_SIZE (32 * 1024 * 1024)
@@ -571,6 +621,9 @@ void cpu_exec_init_all(unsigned long tb_size)
 #if !defined(CONFIG_USER_ONLY)
     io_mem_init();
 #endif
+#if !defined(CONFIG_USER_ONLY) && defined(CONFIG_IOTHREAD)
+    qemu_mutex_init(&tb_mutex);
+#endif
 #if !defined(CONFIG_USER_ONLY) || !defined(CONFIG_USE_GUEST_BASE)
     /* There's no guest base to take into account, so go ahead and
        initialize the prologue now.  */
@@ -1104,7 +1157,9 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
            modifying the memory. It will ensure that it cannot modify
            itself */
         env->current_tb = NULL;
+        tb_cache_lock();
         tb_gen_code(env, current_pc, current_cs_base, current_flags, 1);
+        tb_cache_unlock();
         cpu_resume_from_signal(env, NULL);
     }
 #endif
@@ -1215,10 +1270,9 @@ static inline void tb_alloc_page(TranslationBlock *tb,
 #if defined(TARGET_HAS_SMC) || 1
 
 #if defined(CONFIG_USER_ONLY)
-    if (p->flags & PAGE_WRITE) {
+    if (interval_tree_get(&page_ranges, page_addr) & PAGE_WRITE) {
         target_ulong addr;
-        PageDesc *p2;
-        int prot;
+        int prot, flags;
 
         /* force the host page as non writable (writes will have a
            page fault + mprotect overhead) */
@@ -1227,11 +1281,12 @@ static inline void tb_alloc_page(TranslationBlock *tb,
         for(addr = page_addr; addr < page_addr + qemu_host_page_size;
             addr += TARGET_PAGE_SIZE) {
 
-            p2 = page_find (addr >> TARGET_PAGE_BITS);
-            if (!p2)
-                continue;
-            prot |= p2->flags;
-            p2->flags &= ~PAGE_WRITE;
+            flags = interval_tree_get(&page_ranges, addr);
+            prot |= flags;
+            if (flags & PAGE_WRITE) {
+                interval_tree_set(&page_ranges, addr, addr + TARGET_PAGE_SIZE,
+                                  flags & ~PAGE_WRITE);
+            }
           }
         mprotect(g2h(page_addr), qemu_host_page_size,
                  (prot & PAGE_BITS) & ~PAGE_WRITE);
@@ -2020,13 +2075,46 @@ static inline void tlb_reset_dirty_range(CPUTLBEntry *tlb_entry,
     }
 }
 
+static void tlb_reset_dirty_env(CPUState *env, unsigned long start,
+                                unsigned long length)
+{
+    int mmu_idx, i;
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        for (i = 0; i < CPU_TLB_SIZE; i++) {
+            tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i], start, length);
+        }
+    }
+}
+
+/* With -tcg-vcpu-threads a TLB is only rewritten by the thread running
+   its vCPU; other threads queue the change with async_run_on_cpu and the
+   vCPU applies it before it executes guest code again. */
+typedef struct TLBResetDirty {
+    CPUState *env;
+    unsigned long start;
+    unsigned long length;
+} TLBResetDirty;
+
+static void tlb_reset_dirty_work(void *data)
+{
+    TLBResetDirty *req = data;
+
+    tlb_reset_dirty_env(req->env, req->start, req->length);
+    qemu_free(req);
+}
+
+static void tlb_flush_work(void *data)
+{
+    tlb_flush(data, 1);
+}
+
 /* Note: start and end must be within the same ram block.  */
 void cpu_physical_memory_reset_dirty(ram_addr_t start, ram_addr_t end,
                                      int dirty_flags)
 {
     CPUState *env;
     unsigned long length, start1;
-    int i;
 
     start &= TARGET_PAGE_MASK;
     end = TARGET_PAGE_ALIGN(end);
@@ -2047,15 +2135,53 @@ void cpu_physical_memory_reset_dirty(ram_addr_t start, ram_addr_t end,
     }
 
     for(env = first_cpu; env != NULL; env = env->next_cpu) {
-        int mmu_idx;
-        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-            for(i = 0; i < CPU_TLB_SIZE; i++)
-                tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
-                                      start1, length);
+        if (tcg_vcpu_threads) {
+            TLBResetDirty *req = qemu_malloc(sizeof(*req));
+
+            req->env = env;
+            req->start = start1;
+            req->length = length;
+            async_run_on_cpu(env, tlb_reset_dirty_work, req);
+        } else {
+            tlb_reset_dirty_env(env, start1, length);
         }
     }
 }
 
+/*
+ * Set a bit in bitmap for every page of [start, start + length) that has
+ * one of dirty_flags set, bit 0 standing for the page at start.  Clean
+ * stretches of the dirty map are skipped a word at a time.  Returns the
+ * number of dirty pages.
+ */
+int cpu_physical_memory_get_dirty_range(ram_addr_t start, ram_addr_t length,
+                                        int dirty_flags,
+                                        unsigned long *bitmap)
+{
+    const uint8_t *p = ram_list.phys_dirty + (start >> TARGET_PAGE_BITS);
+    unsigned long mask = dirty_flags * (~0UL / 0xff);
+    unsigned long i, n = length >> TARGET_PAGE_BITS;
+    int count = 0;
+
+    memset(bitmap, 0, BITS_TO_LONGS(n) * sizeof(unsigned long));
+    for (i = 0; i < n; i++) {
+        if (i % sizeof(long) == 0 && i + sizeof(long) <= n) {
+            unsigned long w;
+
+            memcpy(&w, p + i, sizeof(w));
+            if (!(w & mask)) {
+                i += sizeof(long) - 1;
+                continue;
+            }
+        }
+        if (p[i] & dirty_flags) {
+            set_bit(i, bitmap);
+            count++;
+        }
+    }
+    return count;
+}
+
 int cpu_physical_memory_set_dirty_tracking(int enable)
 {
     int ret = 0;
@@ -2301,83 +2427,28 @@ struct walk_memory_regions_data
 {
     walk_memory_regions_fn fn;
     void *priv;
-    unsigned long start;
-    int prot;
 };
 
-static int walk_memory_regions_end(struct walk_memory_regions_data *data,
-                                   abi_ulong end, int new_prot)
+static int walk_memory_regions_1(void *opaque, uint64_t start, uint64_t end,
+                                 int prot)
 {
-    if (data->start != -1ul) {
-        int rc = data->fn(data->priv, data->start, end, data->prot);
-        if (rc != 0) {
-            return rc;
-        }
-    }
+    struct walk_memory_regions_data *data = opaque;
 
-    data->start = (new_prot ? end : -1ul);
-    data->prot = new_prot;
-
-    return 0;
-}
-
-static int walk_memory_regions_1(struct walk_memory_regions_data *data,
-                                 abi_ulong base, int level, void **lp)
-{
-    abi_ulong pa;
-    int i, rc;
-
-    if (*lp == NULL) {
-        return walk_memory_regions_end(data, base, 0);
-    }
-
-    if (level == 0) {
-        PageDesc *pd = *lp;
-        for (i = 0; i < L2_SIZE; ++i) {
-            int prot = pd[i].flags;
-
-            pa = base | (i << TARGET_PAGE_BITS);
-            if (prot != data->prot) {
-                rc = walk_memory_regions_end(data, pa, prot);
-                if (rc != 0) {
-                    return rc;
-                }
-            }
-        }
-    } else {
-        void **pp = *lp;
-        for (i = 0; i < L2_SIZE; ++i) {
-            pa = base | ((abi_ulong)i <<
-                (TARGET_PAGE_BITS + L2_BITS * level));
-            rc = walk_memory_regions_1(data, pa, level - 1, pp + i);
-            if (rc != 0) {
-                return rc;
-            }
-        }
-    }
-
-    return 0;
+    return data->fn(data->priv, start, end, prot);
 }
 
 int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
 {
     struct walk_memory_regions_data data;
-    unsigned long i;
+    int rc;
 
     data.fn = fn;
     data.priv = priv;
-    data.start = -1ul;
-    data.prot = 0;
-
-    for (i = 0; i < V_L1_SIZE; i++) {
-        int rc = walk_memory_regions_1(&data, (abi_ulong)i << V_L1_SHIFT,
-                                       V_L1_SHIFT / L2_BITS - 1, l1_map + i);
-        if (rc != 0) {
-            return rc;
-        }
-    }
 
-    return walk_memory_regions_end(&data, 0, 0);
+    mmap_read_lock();
+    rc = interval_tree_foreach(&page_ranges, walk_memory_regions_1, &data);
+    mmap_read_unlock();
+    return rc;
 }
 
 static int dump_region(void *priv, abi_ulong start,
@@ -2405,12 +2476,43 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageDesc *p;
+    int flags;
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p)
-        return 0;
-    return p->flags;
+    mmap_read_lock();
+    flags = interval_tree_get(&page_ranges, address);
+    mmap_read_unlock();
+    return flags;
+}
+
+/* Invalidate the translated code in the pages [start, end) that are not
+   writable, before they become writable.  Only the parts of the map that
+   hold PageDescs are visited.  */
+static void page_invalidate_unwritable(void **lp, int level, uint64_t base,
+                                       uint64_t start, uint64_t end)
+{
+    uint64_t span = (uint64_t)1 << (level * L2_BITS);
+    int i;
+
+    if (*lp == NULL) {
+        return;
+    }
+    for (i = 0; i < L2_SIZE; i++) {
+        uint64_t index = base + i * span;
+
+        if (index + span <= start || index >= end) {
+            continue;
+        }
+        if (level > 0) {
+            page_invalidate_unwritable((void **)*lp + i, level - 1, index,
+                                       start, end);
+        } else if (((PageDesc *)*lp)[i].first_tb) {
+            target_ulong addr = index << TARGET_PAGE_BITS;
+
+            if (!(interval_tree_get(&page_ranges, addr) & PAGE_WRITE)) {
+                tb_invalidate_phys_page(addr, 0, NULL);
+            }
+        }
+    }
 }
 
 /* Modify the flags of a page and invalidate the code if necessary.
@@ -2418,7 +2520,7 @@ int page_get_flags(target_ulong address)
    on PAGE_WRITE.  The mmap_lock should already be held.  */
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
-    target_ulong addr, len;
+    uint64_t start_index, end_index, i;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2435,27 +2537,47 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
         flags |= PAGE_WRITE_ORG;
     }
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
+    /* end is 0 if the range reaches the top of the address space */
+    start_index = start >> TARGET_PAGE_BITS;
+    end_index = ((uint64_t)start + (end - start)) >> TARGET_PAGE_BITS;
 
-        /* If the write protection bit is set, then we invalidate
-           the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0, NULL);
+    /* If the write protection bit is set, then we invalidate
+       the code inside.  */
+    if (flags & PAGE_WRITE) {
+        for (i = start_index >> V_L1_SHIFT;
+             i <= (end_index - 1) >> V_L1_SHIFT; i++) {
+            page_invalidate_unwritable(l1_map + i, V_L1_SHIFT / L2_BITS - 1,
+                                       i << V_L1_SHIFT,
+                                       start_index, end_index);
         }
-        p->flags = flags;
     }
+    interval_tree_set(&page_ranges, start, (uint64_t)start + (end - start),
+                      flags);
+}
+
+/* Find 'size' bytes of guest address space that are not mapped, starting
+   at or above 'start' on a host page boundary and ending at or below
+   'last'.  Return -1 if there is no such area.  The mmap_lock should
+   already be held.  */
+target_ulong page_find_free(target_ulong start, target_ulong last,
+                            target_ulong size)
+{
+    uint64_t addr, limit = (uint64_t)last + 1;
+
+    addr = interval_tree_find_free(&page_ranges, start,
+                                   limit ? limit : UINT64_MAX,
+                                   size, qemu_host_page_size);
+    if (addr == INTERVAL_TREE_NONE) {
+        return -1;
+    }
+    return addr;
 }
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
-    PageDesc *p;
     target_ulong end;
     target_ulong addr;
+    int mask, protected;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2475,27 +2597,36 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     end = TARGET_PAGE_ALIGN(start+len); /* must do before we loose bits in the next step */
     start = start & TARGET_PAGE_MASK;
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
-        if( !p )
-            return -1;
-        if( !(p->flags & PAGE_VALID) )
-            return -1;
+    mask = PAGE_VALID;
+    if (flags & PAGE_READ) {
+        mask |= PAGE_READ;
+    }
+    if (flags & PAGE_WRITE) {
+        mask |= PAGE_WRITE_ORG;
+    }
 
-        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ))
-            return -1;
-        if (flags & PAGE_WRITE) {
-            if (!(p->flags & PAGE_WRITE_ORG))
+    mmap_read_lock();
+    /* end is 0 if the range reaches the top of the address space */
+    if (!interval_tree_check(&page_ranges, start,
+                             (uint64_t)start + (end - start), mask)) {
+        mmap_read_unlock();
+        return -1;
+    }
+    protected = (flags & PAGE_WRITE) &&
+        !interval_tree_check(&page_ranges, start,
+                             (uint64_t)start + (end - start), PAGE_WRITE);
+    mmap_read_unlock();
+
+    if (protected) {
+        /* unprotect the pages that were put read-only because they
+           contain translated code */
+        for (addr = start, len = end - start;
+             len != 0;
+             len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
+            if (!(page_get_flags(addr) & PAGE_WRITE) &&
+                !page_unprotect(addr, 0, NULL)) {
                 return -1;
-            /* unprotect the page if it was put read-only because it
-               contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
-                if (!page_unprotect(addr, 0, NULL))
-                    return -1;
             }
-            return 0;
         }
     }
     return 0;
@@ -2506,31 +2637,41 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
 int page_unprotect(target_ulong address, unsigned long pc, void *puc)
 {
     unsigned int prot;
-    PageDesc *p;
+    int flags;
     target_ulong host_start, host_end, addr;
 
+    /* Most faults are either not ours or for a page that another thread
+       has just unprotected; neither needs the lock exclusively.  */
+    flags = page_get_flags(address);
+    if (!(flags & PAGE_WRITE_ORG)) {
+        return 0;
+    }
+    if (flags & PAGE_WRITE) {
+        return 1;
+    }
+
     /* Technically this isn't safe inside a signal handler.  However we
        know this only ever happens in a synchronous SEGV handler, so in
        practice it seems to be ok.  */
     mmap_lock();
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        mmap_unlock();
-        return 0;
-    }
+    flags = interval_tree_get(&page_ranges, address);
 
     /* if the page was really writable, then we change its
        protection back to writable */
-    if ((p->flags & PAGE_WRITE_ORG) && !(p->flags & PAGE_WRITE)) {
+    if ((flags & PAGE_WRITE_ORG) && !(flags & PAGE_WRITE)) {
         host_start = address & qemu_host_page_mask;
         host_end = host_start + qemu_host_page_size;
 
         prot = 0;
         for (addr = host_start ; addr < host_end ; addr += TARGET_PAGE_SIZE) {
-            p = page_find(addr >> TARGET_PAGE_BITS);
-            p->flags |= PAGE_WRITE;
-            prot |= p->flags;
+            flags = interval_tree_get(&page_ranges, addr);
+            if ((flags & PAGE_WRITE_ORG) && !(flags & PAGE_WRITE)) {
+                flags |= PAGE_WRITE;
+                interval_tree_set(&page_ranges, addr, addr + TARGET_PAGE_SIZE,
+                                  flags);
+            }
+            prot |= flags;
 
             /* and since the content will be modified, we must invalidate
                the corresponding translated code. */
@@ -2546,7 +2687,8 @@ int page_unprotect(target_ulong address, unsigned long pc, void *puc)
         return 1;
     }
     mmap_unlock();
-    return 0;
+    /* another thread may have unprotected it in the meantime */
+    return (flags & PAGE_WRITE_ORG) != 0;
 }
 
 static inline void tlb_set_dirty(CPUState *env,
@@ -2674,7 +2816,11 @@ void cpu_register_physical_memory_offset(target_phys_addr_t start_addr,
        reset the modified entries */
     /* XXX: slow ! */
     for(env = first_cpu; env != NULL; env = env->next_cpu) {
-        tlb_flush(env, 1);
+        if (tcg_vcpu_threads) {
+            async_run_on_cpu(env, tlb_flush_work, env);
+        } else {
+            tlb_flush(env, 1);
+        }
     }
 }
 
@@ -2707,6 +2853,86 @@ void qemu_flush_coalesced_mmio_buffer(void)
         kvm_flush_coalesced_mmio_buffer();
 }
 
+#ifndef _WIN32
+
+#define RAM_PREFAULT_MAX_THREADS 64
+
+typedef struct RAMPrefaultChunk {
+    uint8_t *addr;
+    ram_addr_t len;
+    unsigned long pagesize;
+} RAMPrefaultChunk;
+
+static void *ram_prefault_thread(void *opaque)
+{
+    RAMPrefaultChunk *chunk = opaque;
+    ram_addr_t off;
+
+    for (off = 0; off < chunk->len; off += chunk->pagesize) {
+        volatile uint8_t *p = chunk->addr + off;
+        *p = *p;
+    }
+    return NULL;
+}
+
+/* Touch every page of the area so that the guest does not take the page
+   faults on first access.  The area is split into contiguous chunks, one
+   per -mem-prealloc-threads thread; the calling thread does the first. */
+static void ram_prefault(uint8_t *host, ram_addr_t size, unsigned long pagesize)
+{
+    pthread_t threads[RAM_PREFAULT_MAX_THREADS];
+    RAMPrefaultChunk chunks[RAM_PREFAULT_MAX_THREADS];
+    int started[RAM_PREFAULT_MAX_THREADS];
+    sigset_t set, oldset;
+    ram_addr_t npages, per_thread, off;
+    int nthreads, i;
+
+    npages = size / pagesize;
+    nthreads = MIN(mem_prealloc_threads, RAM_PREFAULT_MAX_THREADS);
+    if (nthreads > npages) {
+        nthreads = npages;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    per_thread = (npages + nthreads - 1) / nthreads * pagesize;
+
+    /* the helpers must not steal the alarm and I/O signals */
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oldset);
+    for (i = 0, off = 0; i < nthreads; i++, off += per_thread) {
+        chunks[i].addr = host + off;
+        chunks[i].len = off < size ? MIN(per_thread, size - off) : 0;
+        chunks[i].pagesize = pagesize;
+        started[i] = i > 0 && pthread_create(&threads[i], NULL,
+                                             ram_prefault_thread,
+                                             &chunks[i]) == 0;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+    for (i = 0; i < nthreads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            ram_prefault_thread(&chunks[i]);
+        }
+    }
+}
+
+#else
+
+static void ram_prefault(uint8_t *host, ram_addr_t size, unsigned long pagesize)
+{
+    ram_addr_t off;
+
+    for (off = 0; off < size; off += pagesize) {
+        volatile uint8_t *p = host + off;
+        *p = *p;
+    }
+}
+
+#endif
+
 #if defined(__linux__) && !defined(TARGET_S390X)
 
 #include <sys/vfs.h>
@@ -2739,10 +2965,7 @@ static void *file_ram_alloc(RAMBlock *block,
 {
     char *filename;
     void *area;
-    int fd;
-#ifdef MAP_POPULATE
-    int flags;
-#endif
+    int fd, flags;
     unsigned long hpagesize;
 
     hpagesize = gethugepagesize(path);
@@ -2783,26 +3006,175 @@ static void *file_ram_alloc(RAMBlock *block,
     if (ftruncate(fd, memory))
         perror("ftruncate");
 
-#ifdef MAP_POPULATE
-    /* NB: MAP_POPULATE won't exhaustively alloc all phys pages in the case
-     * MAP_PRIVATE is requested.  For mem_prealloc we mmap as MAP_SHARED
-     * to sidestep this quirk.
+    /* With mem_prealloc, ram_prefault touches every page once the block
+     * is bound to its NUMA nodes, so MAP_POPULATE would only fault them in
+     * twice.  The mapping is MAP_SHARED so that the pages touched end up
+     * in the hugetlbfs file rather than in private copies.
      */
-    flags = mem_prealloc ? MAP_POPULATE | MAP_SHARED : MAP_PRIVATE;
+    flags = mem_prealloc ? MAP_SHARED : MAP_PRIVATE;
     area = mmap(0, memory, PROT_READ | PROT_WRITE, flags, fd, 0);
-#else
-    area = mmap(0, memory, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-#endif
     if (area == MAP_FAILED) {
         perror("file_ram_alloc: can't mmap RAM pages");
         close(fd);
         return (NULL);
     }
     block->fd = fd;
+    block->page_size = hpagesize;
     return area;
 }
 #endif
 
+#if defined(__linux__)
+/* Transparent hugepages are only visible in /proc/self/smaps, so add up
+   AnonHugePages over the mappings that overlap the block.  Returns -1 if
+   the host does not report it. */
+int64_t qemu_ram_block_thp_size(RAMBlock *block)
+{
+    unsigned long start = (unsigned long)block->host;
+    unsigned long end = start + block->length;
+    unsigned long vma_start, vma_end, kb;
+    int overlaps = 0;
+    int64_t total = -1;
+    char line[256];
+    FILE *f;
+
+    f = fopen("/proc/self/smaps", "r");
+    if (!f) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%lx-%lx ", &vma_start, &vma_end) == 2) {
+            overlaps = vma_start < end && vma_end > start;
+        } else if (overlaps &&
+                   sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            total = (total < 0 ? 0 : total) + (int64_t)kb * 1024;
+        }
+    }
+    fclose(f);
+    return total;
+}
+#else
+int64_t qemu_ram_block_thp_size(RAMBlock *block)
+{
+    return -1;
+}
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_mbind) && defined(__NR_get_mempolicy)
+
+#define QEMU_MPOL_DEFAULT    0
+#define QEMU_MPOL_PREFERRED  1
+#define QEMU_MPOL_BIND       2
+#define QEMU_MPOL_INTERLEAVE 3
+#define QEMU_MPOL_MF_MOVE    (1 << 1)
+#define QEMU_MPOL_F_ADDR     (1 << 1)
+
+#define HOST_NODE_BITS 1024
+
+/* host address of each guest node's memory, if it was bound */
+static uint8_t *numa_node_host_addr[MAX_NODES];
+
+static void qemu_ram_mbind(uint8_t *addr, ram_addr_t len, int host_node)
+{
+    unsigned long nodemask[HOST_NODE_BITS / (8 * sizeof(unsigned long))];
+    int bits = 8 * sizeof(unsigned long);
+
+    if (host_node >= HOST_NODE_BITS) {
+        fprintf(stderr, "qemu: host node %d out of range\n", host_node);
+        return;
+    }
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[host_node / bits] |= 1UL << (host_node % bits);
+
+    /* the kernel expects one more than the number of bits in the mask */
+    if (syscall(__NR_mbind, addr, len, QEMU_MPOL_BIND, nodemask,
+                HOST_NODE_BITS + 1, QEMU_MPOL_MF_MOVE) < 0) {
+        fprintf(stderr, "qemu: cannot bind guest memory to host node %d: %s\n",
+                host_node, strerror(errno));
+    }
+}
+
+/* Guest NUMA nodes are laid out one after the other over main memory, in
+   the order the firmware tables describe them.  Bind each node's share of
+   the main memory block at 'start' to the host node given with
+   -numa node,hostnode=N before it is touched. */
+static void ram_numa_bind(uint8_t *host, ram_addr_t start, ram_addr_t length)
+{
+    uintptr_t page_mask = getpagesize() - 1;
+    ram_addr_t node_start = 0, node_end, lo, hi;
+    uintptr_t addr, end;
+    int i;
+
+    for (i = 0; i < nb_numa_nodes; i++, node_start = node_end) {
+        node_end = node_start + node_mem[i];
+        if (i == nb_numa_nodes - 1) {
+            node_end = start + length;
+        }
+        lo = MAX(node_start, start);
+        hi = MIN(node_end, start + length);
+        if (node_host[i] < 0 || lo >= hi) {
+            continue;
+        }
+        addr = ((uintptr_t)host + (lo - start) + page_mask) & ~page_mask;
+        end = ((uintptr_t)host + (hi - start)) & ~page_mask;
+        if (end > addr) {
+            qemu_ram_mbind((uint8_t *)addr, end - addr, node_host[i]);
+            if (!numa_node_host_addr[i]) {
+                numa_node_host_addr[i] = (uint8_t *)addr;
+            }
+        }
+    }
+}
+
+int qemu_ram_numa_policy(int node, int *host_node)
+{
+    unsigned long nodemask[HOST_NODE_BITS / (8 * sizeof(unsigned long))];
+    int bits = 8 * sizeof(unsigned long);
+    int mode, i;
+
+    if (node < 0 || node >= MAX_NODES || !numa_node_host_addr[node]) {
+        return -1;
+    }
+    if (syscall(__NR_get_mempolicy, &mode, nodemask, HOST_NODE_BITS + 1,
+                numa_node_host_addr[node], QEMU_MPOL_F_ADDR) < 0) {
+        return -1;
+    }
+    *host_node = -1;
+    for (i = 0; i < HOST_NODE_BITS; i++) {
+        if (nodemask[i / bits] & (1UL << (i % bits))) {
+            *host_node = i;
+            break;
+        }
+    }
+    return mode;
+}
+
+#else
+
+static void ram_numa_bind(uint8_t *host, ram_addr_t start, ram_addr_t length)
+{
+    int i;
+
+    for (i = 0; i < nb_numa_nodes; i++) {
+        if (node_host[i] >= 0) {
+            fprintf(stderr, "qemu: NUMA memory binding not supported "
+                    "on this host\n");
+            return;
+        }
+    }
+}
+
+int qemu_ram_numa_policy(int node, int *host_node)
+{
+    return -1;
+}
+
+#endif
+
 static ram_addr_t find_ram_offset(ram_addr_t size)
 {
     RAMBlock *block, *next_block;
@@ -2840,8 +3212,11 @@ static ram_addr_t last_ram_offset(void)
     return last;
 }
 
-ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
-                                   ram_addr_t size, void *host)
+/* amount of guest main memory allocated so far */
+static ram_addr_t main_ram_size;
+
+static ram_addr_t ram_alloc(DeviceState *dev, const char *name,
+                            ram_addr_t size, void *host, int main_ram)
 {
     RAMBlock *new_block, *block;
 
@@ -2865,6 +3240,7 @@ ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
         }
     }
 
+    new_block->page_size = getpagesize();
     if (host) {
         new_block->host = host;
     } else {
@@ -2872,8 +3248,12 @@ ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
 #if defined (__linux__) && !defined(TARGET_S390X)
             new_block->host = file_ram_alloc(new_block, size, mem_path);
             if (!new_block->host) {
+                fprintf(stderr, "Warning: cannot allocate \"%s\" from %s, "
+                        "falling back to anonymous memory\n",
+                        new_block->idstr, mem_path);
                 new_block->host = qemu_vmalloc(size);
                 qemu_madvise(new_block->host, size, QEMU_MADV_MERGEABLE);
+                qemu_madvise(new_block->host, size, QEMU_MADV_HUGEPAGE);
             }
 #else
             fprintf(stderr, "-mem-path option unsupported\n");
@@ -2889,11 +3269,23 @@ ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
             new_block->host = qemu_vmalloc(size);
 #endif
             qemu_madvise(new_block->host, size, QEMU_MADV_MERGEABLE);
+            qemu_madvise(new_block->host, size, QEMU_MADV_HUGEPAGE);
+        }
+        /* guest RAM must not be copied into children we fork to exec */
+        qemu_madvise(new_block->host, size, QEMU_MADV_DONTFORK);
+        if (main_ram && nb_numa_nodes > 0) {
+            ram_numa_bind(new_block->host, main_ram_size, size);
+        }
+        if (mem_prealloc) {
+            ram_prefault(new_block->host, size, new_block->page_size);
         }
     }
 
     new_block->offset = find_ram_offset(size);
     new_block->length = size;
+    if (main_ram) {
+        main_ram_size += size;
+    }
 
     QLIST_INSERT_HEAD(&ram_list.blocks, new_block, next);
 
@@ -2908,9 +3300,39 @@ ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
     return new_block->offset;
 }
 
+ram_addr_t qemu_ram_alloc_from_ptr(DeviceState *dev, const char *name,
+                                   ram_addr_t size, void *host)
+{
+    return ram_alloc(dev, name, size, host, 0);
+}
+
 ram_addr_t qemu_ram_alloc(DeviceState *dev, const char *name, ram_addr_t size)
 {
-    return qemu_ram_alloc_from_ptr(dev, name, size, NULL);
+    return ram_alloc(dev, name, size, NULL, 0);
+}
+
+ram_addr_t qemu_ram_alloc_main(DeviceState *dev, const char *name,
+                               ram_addr_t size)
+{
+    return ram_alloc(dev, name, size, NULL, 1);
+}
+
+/* Called once the machine is built: hostnode= has no effect on boards
+   that do not allocate their RAM with qemu_ram_alloc_main. */
+void qemu_ram_numa_check(void)
+{
+    int i;
+
+    if (main_ram_size) {
+        return;
+    }
+    for (i = 0; i < nb_numa_nodes; i++) {
+        if (node_host[i] >= 0) {
+            fprintf(stderr, "qemu: warning: this machine does not support "
+                    "binding guest memory to host nodes\n");
+            return;
+        }
+    }
 }
 
 void qemu_ram_free(ram_addr_t addr)
@@ -3197,7 +3619,9 @@ static void check_watchpoint(int offset, int len_mask, int flags)
                     env->exception_index = EXCP_DEBUG;
                 } else {
                     cpu_get_tb_cpu_state(env, &pc, &cs_base, &cpu_flags);
+                    tb_cache_lock();
                     tb_gen_code(env, pc, cs_base, cpu_flags, 1);
+                    tb_cache_unlock();
                 }
                 cpu_resume_from_signal(env, NULL);
             }
@@ -4261,7 +4685,9 @@ void cpu_io_recompile(CPUState *env, void *retaddr)
     tb_phys_invalidate(tb, -1);
     /* FIXME: In theory this could raise an exception.  In practice
        we have already translated the block once so it's probably ok.  */
+    tb_cache_lock();
     tb_gen_code(env, pc, cs_base, flags, cflags);
+    tb_cache_unlock();
     /* TODO: If env->pc != tb->pc (i.e. the faulting instruction was not
        the first in the TB) then we end up generating a whole new TB and
        repeating the fault, which is horribly inefficient.
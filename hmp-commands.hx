@@ -164,6 +164,39 @@ STEXI
 @item screendump @var{filename}
 @findex screendump
 Save screen into PPM image @var{filename}.
+ETEXI
+
+    {
+        .name       = "screenrecord",
+        .args_type  = "filename:F",
+        .params     = "filename",
+        .help       = "record screen changes into 'filename'",
+        .user_print = monitor_user_noop,
+        .mhandler.cmd_new = do_screen_record,
+    },
+
+STEXI
+@item screenrecord @var{filename}
+@findex screenrecord
+Record the screen into @var{filename} until @code{screenrecord_stop}.
+Only the parts of the screen that changed are stored, as zlib compressed
+frames taken at most 25 times per second; @command{qemu-fbrec} turns
+the recording into PNG images.
+ETEXI
+
+    {
+        .name       = "screenrecord_stop",
+        .args_type  = "",
+        .params     = "",
+        .help       = "stop recording the screen",
+        .user_print = monitor_user_noop,
+        .mhandler.cmd_new = do_screen_record_stop,
+    },
+
+STEXI
+@item screenrecord_stop
+@findex screenrecord_stop
+Stop recording the screen and close the file.
 ETEXI
 
     {
@@ -283,6 +316,23 @@ STEXI
 @findex singlestep
 Run the emulation in single step mode.
 If called with option off, the emulation returns to normal mode.
+ETEXI
+
+    {
+        .name       = "event_loop_stats",
+        .args_type  = "option:s?",
+        .params     = "[on|off]",
+        .help       = "account time spent in main loop callbacks",
+        .mhandler.cmd = do_event_loop_stats,
+    },
+
+STEXI
+@item event_loop_stats [off]
+@findex event_loop_stats
+Start accounting how often each fd handler, timer and bottom half of the
+main loop runs and how long it takes, starting from zero.  The results are
+shown by @code{info event-loop}.  If called with option off, accounting
+stops and the collected data is kept.
 ETEXI
 
     {
@@ -1314,6 +1364,14 @@ show dynamic compiler info
 show KVM information
 @item info numa
 show NUMA information
+@item info ramblock
+show the RAM blocks and the host page size backing them
+@item info mempool
+show allocation counts of the object pools used by device emulation
+@item info event-loop
+show calls, total and maximum time of each main loop callback
+@item info screenrecord
+show the file, frame count and sizes of the screen recording
 @item info kvm
 show KVM information
 @item info usb
@@ -32,6 +32,7 @@
 #include "console.h"
 #include "vga_int.h"
 #include "loader.h"
+#include "host-utils.h"
 
 /*
  * TODO:
@@ -296,6 +297,7 @@ static void cirrus_bitblt_fill_nop(CirrusVGAState *s,
 
 #define ROP_NAME src
 #define ROP_FN(d, s) s
+#define ROP_COPY
 #include "cirrus_vga_rop.h"
 
 #define ROP_NAME 1
@@ -607,6 +609,25 @@ static void cirrus_invalidate_region(CirrusVGAState * s, int off_begin,
     int off_cur;
     int off_cur_end;
 
+    /*
+     * When less than a page separates two lines every page between the
+     * first and the last line is written, so mark them in one go.  A
+     * negative pitch comes from a backward blit, which starts at the last
+     * byte of the bottom line.
+     */
+    if (lines > 0 && ABS(off_pitch) - bytesperline < TARGET_PAGE_SIZE) {
+        off_cur = off_begin & s->cirrus_addr_mask;
+        if (off_pitch < 0) {
+            off_cur += (lines - 1) * off_pitch - (bytesperline - 1);
+        }
+        off_cur_end = off_cur + (lines - 1) * ABS(off_pitch) + bytesperline;
+        if (off_cur >= 0 && off_cur_end <= s->vga.vram_size) {
+            cpu_physical_memory_set_dirty_range(s->vga.vram_offset + off_cur,
+                                                off_cur_end - off_cur, 0xff);
+            return;
+        }
+    }
+
     for (y = 0; y < lines; y++) {
 	off_cur = off_begin;
 	off_cur_end = (off_cur + bytesperline) & s->cirrus_addr_mask;
@@ -37,32 +37,92 @@ static inline void glue(rop_32_,ROP_NAME)(uint32_t *dst, uint32_t src)
     *dst = ROP_FN(*dst, src);
 }
 
+/* eight bytes at once; all ROPs are bitwise, so this equals eight rop_8 */
+static inline void glue(rop_64_,ROP_NAME)(uint8_t *dst, uint64_t src)
+{
+    uint64_t val;
+
+    memcpy(&val, dst, sizeof(val));
+    val = ROP_FN(val, src);
+    memcpy(dst, &val, sizeof(val));
+}
+
 #define ROP_OP(d, s) glue(rop_8_,ROP_NAME)(d, s)
 #define ROP_OP_16(d, s) glue(rop_16_,ROP_NAME)(d, s)
 #define ROP_OP_32(d, s) glue(rop_32_,ROP_NAME)(d, s)
+#define ROP_OP_64(d, s) glue(rop_64_,ROP_NAME)(d, s)
 #undef ROP_FN
 
+/*
+ * One line of a forward blit.  The hardware walks it byte by byte, so a
+ * source that starts just below the destination reads bytes the blit
+ * itself has written; in every other case whole words, or a memmove for
+ * a plain copy, give the same result.
+ */
+static inline void
+glue(cirrus_bitblt_line_fwd_, ROP_NAME)(uint8_t *dst, const uint8_t *src,
+                                        int bltwidth)
+{
+    int x = 0;
+
+    if (dst <= src || dst >= src + bltwidth) {
+#ifdef ROP_COPY
+        memmove(dst, src, bltwidth);
+        return;
+#else
+        for (; x + 8 <= bltwidth; x += 8) {
+            uint64_t val;
+
+            memcpy(&val, src + x, sizeof(val));
+            ROP_OP_64(dst + x, val);
+        }
+#endif
+    }
+    for (; x < bltwidth; x++) {
+        ROP_OP(&dst[x], src[x]);
+    }
+}
+
+/* Same for a backward blit, where dst and src point to the last byte */
+static inline void
+glue(cirrus_bitblt_line_bkwd_, ROP_NAME)(uint8_t *dst, const uint8_t *src,
+                                         int bltwidth)
+{
+    int x = 0;
+
+    if (dst >= src || dst <= src - bltwidth) {
+#ifdef ROP_COPY
+        memmove(dst - bltwidth + 1, src - bltwidth + 1, bltwidth);
+        return;
+#else
+        for (; x + 8 <= bltwidth; x += 8) {
+            uint64_t val;
+
+            memcpy(&val, src - x - 7, sizeof(val));
+            ROP_OP_64(dst - x - 7, val);
+        }
+#endif
+    }
+    for (; x < bltwidth; x++) {
+        ROP_OP(dst - x, *(src - x));
+    }
+}
+
 static void
 glue(cirrus_bitblt_rop_fwd_, ROP_NAME)(CirrusVGAState *s,
                              uint8_t *dst,const uint8_t *src,
                              int dstpitch,int srcpitch,
                              int bltwidth,int bltheight)
 {
-    int x,y;
-    dstpitch -= bltwidth;
-    srcpitch -= bltwidth;
+    int y;
 
-    if (dstpitch < 0 || srcpitch < 0) {
+    if (dstpitch < bltwidth || srcpitch < bltwidth) {
         /* is 0 valid? srcpitch == 0 could be useful */
         return;
     }
 
     for (y = 0; y < bltheight; y++) {
-        for (x = 0; x < bltwidth; x++) {
-            ROP_OP(dst, *src);
-            dst++;
-            src++;
-        }
+        glue(cirrus_bitblt_line_fwd_, ROP_NAME)(dst, src, bltwidth);
         dst += dstpitch;
         src += srcpitch;
     }
@@ -74,15 +134,10 @@ glue(cirrus_bitblt_rop_bkwd_, ROP_NAME)(CirrusVGAState *s,
                                         int dstpitch,int srcpitch,
                                         int bltwidth,int bltheight)
 {
-    int x,y;
-    dstpitch += bltwidth;
-    srcpitch += bltwidth;
+    int y;
+
     for (y = 0; y < bltheight; y++) {
-        for (x = 0; x < bltwidth; x++) {
-            ROP_OP(dst, *src);
-            dst--;
-            src--;
-        }
+        glue(cirrus_bitblt_line_bkwd_, ROP_NAME)(dst, src, bltwidth);
         dst += dstpitch;
         src += srcpitch;
     }
@@ -206,3 +261,5 @@ glue(glue(cirrus_bitblt_rop_bkwd_transp_, ROP_NAME),_16)(CirrusVGAState *s,
 #undef ROP_OP
 #undef ROP_OP_16
 #undef ROP_OP_32
+#undef ROP_OP_64
+#undef ROP_COPY
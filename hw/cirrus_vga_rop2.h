@@ -129,6 +129,13 @@ glue(glue(glue(cirrus_colorexpand_transp_, ROP_NAME), _),DEPTH)
                 bitmask = 0x80;
                 bits = *src++ ^ bits_xor;
             }
+            if (!(bits & ((bitmask << 1) - 1))) {
+                /* nothing left to draw for this source byte */
+                x += ctz32(bitmask) * (DEPTH / 8);
+                d += (ctz32(bitmask) + 1) * (DEPTH / 8);
+                bitmask = 0;
+                continue;
+            }
             index = (bits & bitmask);
             if (index) {
                 PUTPIXEL();
@@ -263,13 +270,31 @@ glue(glue(glue(cirrus_fill_, ROP_NAME), _),DEPTH)
     uint8_t *d, *d1;
     uint32_t col;
     int x, y;
+#if DEPTH != 24
+    uint64_t col64;
+#endif
 
     col = s->cirrus_blt_fgcol;
+#if DEPTH == 8
+    col64 = (uint8_t)col * 0x0101010101010101ULL;
+#elif DEPTH == 16
+    col64 = (uint16_t)col * 0x0001000100010001ULL;
+#elif DEPTH == 32
+    col64 = (uint32_t)col * 0x0000000100000001ULL;
+#endif
 
     d1 = dst;
     for(y = 0; y < height; y++) {
         d = d1;
-        for(x = 0; x < width; x += (DEPTH / 8)) {
+        x = 0;
+#if DEPTH != 24
+        /* a whole number of pixels per word keeps the pattern in phase */
+        for (; x + 8 <= width; x += 8) {
+            ROP_OP_64(d, col64);
+            d += 8;
+        }
+#endif
+        for(; x < width; x += (DEPTH / 8)) {
             PUTPIXEL();
             d += (DEPTH / 8);
         }
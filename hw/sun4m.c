@@ -724,7 +724,7 @@ static int ram_init1(SysBusDevice *dev)
 
     RAM_size = d->size;
 
-    ram_offset = qemu_ram_alloc(NULL, "sun4m.ram", RAM_size);
+    ram_offset = qemu_ram_alloc_main(NULL, "sun4m.ram", RAM_size);
     sysbus_init_mmio(dev, RAM_size, ram_offset);
     return 0;
 }
@@ -28,6 +28,11 @@
 #include "vga_int.h"
 #include "pixel_ops.h"
 #include "qemu-timer.h"
+#include "bitops.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 //#define DEBUG_VGA
 //#define DEBUG_VGA_MEM
@@ -939,6 +944,42 @@ typedef void vga_draw_glyph9_func(uint8_t *d, int linesize,
 typedef void vga_draw_line_func(VGACommonState *s1, uint8_t *d,
                                 const uint8_t *s, int width);
 
+#if defined(__SSE2__) && !defined(HOST_WORDS_BIGENDIAN) && \
+    !defined(TARGET_WORDS_BIGENDIAN)
+#define VGA_SSE2
+
+/*
+ * 15 (rgb555) or 16 (rgb565) bpp to 32 bpp xrgb, 8 pixels at a time.
+ * Returns the number of pixels converted; the caller does the rest.
+ */
+static inline int vga_draw_line16to32_sse2(uint8_t *d, const uint8_t *s,
+                                           int width, int bpp15)
+{
+    const __m128i mask5 = _mm_set1_epi16(0xf8);
+    const __m128i mask6 = _mm_set1_epi16(bpp15 ? 0xf8 : 0xfc);
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + x * 2));
+        __m128i r, g, b, gb;
+
+        if (bpp15) {
+            r = _mm_and_si128(_mm_srli_epi16(v, 7), mask5);
+            g = _mm_and_si128(_mm_srli_epi16(v, 2), mask6);
+        } else {
+            r = _mm_and_si128(_mm_srli_epi16(v, 8), mask5);
+            g = _mm_and_si128(_mm_srli_epi16(v, 3), mask6);
+        }
+        b = _mm_and_si128(_mm_slli_epi16(v, 3), mask5);
+        gb = _mm_or_si128(_mm_slli_epi16(g, 8), b);
+        _mm_storeu_si128((__m128i *)(d + x * 4), _mm_unpacklo_epi16(gb, r));
+        _mm_storeu_si128((__m128i *)(d + x * 4 + 16),
+                         _mm_unpackhi_epi16(gb, r));
+    }
+    return x;
+}
+#endif
+
 #define DEPTH 8
 #include "vga_template.h"
 
@@ -1615,16 +1656,64 @@ void vga_dirty_log_restart(VGACommonState *s)
 /*
  * graphic modes
  */
+
+/* Hash of len bytes at p, never 0 */
+static uint64_t vga_hash(const void *p, int len, uint64_t seed)
+{
+    const uint8_t *b = p;
+    uint64_t h = seed ^ 0xcbf29ce484222325ULL;
+    uint64_t v;
+    int i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&v, b + i, 8);
+        h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    for (; i < len; i++) {
+        h = (h ^ b[i]) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    return h | 1;
+}
+
+static inline int vga_page_dirty(VGACommonState *s, ram_addr_t page)
+{
+    ram_addr_t i = (page - s->vram_offset) >> TARGET_PAGE_BITS;
+
+    if (i < (s->vram_size >> TARGET_PAGE_BITS)) {
+        return test_bit(i, s->vram_dirty);
+    }
+    return cpu_physical_memory_get_dirty(page, VGA_DIRTY_FLAG);
+}
+
+static int vga_cursor_invalidated(VGACommonState *s, int height)
+{
+    int i;
+
+    for (i = 0; i < (height + 31) >> 5; i++) {
+        if (s->invalidated_y_table[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static void vga_draw_graphic(VGACommonState *s, int full_update)
 {
-    int y1, y, update, linesize, y_start, double_scan, mask, depth;
-    int width, height, shift_control, line_offset, bwidth, bits;
+    int y1, y, update, draw, cursor, linesize, y_start, double_scan, mask;
+    int width, height, shift_control, line_offset, bwidth, bits, depth;
     ram_addr_t page0, page1, page_min, page_max;
-    int disp_width, multi_scan, multi_run;
+    int disp_width, multi_scan, multi_run, hash_lines;
     uint8_t *d;
     uint32_t v, addr1, addr;
+    uint64_t key = 0;
     vga_draw_line_func *vga_draw_line;
 
+    if (full_update) {
+        /* coming from another mode: the surface may hold anything */
+        memset(s->line_hash, 0, sizeof(s->line_hash));
+    }
     full_update |= update_basic_params(s);
 
     if (!full_update)
@@ -1688,6 +1777,7 @@ static void vga_draw_graphic(VGACommonState *s, int full_update)
         s->last_line_offset = s->line_offset;
         s->last_depth = depth;
         full_update = 1;
+        memset(s->line_hash, 0, sizeof(s->line_hash));
     } else if (is_buffer_shared(s->ds->surface) &&
                (full_update || s->ds->surface->data != s->vram_ptr + (s->start_addr * 4))) {
         s->ds->surface->data = s->vram_ptr + (s->start_addr * 4);
@@ -1749,6 +1839,35 @@ static void vga_draw_graphic(VGACommonState *s, int full_update)
     if (!is_buffer_shared(s->ds->surface) && s->cursor_invalidate)
         s->cursor_invalidate(s);
 
+    /*
+     * Take the dirty state of the whole vram at once; a static screen
+     * needs no further work.
+     */
+    if (!cpu_physical_memory_get_dirty_range(s->vram_offset, s->vram_size,
+                                             VGA_DIRTY_FLAG, s->vram_dirty) &&
+        !full_update && !vga_cursor_invalidated(s, height)) {
+        return;
+    }
+
+    /*
+     * When we draw the lines ourselves, remember what each one was drawn
+     * from so that lines whose source did not change are skipped, even
+     * on a full update caused by a register or palette write.
+     */
+    hash_lines = !is_buffer_shared(s->ds->surface);
+    if (hash_lines) {
+        uint64_t params[] = {
+            (uintptr_t)vga_draw_line, (uintptr_t)s->rgb_to_pixel,
+            (uintptr_t)ds_get_data(s->ds), ds_get_linesize(s->ds),
+            width, disp_width,
+        };
+
+        key = vga_hash(&params, sizeof(params), 0);
+        if (bits <= 8) {
+            key = vga_hash(s->last_palette, sizeof(s->last_palette), key);
+        }
+    }
+
     line_offset = s->line_offset;
 #if 0
     printf("w=%d h=%d v=%d line_offset=%d cr[0x09]=0x%02x cr[0x17]=0x%02x linecmp=%d sr[0x01]=0x%02x\n",
@@ -1776,22 +1895,31 @@ static void vga_draw_graphic(VGACommonState *s, int full_update)
         page0 = s->vram_offset + (addr & TARGET_PAGE_MASK);
         page1 = s->vram_offset + ((addr + bwidth - 1) & TARGET_PAGE_MASK);
         update = full_update |
-            cpu_physical_memory_get_dirty(page0, VGA_DIRTY_FLAG) |
-            cpu_physical_memory_get_dirty(page1, VGA_DIRTY_FLAG);
+            vga_page_dirty(s, page0) | vga_page_dirty(s, page1);
         if ((page1 - page0) > TARGET_PAGE_SIZE) {
             /* if wide line, can use another page */
-            update |= cpu_physical_memory_get_dirty(page0 + TARGET_PAGE_SIZE,
-                                                    VGA_DIRTY_FLAG);
+            update |= vga_page_dirty(s, page0 + TARGET_PAGE_SIZE);
         }
         /* explicit invalidation for the hardware cursor */
-        update |= (s->invalidated_y_table[y >> 5] >> (y & 0x1f)) & 1;
+        cursor = (s->invalidated_y_table[y >> 5] >> (y & 0x1f)) & 1;
+        draw = update | cursor;
         if (update) {
-            if (y_start < 0)
-                y_start = y;
             if (page0 < page_min)
                 page_min = page0;
             if (page1 > page_max)
                 page_max = page1;
+            if (hash_lines) {
+                uint64_t h = vga_hash(s->vram_ptr + addr, bwidth, key);
+
+                if (h == s->line_hash[y] && !cursor) {
+                    draw = 0;
+                }
+                s->line_hash[y] = h;
+            }
+        }
+        if (draw) {
+            if (y_start < 0)
+                y_start = y;
             if (!(is_buffer_shared(s->ds->surface))) {
                 vga_draw_line(s, d, s->vram_ptr + addr, width);
                 if (s->cursor_draw_line)
@@ -2239,6 +2367,8 @@ void vga_common_init(VGACommonState *s, int vga_ram_size)
     s->vram_offset = qemu_ram_alloc(NULL, "vga.vram", vga_ram_size);
     s->vram_ptr = qemu_get_ram_ptr(s->vram_offset);
     s->vram_size = vga_ram_size;
+    s->vram_dirty = qemu_mallocz(BITS_TO_LONGS(vga_ram_size >> TARGET_PAGE_BITS)
+                                 * sizeof(unsigned long));
     s->get_bpp = vga_get_bpp;
     s->get_offsets = vga_get_offsets;
     s->get_resolution = vga_get_resolution;
@@ -174,6 +174,10 @@ typedef struct VGACommonState {
     /* tell for each page if it has been updated since the last time */
     uint32_t last_palette[256];
     uint32_t last_ch_attr[CH_ATTR_SIZE]; /* XXX: make it dynamic */
+    /* vram pages found dirty by the current vga_draw_graphic() pass */
+    unsigned long *vram_dirty;
+    /* hash of what each line was last drawn from, 0 if unknown */
+    uint64_t line_hash[VGA_MAX_HEIGHT];
     /* retrace */
     vga_retrace_fn retrace;
     vga_update_retrace_info_fn update_retrace_info;
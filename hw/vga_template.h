@@ -424,7 +424,16 @@ static void glue(vga_draw_line15_, PIXEL_NAME)(VGACommonState *s1, uint8_t *d,
     uint32_t v, r, g, b;
 
     w = width;
-    do {
+#if DEPTH == 32 && !defined(BGR_FORMAT) && defined(VGA_SSE2)
+    {
+        int done = vga_draw_line16to32_sse2(d, s, w, 1);
+
+        s += done * 2;
+        d += done * BPP;
+        w -= done;
+    }
+#endif
+    for (; w > 0; w--) {
         v = lduw_raw((void *)s);
         r = (v >> 7) & 0xf8;
         g = (v >> 2) & 0xf8;
@@ -432,7 +441,7 @@ static void glue(vga_draw_line15_, PIXEL_NAME)(VGACommonState *s1, uint8_t *d,
         ((PIXEL_TYPE *)d)[0] = glue(rgb_to_pixel, PIXEL_NAME)(r, g, b);
         s += 2;
         d += BPP;
-    } while (--w != 0);
+    }
 #endif
 }
 
@@ -449,7 +458,16 @@ static void glue(vga_draw_line16_, PIXEL_NAME)(VGACommonState *s1, uint8_t *d,
     uint32_t v, r, g, b;
 
     w = width;
-    do {
+#if DEPTH == 32 && !defined(BGR_FORMAT) && defined(VGA_SSE2)
+    {
+        int done = vga_draw_line16to32_sse2(d, s, w, 0);
+
+        s += done * 2;
+        d += done * BPP;
+        w -= done;
+    }
+#endif
+    for (; w > 0; w--) {
         v = lduw_raw((void *)s);
         r = (v >> 8) & 0xf8;
         g = (v >> 3) & 0xfc;
@@ -457,7 +475,7 @@ static void glue(vga_draw_line16_, PIXEL_NAME)(VGACommonState *s1, uint8_t *d,
         ((PIXEL_TYPE *)d)[0] = glue(rgb_to_pixel, PIXEL_NAME)(r, g, b);
         s += 2;
         d += BPP;
-    } while (--w != 0);
+    }
 #endif
 }
 
@@ -13,6 +13,7 @@
 
 #include <qemu-common.h>
 #include "qemu-error.h"
+#include "qemu-pool.h"
 #include "trace.h"
 #include "blockdev.h"
 #include "virtio-blk.h"
@@ -49,6 +50,10 @@ typedef struct VirtIOBlockReq
     struct VirtIOBlockReq *next;
 } VirtIOBlockReq;
 
+/* requests embed a whole VirtQueueElement, so keep them around */
+static MemPool virtio_blk_req_pool =
+    MEM_POOL_INITIALIZER("virtio-blk-req", sizeof(VirtIOBlockReq), 128);
+
 static void virtio_blk_req_complete(VirtIOBlockReq *req, int status)
 {
     VirtIOBlock *s = req->dev;
@@ -59,7 +64,7 @@ static void virtio_blk_req_complete(VirtIOBlockReq *req, int status)
     virtqueue_push(s->vq, &req->elem, req->qiov.size + sizeof(*req->in));
     virtio_notify(&s->vdev, s->vq);
 
-    qemu_free(req);
+    mem_pool_free(&virtio_blk_req_pool, req);
 }
 
 static int virtio_blk_handle_rw_error(VirtIOBlockReq *req, int error,
@@ -117,7 +122,7 @@ static void virtio_blk_flush_complete(void *opaque, int ret)
 
 static VirtIOBlockReq *virtio_blk_alloc_request(VirtIOBlock *s)
 {
-    VirtIOBlockReq *req = qemu_malloc(sizeof(*req));
+    VirtIOBlockReq *req = mem_pool_alloc(&virtio_blk_req_pool);
     req->dev = s;
     req->qiov.size = 0;
     req->next = NULL;
@@ -130,7 +135,7 @@ static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s)
 
     if (req != NULL) {
         if (!virtqueue_pop(s->vq, &req->elem)) {
-            qemu_free(req);
+            mem_pool_free(&virtio_blk_req_pool, req);
             return NULL;
         }
     }
@@ -0,0 +1,358 @@
+/*
+ * Ordered map of disjoint address ranges
+ *
+ * A treap: a binary search tree on the range start whose shape is
+ * given by random node priorities, which keeps it balanced on average
+ * and makes splitting and joining trees cheap.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <sys/mman.h>
+#include "qemu-common.h"
+#include "interval-tree.h"
+
+struct IntervalNode {
+    uint64_t start;
+    uint64_t end;
+    int value;
+    uint32_t prio;
+    /* summary of the subtree rooted here */
+    uint64_t min_start;
+    uint64_t max_end;
+    uint64_t max_gap;
+    IntervalNode *left;
+    IntervalNode *right;
+};
+
+#define NODES_PER_CHUNK  1024
+
+static IntervalNode *free_nodes;
+static uint32_t prio_seed = 2463534242u;
+
+static IntervalNode *node_new(uint64_t start, uint64_t end, int value)
+{
+    IntervalNode *n;
+
+    if (!free_nodes) {
+        /* Not malloc: the tree is updated with the mmap lock held.  */
+        IntervalNode *chunk = mmap(NULL, NODES_PER_CHUNK * sizeof(*chunk),
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        int i;
+
+        if (chunk == MAP_FAILED) {
+            abort();
+        }
+        for (i = 0; i < NODES_PER_CHUNK; i++) {
+            chunk[i].left = free_nodes;
+            free_nodes = &chunk[i];
+        }
+    }
+    n = free_nodes;
+    free_nodes = n->left;
+
+    /* xorshift32 */
+    prio_seed ^= prio_seed << 13;
+    prio_seed ^= prio_seed >> 17;
+    prio_seed ^= prio_seed << 5;
+
+    n->start = n->min_start = start;
+    n->end = n->max_end = end;
+    n->value = value;
+    n->prio = prio_seed;
+    n->max_gap = 0;
+    n->left = n->right = NULL;
+    return n;
+}
+
+static void node_free(IntervalNode *n)
+{
+    n->left = free_nodes;
+    free_nodes = n;
+}
+
+static void tree_free(IntervalNode *n)
+{
+    while (n) {
+        IntervalNode *right = n->right;
+
+        tree_free(n->left);
+        node_free(n);
+        n = right;
+    }
+}
+
+static void node_update(IntervalNode *n)
+{
+    uint64_t gap = 0;
+
+    n->min_start = n->start;
+    n->max_end = n->end;
+    if (n->left) {
+        n->min_start = n->left->min_start;
+        gap = n->start - n->left->max_end;
+        if (n->left->max_gap > gap) {
+            gap = n->left->max_gap;
+        }
+    }
+    if (n->right) {
+        n->max_end = n->right->max_end;
+        if (n->right->min_start - n->end > gap) {
+            gap = n->right->min_start - n->end;
+        }
+        if (n->right->max_gap > gap) {
+            gap = n->right->max_gap;
+        }
+    }
+    n->max_gap = gap;
+}
+
+/* Everything in 'l' lies below everything in 'r'.  */
+static IntervalNode *tree_join(IntervalNode *l, IntervalNode *r)
+{
+    if (!l) {
+        return r;
+    }
+    if (!r) {
+        return l;
+    }
+    if (l->prio > r->prio) {
+        l->right = tree_join(l->right, r);
+        node_update(l);
+        return l;
+    }
+    r->left = tree_join(l, r->left);
+    node_update(r);
+    return r;
+}
+
+/* Ranges starting below 'key' go to *l, the others to *r.  */
+static void tree_split(IntervalNode *n, uint64_t key,
+                       IntervalNode **l, IntervalNode **r)
+{
+    if (!n) {
+        *l = *r = NULL;
+    } else if (n->start < key) {
+        tree_split(n->right, key, &n->right, r);
+        node_update(n);
+        *l = n;
+    } else {
+        tree_split(n->left, key, l, &n->left);
+        node_update(n);
+        *r = n;
+    }
+}
+
+static IntervalNode *tree_pop_last(IntervalNode **pn)
+{
+    IntervalNode *n = *pn, *last;
+
+    if (!n->right) {
+        *pn = n->left;
+        n->left = NULL;
+        node_update(n);
+        return n;
+    }
+    last = tree_pop_last(&n->right);
+    node_update(n);
+    return last;
+}
+
+static IntervalNode *tree_pop_first(IntervalNode **pn)
+{
+    IntervalNode *n = *pn, *first;
+
+    if (!n->left) {
+        *pn = n->right;
+        n->right = NULL;
+        node_update(n);
+        return n;
+    }
+    first = tree_pop_first(&n->left);
+    node_update(n);
+    return first;
+}
+
+void interval_tree_set(IntervalTree *t, uint64_t start, uint64_t end,
+                       int value)
+{
+    IntervalNode *l, *m, *r, *n;
+    uint64_t tail_end = 0;
+    int tail_value = 0;
+
+    tree_split(t->root, start, &l, &m);
+    tree_split(m, end, &m, &r);
+
+    /* Cut the range overlapping 'start' and keep what lies beyond 'end'.  */
+    if (l) {
+        n = tree_pop_last(&l);
+        if (n->end > start) {
+            if (n->end > end) {
+                tail_end = n->end;
+                tail_value = n->value;
+            }
+            n->end = start;
+            node_update(n);
+        }
+        l = tree_join(l, n);
+    }
+    if (m) {
+        n = tree_pop_last(&m);
+        if (n->end > end) {
+            tail_end = n->end;
+            tail_value = n->value;
+        }
+        node_free(n);
+        tree_free(m);
+    }
+    if (tail_end) {
+        r = tree_join(node_new(end, tail_end, tail_value), r);
+    }
+
+    if (value) {
+        /* Merge with neighbours of the same value.  */
+        if (l) {
+            n = tree_pop_last(&l);
+            if (n->end == start && n->value == value) {
+                start = n->start;
+                node_free(n);
+            } else {
+                l = tree_join(l, n);
+            }
+        }
+        if (r) {
+            n = tree_pop_first(&r);
+            if (n->start == end && n->value == value) {
+                end = n->end;
+                node_free(n);
+            } else {
+                r = tree_join(n, r);
+            }
+        }
+        l = tree_join(l, node_new(start, end, value));
+    }
+    t->root = tree_join(l, r);
+}
+
+int interval_tree_get(IntervalTree *t, uint64_t addr)
+{
+    IntervalNode *n = t->root;
+
+    while (n) {
+        if (addr < n->start) {
+            n = n->left;
+        } else if (addr >= n->end) {
+            n = n->right;
+        } else {
+            return n->value;
+        }
+    }
+    return 0;
+}
+
+static int tree_foreach(IntervalNode *n, interval_tree_fn fn, void *opaque)
+{
+    int rc;
+
+    while (n) {
+        rc = tree_foreach(n->left, fn, opaque);
+        if (rc) {
+            return rc;
+        }
+        rc = fn(opaque, n->start, n->end, n->value);
+        if (rc) {
+            return rc;
+        }
+        n = n->right;
+    }
+    return 0;
+}
+
+int interval_tree_foreach(IntervalTree *t, interval_tree_fn fn, void *opaque)
+{
+    return tree_foreach(t->root, fn, opaque);
+}
+
+/* In-order walk over the ranges overlapping [*cur, end); *cur advances
+   over the covered part.  */
+static int tree_check(IntervalNode *n, uint64_t *cur, uint64_t end, int mask)
+{
+    while (n && *cur < end && n->max_end > *cur && n->min_start < end) {
+        if (!tree_check(n->left, cur, end, mask)) {
+            return 0;
+        }
+        if (*cur >= end) {
+            break;
+        }
+        if (n->end > *cur) {
+            if (n->start > *cur || (n->value & mask) != mask) {
+                return 0;
+            }
+            *cur = n->end;
+        }
+        n = n->right;
+    }
+    return 1;
+}
+
+int interval_tree_check(IntervalTree *t, uint64_t start, uint64_t end,
+                        int mask)
+{
+    uint64_t cur = start;
+
+    return tree_check(t->root, &cur, end, mask) && cur >= end;
+}
+
+static int hole_fits(uint64_t lo, uint64_t hi, uint64_t size, uint64_t align,
+                     uint64_t *addr)
+{
+    uint64_t a = (lo + align - 1) & ~(align - 1);
+
+    if (a < lo || a > hi || hi - a < size) {
+        return 0;
+    }
+    *addr = a;
+    return 1;
+}
+
+/* In-order walk that looks at the holes from *cur on; subtrees without
+   a large enough hole are skipped as a whole.  */
+static int tree_find_free(IntervalNode *n, uint64_t *cur, uint64_t limit,
+                          uint64_t size, uint64_t align, uint64_t *addr)
+{
+    while (n && *cur < limit && n->max_end > *cur) {
+        if (n->min_start > *cur &&
+            hole_fits(*cur, MIN(n->min_start, limit), size, align, addr)) {
+            return 1;
+        }
+        if (n->max_gap < size) {
+            *cur = MAX(*cur, n->max_end);
+            break;
+        }
+        if (tree_find_free(n->left, cur, limit, size, align, addr)) {
+            return 1;
+        }
+        if (n->start > *cur &&
+            hole_fits(*cur, MIN(n->start, limit), size, align, addr)) {
+            return 1;
+        }
+        *cur = MAX(*cur, n->end);
+        n = n->right;
+    }
+    return 0;
+}
+
+uint64_t interval_tree_find_free(IntervalTree *t, uint64_t start,
+                                 uint64_t limit, uint64_t size,
+                                 uint64_t align)
+{
+    uint64_t cur = start, addr;
+
+    if (tree_find_free(t->root, &cur, limit, size, align, &addr) ||
+        (cur < limit && hole_fits(cur, limit, size, align, &addr))) {
+        return addr;
+    }
+    return INTERVAL_TREE_NONE;
+}
@@ -0,0 +1,58 @@
+/*
+ * Ordered map of disjoint address ranges
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef INTERVAL_TREE_H
+#define INTERVAL_TREE_H
+
+#include <stdint.h>
+
+/*
+ * Maps half-open ranges [start, end) to a non-zero int value.  Ranges
+ * never overlap; setting a range replaces whatever it covered, and
+ * neighbouring ranges with the same value are merged.  Every subtree
+ * knows the largest hole between its ranges, so free space is found
+ * without visiting the ranges in between.
+ *
+ * The tree does no locking.  Lookups do not modify it and may run
+ * concurrently with each other, but not with an update.
+ * Nodes are never returned to the system, so the tree may be used in
+ * code that must not call malloc.
+ */
+typedef struct IntervalNode IntervalNode;
+
+typedef struct IntervalTree {
+    IntervalNode *root;
+} IntervalTree;
+
+#define INTERVAL_TREE_NONE  UINT64_MAX
+
+/* Give [start, end) the value 'value'; 0 removes the range.  */
+void interval_tree_set(IntervalTree *t, uint64_t start, uint64_t end,
+                       int value);
+
+/* Value of the range containing 'addr', 0 if there is none.  */
+int interval_tree_get(IntervalTree *t, uint64_t addr);
+
+/* Return 1 if [start, end) is completely covered by ranges whose value
+   has all the bits in 'mask' set.  */
+int interval_tree_check(IntervalTree *t, uint64_t start, uint64_t end,
+                        int mask);
+
+/* Call 'fn' for each range in address order until it returns non-zero,
+   and return that value.  */
+typedef int (*interval_tree_fn)(void *opaque, uint64_t start, uint64_t end,
+                                int value);
+int interval_tree_foreach(IntervalTree *t, interval_tree_fn fn, void *opaque);
+
+/* Lowest multiple of 'align' (a power of two) that is >= 'start' and
+   starts 'size' bytes not covered by any range and not past 'limit'.
+   Returns INTERVAL_TREE_NONE if there is no such hole.  */
+uint64_t interval_tree_find_free(IntervalTree *t, uint64_t start,
+                                 uint64_t limit, uint64_t size,
+                                 uint64_t align);
+
+#endif
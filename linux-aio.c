@@ -187,6 +187,7 @@ static void laio_cancel(BlockDriverAIOCB *blockacb)
 static AIOPool laio_pool = {
     .aiocb_size         = sizeof(struct qemu_laiocb),
     .cancel             = laio_cancel,
+    .name               = "laio-aiocb",
 };
 
 BlockDriverAIOCB *laio_submit(BlockDriverState *bs, void *aio_ctx, int fd,
@@ -34,6 +34,9 @@
 #include "tcg.h"
 #include "qemu-timer.h"
 #include "envlist.h"
+#ifdef CONFIG_SYNC_BUILTINS
+#include "qemu-atomic.h"
+#endif
 
 #define DEBUG_LOGFILE "/tmp/qemu.log"
 
@@ -90,8 +93,9 @@ int64_t cpu_get_real_ticks(void)
 
 /* To implement exclusive operations we force all cpus to syncronise.
    We don't require a full sync, only that no cpus are executing guest code.
-   The alternative is to map target atomic ops onto host equivalents,
-   which requires quite a lot of per host/target work.  */
+   The alternative is to map target atomic ops onto host equivalents;
+   ARM and SPARC do that where the host compiler has atomic builtins, and
+   only come here for what those cannot express.  */
 static pthread_mutex_t cpu_list_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t exclusive_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t exclusive_cond = PTHREAD_COND_INITIALIZER;
@@ -486,20 +490,29 @@ do_kernel_trap(CPUARMState *env)
         /* ??? No-op. Will need to do better for SMP.  */
         break;
     case 0xffff0fc0: /* __kernel_cmpxchg */
-         /* XXX: This only works between threads, not between processes.
-            It's probably possible to implement this with native host
-            operations. However things like ldrex/strex are much harder so
-            there's not much point trying.  */
-        start_exclusive();
         cpsr = cpsr_read(env);
         addr = env->regs[2];
         /* FIXME: This should SEGV if the access fails.  */
+#ifdef CONFIG_SYNC_BUILTINS
+        if (access_ok(VERIFY_WRITE, addr, 4)) {
+            val = tswap32(atomic_cmpxchg((uint32_t *)g2h(addr),
+                                         tswap32(env->regs[0]),
+                                         tswap32(env->regs[1])));
+        } else {
+            val = ~env->regs[0];
+        }
+#else
+        /* XXX: This only works between threads, not between processes.  */
+        start_exclusive();
         if (get_user_u32(val, addr))
             val = ~env->regs[0];
         if (val == env->regs[0]) {
-            val = env->regs[1];
             /* FIXME: Check for segfaults.  */
-            put_user_u32(val, addr);
+            put_user_u32(env->regs[1], addr);
+        }
+        end_exclusive();
+#endif
+        if (val == env->regs[0]) {
             env->regs[0] = 0;
             cpsr |= CPSR_C;
         } else {
@@ -507,7 +520,6 @@ do_kernel_trap(CPUARMState *env)
             cpsr &= ~CPSR_C;
         }
         cpsr_write(env, cpsr, CPSR_C);
-        end_exclusive();
         break;
     case 0xffff0fe0: /* __kernel_get_tls */
         env->regs[0] = env->cp15.c13_tls2;
@@ -2657,10 +2669,12 @@ static void usage(void)
            "-p pagesize  set the host page size to 'pagesize'\n"
            "-singlestep  always run in singlestep mode\n"
            "-strace      log system calls\n"
+           "-strace-count  count system calls and print a summary at exit\n"
            "\n"
            "Environment variables:\n"
            "QEMU_STRACE       Print system calls and arguments similar to the\n"
            "                  'strace' program.  Enable by setting to any value.\n"
+           "QEMU_STRACE_COUNT Count system calls like -strace-count.\n"
            "You can use -E and -U options to set/unset environment variables\n"
            "for target process.  It is possible to provide several variables\n"
            "by repeating the option.  For example:\n"
@@ -2893,6 +2907,8 @@ int main(int argc, char **argv, char **envp)
             singlestep = 1;
         } else if (!strcmp(r, "strace")) {
             do_strace = 1;
+        } else if (!strcmp(r, "strace-count")) {
+            do_strace_count = 1;
         } else if (!strcmp(r, "version")) {
             version();
             exit(0);
@@ -2966,6 +2982,9 @@ int main(int argc, char **argv, char **envp)
     if (getenv("QEMU_STRACE")) {
         do_strace = 1;
     }
+    if (getenv("QEMU_STRACE_COUNT")) {
+        do_strace_count = 1;
+    }
 
     target_environ = envlist_to_environ(envlist, NULL);
     envlist_free(envlist);
@@ -34,37 +34,76 @@
 //#define DEBUG_MMAP
 
 #if defined(CONFIG_USE_NPTL)
-static pthread_mutex_t mmap_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Taken exclusively to change the guest mappings and shared to look them
+   up.  Both kinds nest, and a thread that holds the lock exclusively may
+   take it shared; the reverse would deadlock.
+   glibc lets readers overtake a waiting writer by default, which can keep
+   mmap() out forever while other threads keep looking up pages, so ask for
+   writer preference.  Nested shared locking is done with the counters
+   below and never reaches the rwlock, so the non-recursive kind is safe.  */
+#ifdef __GLIBC__
+static pthread_rwlock_t mmap_rwlock =
+    PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+#else
+static pthread_rwlock_t mmap_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+#endif
 static __thread int mmap_lock_count;
+static __thread int mmap_read_count;
 
 void mmap_lock(void)
 {
     if (mmap_lock_count++ == 0) {
-        pthread_mutex_lock(&mmap_mutex);
+        if (mmap_read_count) {
+            abort();
+        }
+        pthread_rwlock_wrlock(&mmap_rwlock);
     }
 }
 
 void mmap_unlock(void)
 {
     if (--mmap_lock_count == 0) {
-        pthread_mutex_unlock(&mmap_mutex);
+        pthread_rwlock_unlock(&mmap_rwlock);
+    }
+}
+
+void mmap_read_lock(void)
+{
+    if (mmap_lock_count == 0 && mmap_read_count++ == 0) {
+        pthread_rwlock_rdlock(&mmap_rwlock);
+    }
+}
+
+void mmap_read_unlock(void)
+{
+    if (mmap_lock_count == 0 && --mmap_read_count == 0) {
+        pthread_rwlock_unlock(&mmap_rwlock);
     }
 }
 
 /* Grab lock to make sure things are in a consistent state after fork().  */
 void mmap_fork_start(void)
 {
-    if (mmap_lock_count)
+    if (mmap_lock_count || mmap_read_count)
         abort();
-    pthread_mutex_lock(&mmap_mutex);
+    pthread_rwlock_wrlock(&mmap_rwlock);
 }
 
 void mmap_fork_end(int child)
 {
-    if (child)
-        pthread_mutex_init(&mmap_mutex, NULL);
-    else
-        pthread_mutex_unlock(&mmap_mutex);
+    if (child) {
+        pthread_rwlockattr_t attr;
+
+        pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+        pthread_rwlockattr_setkind_np(
+            &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        pthread_rwlock_init(&mmap_rwlock, &attr);
+        pthread_rwlockattr_destroy(&attr);
+    } else {
+        pthread_rwlock_unlock(&mmap_rwlock);
+    }
 }
 #else
 /* We aren't threadsafe to start with, so no need to worry about locking.  */
@@ -75,6 +114,14 @@ void mmap_lock(void)
 void mmap_unlock(void)
 {
 }
+
+void mmap_read_lock(void)
+{
+}
+
+void mmap_read_unlock(void)
+{
+}
 #endif
 
 /* NOTE: all the constants are the HOST ones, but addresses are target. */
@@ -222,33 +269,20 @@ unsigned long last_brk;
 static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size)
 {
     abi_ulong addr;
-    abi_ulong last_addr;
-    int prot;
-    int looped = 0;
 
     if (size > RESERVED_VA) {
         return (abi_ulong)-1;
     }
 
-    last_addr = start;
-    for (addr = start; last_addr + size != addr; addr += qemu_host_page_size) {
-        if (last_addr + size >= RESERVED_VA
-            || (abi_ulong)(last_addr + size) < last_addr) {
-            if (looped) {
-                return (abi_ulong)-1;
-            }
-            last_addr = qemu_host_page_size;
-            addr = 0;
-            looped = 1;
-            continue;
-        }
-        prot = page_get_flags(addr);
-        if (prot) {
-            last_addr = addr + qemu_host_page_size;
+    addr = page_find_free(start, RESERVED_VA - 1, size);
+    if (addr == (abi_ulong)-1) {
+        addr = page_find_free(qemu_host_page_size, RESERVED_VA - 1, size);
+        if (addr == (abi_ulong)-1) {
+            return (abi_ulong)-1;
         }
     }
-    mmap_next_start = addr;
-    return last_addr;
+    mmap_next_start = addr + size;
+    return addr;
 }
 #endif
 
@@ -284,6 +318,15 @@ abi_ulong mmap_find_vma(abi_ulong start, abi_ulong size)
     prev = 0;
 
     for (;; prev = ptr) {
+        abi_ulong free_addr;
+
+        /* Skip the guest mappings; the probe below is still needed for
+           host mappings that the guest does not know about.  */
+        free_addr = page_find_free(addr, (abi_ulong)-1, size);
+        if (free_addr != (abi_ulong)-1) {
+            addr = free_addr;
+        }
+
         /*
          * Reserve needed memory area to avoid a race.
          * It should be discarded using:
@@ -190,6 +190,8 @@ void syscall_init(void);
 abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
                     abi_long arg2, abi_long arg3, abi_long arg4,
                     abi_long arg5, abi_long arg6);
+int do_fast_syscall(void *cpu_env, int num, abi_long arg1, abi_long arg2,
+                    abi_long *ret);
 void gemu_log(const char *fmt, ...) GCC_FMT_ATTR(1, 2);
 extern THREAD CPUState *thread_env;
 void cpu_loop(CPUState *env);
@@ -205,7 +207,11 @@ void print_syscall(int num,
                    abi_long arg1, abi_long arg2, abi_long arg3,
                    abi_long arg4, abi_long arg5, abi_long arg6);
 void print_syscall_ret(int num, abi_long arg1);
+void count_syscall(int num);
+void count_syscall_ret(int num, abi_long ret);
+void print_syscall_counts(void);
 extern int do_strace;
+extern int do_strace_count;
 
 /* signal.c */
 void process_pending_signals(CPUState *cpu_env);
@@ -242,6 +248,8 @@ int target_msync(abi_ulong start, abi_ulong len, int flags);
 extern unsigned long last_brk;
 void mmap_lock(void);
 void mmap_unlock(void);
+void mmap_read_lock(void);
+void mmap_read_unlock(void);
 abi_ulong mmap_find_vma(abi_ulong, abi_ulong);
 void cpu_list_lock(void);
 void cpu_list_unlock(void);
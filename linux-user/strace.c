@@ -12,6 +12,7 @@
 #include "qemu.h"
 
 int do_strace=0;
+int do_strace_count;
 
 struct syscallname {
     int nr;
@@ -1357,3 +1358,95 @@ print_syscall_ret(int num, abi_long ret)
             break;
         }
 }
+
+/*
+ * Syscall counting for -strace-count.  The counters are not atomic, so
+ * with several guest threads the numbers are approximate.
+ */
+#define MAX_COUNTED_SYSCALLS 8192
+
+struct syscall_count {
+    int nr;
+    unsigned long calls;
+    unsigned long errors;
+};
+
+/* The last slot collects the syscalls past the end of the table.  */
+static struct syscall_count syscall_counts[MAX_COUNTED_SYSCALLS + 1];
+
+static struct syscall_count *syscall_count_slot(int num)
+{
+    if (num < 0 || num >= MAX_COUNTED_SYSCALLS) {
+        return &syscall_counts[MAX_COUNTED_SYSCALLS];
+    }
+    return &syscall_counts[num];
+}
+
+void count_syscall(int num)
+{
+    syscall_count_slot(num)->calls++;
+}
+
+void count_syscall_ret(int num, abi_long ret)
+{
+    if ((abi_ulong)ret >= (abi_ulong)-4096) {
+        syscall_count_slot(num)->errors++;
+    }
+}
+
+static int compare_syscall_counts(const void *a, const void *b)
+{
+    const struct syscall_count *ca = a, *cb = b;
+
+    if (ca->calls != cb->calls) {
+        return ca->calls < cb->calls ? 1 : -1;
+    }
+    return ca->nr - cb->nr;
+}
+
+static const char *syscall_name(int nr)
+{
+    int i;
+
+    for (i = 0; i < nsyscalls; i++) {
+        if (scnames[i].nr == nr) {
+            return scnames[i].name;
+        }
+    }
+    return NULL;
+}
+
+void print_syscall_counts(void)
+{
+    static struct syscall_count sorted[MAX_COUNTED_SYSCALLS + 1];
+    unsigned long calls = 0, errors = 0;
+    const char *name;
+    int i;
+
+    for (i = 0; i <= MAX_COUNTED_SYSCALLS; i++) {
+        sorted[i] = syscall_counts[i];
+        sorted[i].nr = i;
+    }
+    qsort(sorted, ARRAY_SIZE(sorted), sizeof(sorted[0]),
+          compare_syscall_counts);
+
+    gemu_log("%10s %10s syscall\n", "calls", "errors");
+    for (i = 0; i <= MAX_COUNTED_SYSCALLS && sorted[i].calls; i++) {
+        calls += sorted[i].calls;
+        errors += sorted[i].errors;
+        if (sorted[i].nr == MAX_COUNTED_SYSCALLS) {
+            gemu_log("%10lu %10lu (other)\n", sorted[i].calls,
+                     sorted[i].errors);
+            continue;
+        }
+        name = syscall_name(sorted[i].nr);
+        if (name) {
+            gemu_log("%10lu %10lu %s\n", sorted[i].calls, sorted[i].errors,
+                     name);
+        } else {
+            gemu_log("%10lu %10lu %d\n", sorted[i].calls, sorted[i].errors,
+                     sorted[i].nr);
+        }
+    }
+    gemu_log("%10lu %10lu total\n", calls, errors);
+}
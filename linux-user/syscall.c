@@ -2857,6 +2857,7 @@ static inline abi_long do_shmdt(abi_ulong shmaddr)
 {
     int i;
 
+    mmap_lock();
     for (i = 0; i < N_SHM_REGIONS; ++i) {
         if (shm_regions[i].start == shmaddr) {
             shm_regions[i].start = 0;
@@ -2864,6 +2865,7 @@ static inline abi_long do_shmdt(abi_ulong shmaddr)
             break;
         }
     }
+    mmap_unlock();
 
     return get_errno(shmdt(g2h(shmaddr)));
 }
@@ -4363,6 +4365,134 @@ int get_osversion(void)
     return osversion;
 }
 
+/* Fast paths for syscalls that programs make at high rates.  They
+   only take the common case and return 0 to leave everything else,
+   such as bad guest pointers, to do_syscall.  Targets may call
+   do_fast_syscall from translated code, so these must not block, fault
+   or unprotect pages that hold translated code.  */
+
+/* Is [addr, addr + size) writable without touching translated code?
+   size is at most a page.  */
+static inline int fast_access_ok(abi_ulong addr, abi_ulong size)
+{
+    const int mask = PAGE_VALID | PAGE_READ | PAGE_WRITE;
+
+    return addr + size - 1 >= addr &&
+        (page_get_flags(addr) & mask) == mask &&
+        (page_get_flags(addr + size - 1) & mask) == mask;
+}
+
+#ifdef TARGET_NR_gettimeofday
+static int fast_gettimeofday(abi_long arg1, abi_long arg2, abi_long *ret)
+{
+    struct target_timeval *target_tv;
+    struct timeval tv;
+
+    if (!fast_access_ok(arg1, sizeof(*target_tv))) {
+        return 0;
+    }
+    *ret = get_errno(gettimeofday(&tv, NULL));
+    if (!is_error(*ret)) {
+        target_tv = g2h(arg1);
+        __put_user(tv.tv_sec, &target_tv->tv_sec);
+        __put_user(tv.tv_usec, &target_tv->tv_usec);
+    }
+    return 1;
+}
+#endif
+
+#ifdef TARGET_NR_clock_gettime
+static int fast_clock_gettime(abi_long arg1, abi_long arg2, abi_long *ret)
+{
+    struct target_timespec *target_ts;
+    struct timespec ts;
+
+    if (!fast_access_ok(arg2, sizeof(*target_ts))) {
+        return 0;
+    }
+    *ret = get_errno(clock_gettime(arg1, &ts));
+    if (!is_error(*ret)) {
+        target_ts = g2h(arg2);
+        __put_user(ts.tv_sec, &target_ts->tv_sec);
+        __put_user(ts.tv_nsec, &target_ts->tv_nsec);
+    }
+    return 1;
+}
+#endif
+
+#ifdef TARGET_NR_time
+static int fast_time(abi_long arg1, abi_long arg2, abi_long *ret)
+{
+    time_t host_time;
+
+    if (arg1 && !fast_access_ok(arg1, sizeof(abi_long))) {
+        return 0;
+    }
+    *ret = get_errno(time(&host_time));
+    if (!is_error(*ret) && arg1) {
+        __put_user((abi_long)host_time, (abi_long *)g2h(arg1));
+    }
+    return 1;
+}
+#endif
+
+#ifdef TARGET_NR_getpid
+static int fast_getpid(abi_long arg1, abi_long arg2, abi_long *ret)
+{
+    *ret = get_errno(getpid());
+    return 1;
+}
+#endif
+
+static int fast_gettid(abi_long arg1, abi_long arg2, abi_long *ret)
+{
+    *ret = get_errno(gettid());
+    return 1;
+}
+
+static int fast_sched_yield(abi_long arg1, abi_long arg2, abi_long *ret)
+{
+    *ret = get_errno(sched_yield());
+    return 1;
+}
+
+static const struct {
+    int nr;
+    int (*fn)(abi_long arg1, abi_long arg2, abi_long *ret);
+} fast_syscalls[] = {
+#ifdef TARGET_NR_gettimeofday
+    { TARGET_NR_gettimeofday, fast_gettimeofday },
+#endif
+#ifdef TARGET_NR_clock_gettime
+    { TARGET_NR_clock_gettime, fast_clock_gettime },
+#endif
+#ifdef TARGET_NR_time
+    { TARGET_NR_time, fast_time },
+#endif
+#ifdef TARGET_NR_getpid
+    { TARGET_NR_getpid, fast_getpid },
+#endif
+    { TARGET_NR_gettid, fast_gettid },
+    { TARGET_NR_sched_yield, fast_sched_yield },
+};
+
+/* Returns 1 and sets *ret if the syscall was handled.  */
+int do_fast_syscall(void *cpu_env, int num, abi_long arg1, abi_long arg2,
+                    abi_long *ret)
+{
+    int i;
+
+    if (do_strace || do_strace_count) {
+        return 0;
+    }
+    for (i = 0; i < ARRAY_SIZE(fast_syscalls); i++) {
+        if (fast_syscalls[i].nr == num) {
+            return fast_syscalls[i].fn(arg1, arg2, ret);
+        }
+    }
+    return 0;
+}
+
 /* do_syscall() should always have a single exit point at the end so
    that actions, such as logging of syscall results, can be performed.
    All errnos that do_syscall() returns must be -TARGET_<errcode>. */
@@ -4375,11 +4505,17 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
     struct statfs stfs;
     void *p;
 
+    if (do_fast_syscall(cpu_env, num, arg1, arg2, &ret)) {
+        return ret;
+    }
+
 #ifdef DEBUG
     gemu_log("syscall %d", num);
 #endif
     if(do_strace)
         print_syscall(num, arg1, arg2, arg3, arg4, arg5, arg6);
+    if (do_strace_count)
+        count_syscall(num);
 
     switch(num) {
     case TARGET_NR_exit:
@@ -4424,6 +4560,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 #ifdef TARGET_GPROF
         _mcleanup();
 #endif
+        if (do_strace_count)
+            print_syscall_counts();
         gdb_exit(cpu_env, arg1);
         _exit(arg1);
         ret = 0; /* avoid warning */
@@ -6049,6 +6187,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
 #ifdef TARGET_GPROF
         _mcleanup();
 #endif
+        if (do_strace_count)
+            print_syscall_counts();
         gdb_exit(cpu_env, arg1);
         ret = get_errno(exit_group(arg1));
         break;
@@ -7738,6 +7878,8 @@ fail:
 #endif
     if(do_strace)
         print_syscall_ret(num, ret);
+    if (do_strace_count)
+        count_syscall_ret(num, ret);
     return ret;
 efault:
     ret = -TARGET_EFAULT;
@@ -44,6 +44,7 @@
 #include "disas.h"
 #include "balloon.h"
 #include "qemu-timer.h"
+#include "qemu-pool.h"
 #include "migration.h"
 #include "kvm.h"
 #include "acl.h"
@@ -1216,6 +1217,29 @@ static int do_screen_dump(Monitor *mon, const QDict *qdict, QObject **ret_data)
     return 0;
 }
 
+static int do_screen_record(Monitor *mon, const QDict *qdict,
+                            QObject **ret_data)
+{
+    const char *filename = qdict_get_str(qdict, "filename");
+
+    if (fbrec_active()) {
+        qerror_report(QERR_DEVICE_IN_USE, "screenrecord");
+        return -1;
+    }
+    if (fbrec_start(get_displaystate(), filename) < 0) {
+        qerror_report(QERR_OPEN_FILE_FAILED, filename);
+        return -1;
+    }
+    return 0;
+}
+
+static int do_screen_record_stop(Monitor *mon, const QDict *qdict,
+                                 QObject **ret_data)
+{
+    fbrec_stop();
+    return 0;
+}
+
 static void do_logfile(Monitor *mon, const QDict *qdict)
 {
     cpu_set_log_filename(qdict_get_str(qdict, "filename"));
@@ -1250,6 +1274,18 @@ static void do_singlestep(Monitor *mon, const QDict *qdict)
     }
 }
 
+static void do_event_loop_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *option = qdict_get_try_str(qdict, "option");
+    if (!option || !strcmp(option, "on")) {
+        event_loop_stats_enable(1);
+    } else if (!strcmp(option, "off")) {
+        event_loop_stats_enable(0);
+    } else {
+        monitor_printf(mon, "unexpected option %s\n", option);
+    }
+}
+
 /**
  * do_stop(): Stop VM execution
  */
@@ -2453,6 +2489,25 @@ static void do_info_kvm(Monitor *mon, QObject **ret_data)
 #endif
 }
 
+static void do_info_ramblock(Monitor *mon)
+{
+    RAMBlock *block;
+    int64_t thp;
+
+    QLIST_FOREACH(block, &ram_list.blocks, next) {
+        monitor_printf(mon, "%-24s offset 0x%08lx size %lu kB"
+                       " page size %lu kB",
+                       block->idstr, block->offset,
+                       block->length >> 10, block->page_size >> 10);
+        thp = qemu_ram_block_thp_size(block);
+        if (thp > 0) {
+            monitor_printf(mon, ", %" PRId64 " MB in transparent hugepages",
+                           thp >> 20);
+        }
+        monitor_printf(mon, "\n");
+    }
+}
+
 static void do_info_numa(Monitor *mon)
 {
     int i;
@@ -2469,6 +2524,21 @@ static void do_info_numa(Monitor *mon)
         monitor_printf(mon, "\n");
         monitor_printf(mon, "node %d size: %" PRId64 " MB\n", i,
             node_mem[i] >> 20);
+        if (node_host[i] >= 0) {
+            static const char *const policies[] = {
+                "default", "preferred", "bind", "interleave",
+            };
+            int host_node, mode;
+
+            mode = qemu_ram_numa_policy(i, &host_node);
+            if (mode < 0) {
+                monitor_printf(mon, "node %d host policy: unknown\n", i);
+            } else {
+                monitor_printf(mon, "node %d host policy: %s, host node %d\n",
+                               i, mode < ARRAY_SIZE(policies) ?
+                               policies[mode] : "other", host_node);
+            }
+        }
     }
 }
 
@@ -2937,6 +3007,34 @@ static const mon_cmd_t info_cmds[] = {
         .user_print = do_info_kvm_print,
         .mhandler.info_new = do_info_kvm,
     },
+    {
+        .name       = "ramblock",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the RAM blocks and their host page size",
+        .mhandler.info = do_info_ramblock,
+    },
+    {
+        .name       = "mempool",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show object pool statistics",
+        .mhandler.info = do_info_mempool,
+    },
+    {
+        .name       = "event-loop",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show time spent in main loop callbacks",
+        .mhandler.info = do_info_event_loop,
+    },
+    {
+        .name       = "screenrecord",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the state of the screen recorder",
+        .mhandler.info = do_info_screenrecord,
+    },
     {
         .name       = "numa",
         .args_type  = "",
@@ -23,6 +23,7 @@
 
 #include "net/queue.h"
 #include "qemu-queue.h"
+#include "qemu-pool.h"
 
 /* The delivery handler may only return zero if it will call
  * qemu_net_queue_flush() when it determines that it is once again able
@@ -47,6 +48,32 @@ struct NetPacket {
     uint8_t data[0];
 };
 
+/* Packets up to a standard frame come from a pool; jumbo frames and
+ * GSO packets are rare enough to go through malloc.
+ */
+#define NET_PACKET_POOL_SIZE 2048
+
+static MemPool net_packet_pool =
+    MEM_POOL_INITIALIZER("net-packet",
+                         sizeof(NetPacket) + NET_PACKET_POOL_SIZE, 256);
+
+static NetPacket *net_packet_alloc(size_t size)
+{
+    if (size <= NET_PACKET_POOL_SIZE) {
+        return mem_pool_alloc(&net_packet_pool);
+    }
+    return qemu_malloc(sizeof(NetPacket) + size);
+}
+
+static void net_packet_free(NetPacket *packet)
+{
+    if (packet->size <= NET_PACKET_POOL_SIZE) {
+        mem_pool_free(&net_packet_pool, packet);
+    } else {
+        qemu_free(packet);
+    }
+}
+
 struct NetQueue {
     NetPacketDeliver *deliver;
     NetPacketDeliverIOV *deliver_iov;
@@ -82,7 +109,7 @@ void qemu_del_net_queue(NetQueue *queue)
 
     QTAILQ_FOREACH_SAFE(packet, &queue->packets, entry, next) {
         QTAILQ_REMOVE(&queue->packets, packet, entry);
-        qemu_free(packet);
+        net_packet_free(packet);
     }
 
     qemu_free(queue);
@@ -97,7 +124,7 @@ static ssize_t qemu_net_queue_append(NetQueue *queue,
 {
     NetPacket *packet;
 
-    packet = qemu_malloc(sizeof(NetPacket) + size);
+    packet = net_packet_alloc(size);
     packet->sender = sender;
     packet->flags = flags;
     packet->size = size;
@@ -124,7 +151,7 @@ static ssize_t qemu_net_queue_append_iov(NetQueue *queue,
         max_len += iov[i].iov_len;
     }
 
-    packet = qemu_malloc(sizeof(NetPacket) + max_len);
+    packet = net_packet_alloc(max_len);
     packet->sender = sender;
     packet->sent_cb = sent_cb;
     packet->flags = flags;
@@ -227,7 +254,7 @@ void qemu_net_queue_purge(NetQueue *queue, VLANClientState *from)
     QTAILQ_FOREACH_SAFE(packet, &queue->packets, entry, next) {
         if (packet->sender == from) {
             QTAILQ_REMOVE(&queue->packets, packet, entry);
-            qemu_free(packet);
+            net_packet_free(packet);
         }
     }
 }
@@ -255,6 +282,6 @@ void qemu_net_queue_flush(NetQueue *queue)
             packet->sent_cb(packet->sender, ret);
         }
 
-        qemu_free(packet);
+        net_packet_free(packet);
     }
 }
@@ -61,9 +61,21 @@ void *qemu_memalign(size_t alignment, size_t size)
 }
 
 /* alloc shared memory pages */
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+/* Use 2 MiB alignment so transparent hugepages can back large areas. */
+#define QEMU_VMALLOC_ALIGN (512 * 4096)
+#else
+#define QEMU_VMALLOC_ALIGN getpagesize()
+#endif
+
 void *qemu_vmalloc(size_t size)
 {
-    return qemu_memalign(getpagesize(), size);
+    size_t align = getpagesize();
+
+    if (size >= QEMU_VMALLOC_ALIGN) {
+        align = QEMU_VMALLOC_ALIGN;
+    }
+    return qemu_memalign(align, size);
 }
 
 void qemu_vfree(void *ptr)
@@ -559,6 +559,7 @@ static void paio_cancel(BlockDriverAIOCB *blockacb)
 static AIOPool raw_aio_pool = {
     .aiocb_size         = sizeof(struct qemu_paiocb),
     .cancel             = paio_cancel,
+    .name               = "raw-aiocb",
 };
 
 BlockDriverAIOCB *paio_submit(BlockDriverState *bs, int fd,
@@ -0,0 +1,21 @@
+#ifndef __QEMU_ATOMIC_H
+#define __QEMU_ATOMIC_H 1
+
+/* Host atomic operations on int-sized, smaller and pointer-sized
+   objects.  Only available if CONFIG_SYNC_BUILTINS is defined; callers
+   need a fallback without them.  Both are full barriers.  */
+
+#define atomic_cmpxchg(ptr, old, new) \
+    __sync_val_compare_and_swap(ptr, old, new)
+
+/* Not __sync_lock_test_and_set: that is only an acquire barrier, and
+   some hosts can only store the value 1 with it.  */
+#define atomic_xchg(ptr, new) ({                                \
+    typeof(*(ptr)) _old;                                        \
+    do {                                                        \
+        _old = *(volatile typeof(*(ptr)) *)(ptr);               \
+    } while (__sync_val_compare_and_swap(ptr, _old, new) != _old); \
+    _old;                                                       \
+})
+
+#endif
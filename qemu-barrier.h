@@ -7,4 +7,14 @@
 /* Compiler barrier */
 #define barrier()   asm volatile("" ::: "memory")
 
+/* Inside a busy-wait loop: lets a sibling hyperthread run and avoids the
+   memory order violation penalty when the loop exits */
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax() asm volatile("rep; nop" ::: "memory")
+#elif defined(_ARCH_PPC)
+#define cpu_relax() asm volatile("or 1,1,1; or 2,2,2" ::: "memory")
+#else
+#define cpu_relax() barrier()
+#endif
+
 #endif
@@ -111,13 +111,17 @@ size_t qemu_chr_mem_osize(const CharDriverState *chr);
 
 /* async I/O support */
 
-int qemu_set_fd_handler2(int fd,
-                         IOCanReadHandler *fd_read_poll,
-                         IOHandler *fd_read,
-                         IOHandler *fd_write,
-                         void *opaque);
-int qemu_set_fd_handler(int fd,
-                        IOHandler *fd_read,
-                        IOHandler *fd_write,
-                        void *opaque);
+int qemu_set_fd_handler_named(int fd,
+                              IOCanReadHandler *fd_read_poll,
+                              IOHandler *fd_read,
+                              IOHandler *fd_write,
+                              void *opaque,
+                              const char *read_name,
+                              const char *write_name);
+/* handlers are named after their callbacks in "info event-loop" */
+#define qemu_set_fd_handler2(fd, fd_read_poll, fd_read, fd_write, opaque) \
+    qemu_set_fd_handler_named(fd, fd_read_poll, fd_read, fd_write, opaque, \
+                              #fd_read, #fd_write)
+#define qemu_set_fd_handler(fd, fd_read, fd_write, opaque) \
+    qemu_set_fd_handler2(fd, NULL, fd_read, fd_write, opaque)
 #endif
@@ -126,7 +126,8 @@ void async_context_push(void);
 void async_context_pop(void);
 int get_async_context_id(void);
 
-QEMUBH *qemu_bh_new(QEMUBHFunc *cb, void *opaque);
+QEMUBH *qemu_bh_new_named(QEMUBHFunc *cb, void *opaque, const char *name);
+#define qemu_bh_new(cb, opaque) qemu_bh_new_named(cb, opaque, #cb)
 void qemu_bh_schedule(QEMUBH *bh);
 /* Bottom halfs that are scheduled from a bottom half handler are instantly
  * invoked.  This can create an infinite loop if a bottom half handler
@@ -298,6 +299,7 @@ struct qemu_work_item {
     void (*func)(void *data);
     void *data;
     int done;
+    int free;   /* queued by async_run_on_cpu, freed once run */
 };
 
 #ifdef CONFIG_USER_ONLY
@@ -0,0 +1,256 @@
+/*
+ * Convert a QEMU screen recording into PNG images
+ *
+ * Reads a file written by the "screenrecord" monitor command (see
+ * ui/fbrec.h) and writes one PNG file per frame, or lists the frames.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <zlib.h>
+
+#include "qemu-common.h"
+#include "ui/fbrec.h"
+
+static void QEMU_NORETURN help(void)
+{
+    printf("qemu-fbrec version " QEMU_VERSION QEMU_PKGVERSION "\n"
+           "usage: qemu-fbrec [-l] [-o prefix] [-s step] recording\n"
+           "Convert a screen recording made with the screenrecord monitor\n"
+           "command into PNG images.\n"
+           "\n"
+           "  -l, --list         print one line per frame\n"
+           "  -o, --output=PFX   write frame N to PFX-N.png (default: frame)\n"
+           "  -s, --step=N       only write every Nth frame (the last frame\n"
+           "                     is always written)\n"
+           "  -h, --help         display this help and exit\n");
+    exit(0);
+}
+
+static void QEMU_NORETURN die(const char *msg)
+{
+    fprintf(stderr, "qemu-fbrec: %s\n", msg);
+    exit(1);
+}
+
+static void *xmalloc(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+
+    if (!p) {
+        die("out of memory");
+    }
+    return p;
+}
+
+static void png_chunk(FILE *f, const char *type, const uint8_t *data,
+                      uint32_t len)
+{
+    uint32_t v = cpu_to_be32(len);
+    uLong crc;
+
+    fwrite(&v, 4, 1, f);
+    fwrite(type, 4, 1, f);
+    fwrite(data, len, 1, f);
+    crc = crc32(crc32(0, (const Bytef *)type, 4), data, len);
+    v = cpu_to_be32(crc);
+    fwrite(&v, 4, 1, f);
+}
+
+static void write_png(const char *file, const uint32_t *fb, int w, int h)
+{
+    static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    size_t raw_size = (size_t)h * (1 + w * 3);
+    uLongf size = compressBound(raw_size);
+    uint8_t *raw = xmalloc(raw_size), *z = xmalloc(size), *p = raw;
+    uint8_t ihdr[13];
+    uint32_t v;
+    FILE *f;
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        *p++ = 0;       /* no filter */
+        for (x = 0; x < w; x++) {
+            uint32_t pix = *fb++;
+
+            *p++ = pix >> 16;
+            *p++ = pix >> 8;
+            *p++ = pix;
+        }
+    }
+    compress2(z, &size, raw, raw_size, Z_DEFAULT_COMPRESSION);
+
+    v = cpu_to_be32(w);
+    memcpy(ihdr, &v, 4);
+    v = cpu_to_be32(h);
+    memcpy(ihdr + 4, &v, 4);
+    ihdr[8] = 8;        /* bit depth */
+    ihdr[9] = 2;        /* truecolor */
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    f = fopen(file, "wb");
+    if (!f) {
+        die("cannot create output file");
+    }
+    fwrite(sig, sizeof(sig), 1, f);
+    png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    png_chunk(f, "IDAT", z, size);
+    png_chunk(f, "IEND", NULL, 0);
+    fclose(f);
+    free(raw);
+    free(z);
+}
+
+/* XOR the rectangles of one frame into the screen */
+static void apply_frame(uint32_t *fb, int width, int height,
+                        const uint8_t *p, const uint8_t *end, int nrects)
+{
+    for (; nrects > 0; nrects--) {
+        FbRecRect r;
+        int i, j;
+
+        if (end - p < sizeof(r)) {
+            die("truncated frame");
+        }
+        memcpy(&r, p, sizeof(r));
+        p += sizeof(r);
+        le16_to_cpus(&r.x);
+        le16_to_cpus(&r.y);
+        le16_to_cpus(&r.w);
+        le16_to_cpus(&r.h);
+        if (r.x + r.w > width || r.y + r.h > height ||
+            end - p < (size_t)r.w * r.h * 4) {
+            die("bad rectangle");
+        }
+        for (j = 0; j < r.h; j++) {
+            uint32_t *dst = fb + (r.y + j) * width + r.x;
+
+            for (i = 0; i < r.w; i++) {
+                uint32_t v;
+
+                memcpy(&v, p, 4);
+                dst[i] ^= le32_to_cpu(v);
+                p += 4;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "list", no_argument, NULL, 'l' },
+        { "output", required_argument, NULL, 'o' },
+        { "step", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *prefix = "frame";
+    int list = 0, step = 1;
+    FbRecFileHeader fhdr;
+    FbRecFrameHeader hdr;
+    uint32_t *fb = NULL;
+    uint32_t width = 0, height = 0;
+    uint8_t *z = NULL, *raw = NULL;
+    char name[1024];
+    int c, n, ret;
+    FILE *f;
+
+    while ((c = getopt_long(argc, argv, "hlo:s:", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'l':
+            list = 1;
+            break;
+        case 'o':
+            prefix = optarg;
+            break;
+        case 's':
+            step = atoi(optarg);
+            if (step < 1) {
+                die("step must be at least 1");
+            }
+            break;
+        default:
+            help();
+        }
+    }
+    if (optind != argc - 1) {
+        help();
+    }
+
+    f = fopen(argv[optind], "rb");
+    if (!f) {
+        die("cannot open recording");
+    }
+    if (fread(&fhdr, sizeof(fhdr), 1, f) != 1 ||
+        memcmp(fhdr.magic, FBREC_MAGIC, sizeof(fhdr.magic)) ||
+        le32_to_cpu(fhdr.version) != FBREC_VERSION) {
+        die("not a screen recording");
+    }
+
+    for (n = 0; fread(&hdr, sizeof(hdr), 1, f) == 1; n++) {
+        uLongf raw_size;
+        int last;
+
+        le32_to_cpus(&hdr.type);
+        le32_to_cpus(&hdr.nrects);
+        le32_to_cpus(&hdr.width);
+        le32_to_cpus(&hdr.height);
+        le64_to_cpus(&hdr.timestamp);
+        le32_to_cpus(&hdr.raw_size);
+        le32_to_cpus(&hdr.size);
+
+        if (hdr.type == FBREC_FRAME_KEY) {
+            if (hdr.width != width || hdr.height != height) {
+                width = hdr.width;
+                height = hdr.height;
+                free(fb);
+                fb = xmalloc((size_t)width * height * 4);
+            }
+            memset(fb, 0, (size_t)width * height * 4);
+        } else if (hdr.type != FBREC_FRAME_DELTA || !fb ||
+                   hdr.width != width || hdr.height != height) {
+            die("bad frame");
+        }
+
+        free(z);
+        free(raw);
+        z = xmalloc(hdr.size);
+        raw = xmalloc(hdr.raw_size);
+        if (fread(z, hdr.size, 1, f) != 1) {
+            die("truncated recording");
+        }
+        raw_size = hdr.raw_size;
+        ret = uncompress(raw, &raw_size, z, hdr.size);
+        if (ret != Z_OK || raw_size != hdr.raw_size) {
+            die("corrupt frame");
+        }
+        apply_frame(fb, width, height, raw, raw + raw_size, hdr.nrects);
+
+        if (list) {
+            printf("%d: %" PRIu64 " ms %s %ux%u, %u rects, %u -> %u bytes\n",
+                   n, hdr.timestamp,
+                   hdr.type == FBREC_FRAME_KEY ? "key" : "delta",
+                   width, height, hdr.nrects, hdr.raw_size, hdr.size);
+            continue;
+        }
+        c = fgetc(f);
+        last = c == EOF;
+        ungetc(c, f);
+        if (n % step == 0 || last) {
+            snprintf(name, sizeof(name), "%s-%06d.png", prefix, n);
+            write_png(name, fb, width, height);
+        }
+    }
+
+    fclose(f);
+    free(fb);
+    free(z);
+    free(raw);
+    return 0;
+}
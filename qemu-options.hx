@@ -66,12 +66,36 @@ specifies the maximum number of hotpluggable CPUs.
 ETEXI
 
 DEF("numa", HAS_ARG, QEMU_OPTION_numa,
-    "-numa node[,mem=size][,cpus=cpu[-cpu]][,nodeid=node]\n", QEMU_ARCH_ALL)
+    "-numa node[,mem=size][,cpus=cpu[-cpu]][,nodeid=node][,hostnode=node]\n", QEMU_ARCH_ALL)
 STEXI
 @item -numa @var{opts}
 @findex -numa
 Simulate a multi node NUMA system. If mem and cpus are omitted, resources
-are split equally.
+are split equally.  @option{hostnode} binds the guest node's memory to
+the given host NUMA node; @code{info numa} reports the resulting policy.
+Binding is supported by the PC and Sun4m/Sun4u machines.
+ETEXI
+
+DEF("vcpu-affinity", HAS_ARG, QEMU_OPTION_vcpu_affinity,
+    "-vcpu-affinity vcpu=n,host=cpu[-cpu]\n"
+    "                pin the thread of virtual CPU n to the given host CPUs\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -vcpu-affinity vcpu=@var{n},host=@var{cpu}[-@var{cpu}]
+@findex -vcpu-affinity
+Pin the host thread running virtual CPU @var{n} to a range of host CPUs.
+Can be given once per virtual CPU.  When several virtual CPUs share one
+thread (TCG), the thread is pinned to the union of their ranges.
+ETEXI
+
+DEF("iothread-affinity", HAS_ARG, QEMU_OPTION_iothread_affinity,
+    "-iothread-affinity cpu[-cpu]\n"
+    "                pin the I/O thread to the given host CPUs\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -iothread-affinity @var{cpu}[-@var{cpu}]
+@findex -iothread-affinity
+Pin the main I/O thread to a range of host CPUs.
 ETEXI
 
 DEF("fda", HAS_ARG, QEMU_OPTION_fda,
@@ -335,15 +359,24 @@ STEXI
 Allocate guest RAM from a temporarily created file in @var{path}.
 ETEXI
 
-#ifdef MAP_POPULATE
 DEF("mem-prealloc", 0, QEMU_OPTION_mem_prealloc,
-    "-mem-prealloc   preallocate guest memory (use with -mem-path)\n",
+    "-mem-prealloc   preallocate guest memory\n",
     QEMU_ARCH_ALL)
 STEXI
 @item -mem-prealloc
-Preallocate memory when using -mem-path.
+Fault in all of guest RAM at startup instead of on first access.  This
+works both with -mem-path and with anonymous memory.
+ETEXI
+
+DEF("mem-prealloc-threads", HAS_ARG, QEMU_OPTION_mem_prealloc_threads,
+    "-mem-prealloc-threads n\n"
+    "                use n threads to preallocate guest memory\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -mem-prealloc-threads @var{n}
+Split the work of -mem-prealloc between @var{n} threads (default 1).
+For very large guests this shortens startup considerably.
 ETEXI
-#endif
 
 DEF("k", HAS_ARG, QEMU_OPTION_k,
     "-k language     use keyboard layout (for example 'fr' for French)\n",
@@ -911,7 +944,10 @@ achieved using the @code{acl} monitor command.
 Enable lossy compression methods (gradient, JPEG, ...). If this
 option is set, VNC client may receive lossy framebuffer updates
 depending on its encoding settings. Enabling this option can save
-a lot of bandwidth at the expense of quality.
+a lot of bandwidth at the expense of quality. Unless @option{non-adaptive}
+is given, the JPEG quality asked for by the client is only a starting
+point: it is lowered while the client cannot keep up with the updates,
+and raised up to lossless while it can.
 
 @item non-adaptive
 
@@ -922,9 +958,37 @@ This can be really helpfull to save bandwidth when playing videos. Disabling
 adaptive encodings allow to restore the original static behavior of encodings
 like Tight.
 
+@item workers=@var{n}
+
+Use @var{n} threads to encode framebuffer updates, up to 16.  Each client
+is encoded by one thread at a time, but different clients, also of
+different displays, are encoded in parallel.  The default is one thread
+per host CPU, up to 4.  This option only has an effect when QEMU is
+built with VNC threads enabled.
+
 @end table
 ETEXI
 
+#ifndef _WIN32
+DEF("shm-display", HAS_ARG, QEMU_OPTION_shm_display,
+    "-shm-display path\n"
+    "                export the display in shared memory to viewers\n"
+    "                connecting to unix socket 'path'\n", QEMU_ARCH_ALL)
+#endif
+STEXI
+@item -shm-display @var{path}
+@findex -shm-display
+Export the VGA output to viewers on the same host.  QEMU listens on the
+unix socket @var{path} and passes each viewer that connects a file
+descriptor for a shared memory segment holding the framebuffer and a
+ring of updated rectangles, followed by a 4 byte wakeup on the socket
+after each refresh that changed the screen.  Unless another display
+such as SDL already provides the framebuffer, QEMU draws directly into
+the segment, so exporting the screen costs no encoding or copying.
+The segment layout is described in @file{ui/shm.h}; screens larger than
+2560x2048 are not exported.
+ETEXI
+
 STEXI
 @end table
 ETEXI
@@ -2128,17 +2192,23 @@ re-inject them.
 ETEXI
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [N|auto]\n" \
+    "-icount [N[,sleep=off]|auto]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
-    "                instruction\n", QEMU_ARCH_ALL)
+    "                instruction; with sleep=off idle time is skipped\n", QEMU_ARCH_ALL)
 STEXI
-@item -icount [@var{N}|auto]
+@item -icount [@var{N}[,sleep=off]|auto]
 @findex -icount
 Enable virtual instruction counter.  The virtual cpu will execute one
 instruction every 2^@var{N} ns of virtual time.  If @code{auto} is specified
 then the virtual cpu speed will be automatically adjusted to keep virtual
 time within a few seconds of real time.
 
+With @option{sleep=off}, the virtual clock does not wait for real time
+while all virtual cpus are idle; it jumps directly to the next timer
+deadline instead.  Idle-heavy guests then run much faster than real time
+and execution stays deterministic.  This cannot be combined with
+@code{auto}.
+
 Note that while this option can give deterministic behavior, it does not
 provide cycle accurate emulation.  Modern CPUs contain superscalar out of
 order cores with complex cache hierarchies.  The number of instructions
@@ -2246,6 +2316,36 @@ STEXI
 Set TB size.
 ETEXI
 
+DEF("halt-poll-ns", HAS_ARG, QEMU_OPTION_halt_poll_ns, \
+    "-halt-poll-ns n\n" \
+    "                poll up to n ns for work before a halted TCG CPU sleeps\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -halt-poll-ns @var{n}
+@findex -halt-poll-ns
+When a TCG virtual CPU halts, spin for a while waiting for an interrupt
+before putting its thread to sleep.  The polling window adapts to how
+quickly the CPU is usually woken up and never exceeds @var{n} nanoseconds.
+This trades host CPU time for lower wake-up latency.  @var{n} can be at
+most 1000000000 (one second).  The default is 0, which disables polling.
+Only available when QEMU is built with the I/O thread.
+ETEXI
+
+DEF("tcg-vcpu-threads", 0, QEMU_OPTION_tcg_vcpu_threads, \
+    "-tcg-vcpu-threads\n" \
+    "                run each TCG CPU in a host thread of its own\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -tcg-vcpu-threads
+@findex -tcg-vcpu-threads
+Give every TCG virtual CPU its own host thread instead of running them all
+in one.  Guest code still runs under the global lock, one virtual CPU at a
+time, so this does not make an SMP guest faster yet; it is the first step
+towards parallel TCG execution.  With @option{-vcpu-affinity} each thread
+is pinned to the host CPUs of its own virtual CPU.  Only available when
+QEMU is built with the I/O thread.
+ETEXI
+
 DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming p     prepare for incoming migration, listen on port p\n",
     QEMU_ARCH_ALL)
@@ -0,0 +1,102 @@
+/*
+ * Fixed-size object pools
+ *
+ * Copyright (c) 2011 The QEMU Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu-common.h"
+#include "qemu-pool.h"
+#include "monitor.h"
+
+/* released objects are chained through their first word */
+typedef struct MemPoolFree {
+    struct MemPoolFree *next;
+} MemPoolFree;
+
+static QLIST_HEAD(, MemPool) mem_pools = QLIST_HEAD_INITIALIZER(mem_pools);
+
+void mem_pool_init(MemPool *pool, const char *name, size_t size,
+                   int max_free)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->size = size;
+    pool->max_free = max_free;
+}
+
+void *mem_pool_alloc(MemPool *pool)
+{
+    MemPoolFree *obj;
+
+    if (!pool->registered) {
+        QLIST_INSERT_HEAD(&mem_pools, pool, next);
+        pool->registered = 1;
+    }
+
+    pool->allocs++;
+    if (++pool->in_use > pool->peak) {
+        pool->peak = pool->in_use;
+    }
+
+    obj = pool->free_list;
+    if (obj) {
+        pool->free_list = obj->next;
+        pool->nb_free--;
+        pool->hits++;
+        return obj;
+    }
+    return qemu_malloc(MAX(pool->size, sizeof(MemPoolFree)));
+}
+
+void *mem_pool_allocz(MemPool *pool)
+{
+    void *ptr = mem_pool_alloc(pool);
+
+    memset(ptr, 0, pool->size);
+    return ptr;
+}
+
+void mem_pool_free(MemPool *pool, void *ptr)
+{
+    MemPoolFree *obj = ptr;
+
+    if (!obj) {
+        return;
+    }
+    pool->in_use--;
+    if (pool->nb_free >= pool->max_free) {
+        qemu_free(obj);
+        return;
+    }
+    obj->next = pool->free_list;
+    pool->free_list = obj;
+    pool->nb_free++;
+}
+
+/* Give the cached objects back to malloc */
+void mem_pool_trim(MemPool *pool)
+{
+    MemPoolFree *obj;
+
+    while ((obj = pool->free_list) != NULL) {
+        pool->free_list = obj->next;
+        qemu_free(obj);
+    }
+    pool->nb_free = 0;
+}
+
+void do_info_mempool(Monitor *mon)
+{
+    MemPool *pool;
+
+    QLIST_FOREACH(pool, &mem_pools, next) {
+        monitor_printf(mon, "%-16s size %zu allocs %" PRIu64 " from pool %"
+                       PRIu64 " in use %" PRId64 " peak %" PRId64
+                       " cached %d\n",
+                       pool->name, pool->size, pool->allocs, pool->hits,
+                       pool->in_use, pool->peak, pool->nb_free);
+    }
+}
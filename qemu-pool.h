@@ -0,0 +1,55 @@
+/*
+ * Fixed-size object pools
+ *
+ * Copyright (c) 2011 The QEMU Project
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_POOL_H
+#define QEMU_POOL_H
+
+#include "qemu-common.h"
+#include "qemu-queue.h"
+
+/*
+ * A MemPool hands out objects of one size and keeps up to max_free of the
+ * released ones on a free list, so that per-request structures do not go
+ * through malloc on every request.  Pools are not thread safe: like the
+ * rest of the device model they are used with the global mutex held.
+ *
+ * Pools are normally static and set up with MEM_POOL_INITIALIZER; they
+ * show up in "info mempool" once they have been used.
+ */
+typedef struct MemPool MemPool;
+
+struct MemPool {
+    const char *name;
+    size_t size;
+    int max_free;
+
+    /* all members below are private to qemu-pool.c */
+    void *free_list;
+    int nb_free;
+    int registered;
+    uint64_t allocs;
+    uint64_t hits;
+    int64_t in_use;
+    int64_t peak;
+    QLIST_ENTRY(MemPool) next;
+};
+
+#define MEM_POOL_INITIALIZER(n, sz, max) \
+    { .name = (n), .size = (sz), .max_free = (max) }
+
+void mem_pool_init(MemPool *pool, const char *name, size_t size,
+                   int max_free);
+void *mem_pool_alloc(MemPool *pool);
+void *mem_pool_allocz(MemPool *pool);
+void mem_pool_free(MemPool *pool, void *ptr);
+void mem_pool_trim(MemPool *pool);
+
+void do_info_mempool(Monitor *mon);
+
+#endif
@@ -167,6 +167,15 @@ void qemu_thread_create(QemuThread *thread,
     pthread_sigmask(SIG_SETMASK, &oldset, NULL);
 }
 
+void qemu_thread_join(QemuThread *thread)
+{
+    int err;
+
+    err = pthread_join(thread->thread, NULL);
+    if (err)
+        error_exit(err, __func__);
+}
+
 void qemu_thread_signal(QemuThread *thread, int sig)
 {
     int err;
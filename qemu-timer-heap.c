@@ -0,0 +1,95 @@
+/*
+ * Binary min-heap of pending timers
+ *
+ * Arming and cancelling are O(log n); the earliest timer is always at
+ * entries[0].  Kept apart from qemu-timer.c so that it can be linked
+ * into tests/timer-heap-bench.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu-common.h"
+#include "qemu-timer-heap.h"
+
+static inline int timer_before(QEMUTimerHeapEntry *a, QEMUTimerHeapEntry *b)
+{
+    if (a->expire_time != b->expire_time) {
+        return a->expire_time < b->expire_time;
+    }
+    return a->seq < b->seq;
+}
+
+static inline void timer_heap_set(QEMUTimerHeap *h, int i,
+                                  QEMUTimerHeapEntry *e)
+{
+    h->entries[i] = e;
+    e->index = i;
+}
+
+static void timer_heap_sift_up(QEMUTimerHeap *h, int i)
+{
+    QEMUTimerHeapEntry *e = h->entries[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!timer_before(e, h->entries[parent])) {
+            break;
+        }
+        timer_heap_set(h, i, h->entries[parent]);
+        i = parent;
+    }
+    timer_heap_set(h, i, e);
+}
+
+static void timer_heap_sift_down(QEMUTimerHeap *h, int i)
+{
+    QEMUTimerHeapEntry *e = h->entries[i];
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= h->count) {
+            break;
+        }
+        if (child + 1 < h->count &&
+            timer_before(h->entries[child + 1], h->entries[child])) {
+            child++;
+        }
+        if (!timer_before(h->entries[child], e)) {
+            break;
+        }
+        timer_heap_set(h, i, h->entries[child]);
+        i = child;
+    }
+    timer_heap_set(h, i, e);
+}
+
+void timer_heap_insert(QEMUTimerHeap *h, QEMUTimerHeapEntry *e)
+{
+    if (h->count == h->size) {
+        h->size = h->size ? h->size * 2 : 16;
+        h->entries = qemu_realloc(h->entries,
+                                  h->size * sizeof(QEMUTimerHeapEntry *));
+    }
+    e->seq = h->seq++;
+    timer_heap_set(h, h->count++, e);
+    timer_heap_sift_up(h, e->index);
+}
+
+void timer_heap_remove(QEMUTimerHeap *h, QEMUTimerHeapEntry *e)
+{
+    int i = e->index;
+    QEMUTimerHeapEntry *last;
+
+    e->index = -1;
+    last = h->entries[--h->count];
+    if (last == e) {
+        return;
+    }
+    timer_heap_set(h, i, last);
+    if (i > 0 && timer_before(last, h->entries[(i - 1) / 2])) {
+        timer_heap_sift_up(h, i);
+    } else {
+        timer_heap_sift_down(h, i);
+    }
+}
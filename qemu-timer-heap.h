@@ -0,0 +1,37 @@
+/*
+ * Binary min-heap of pending timers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_TIMER_HEAP_H
+#define QEMU_TIMER_HEAP_H
+
+#include <stdint.h>
+
+/* Embedded in each timer.  Entries are ordered by (expire_time, seq),
+   so timers with equal deadlines fire in the order they were armed. */
+typedef struct QEMUTimerHeapEntry {
+    int64_t expire_time;
+    uint64_t seq;
+    /* position in the heap, -1 if not pending */
+    int index;
+} QEMUTimerHeapEntry;
+
+typedef struct QEMUTimerHeap {
+    QEMUTimerHeapEntry **entries;
+    int count;
+    int size;
+    uint64_t seq;
+} QEMUTimerHeap;
+
+void timer_heap_insert(QEMUTimerHeap *h, QEMUTimerHeapEntry *e);
+void timer_heap_remove(QEMUTimerHeap *h, QEMUTimerHeapEntry *e);
+
+static inline QEMUTimerHeapEntry *timer_heap_first(QEMUTimerHeap *h)
+{
+    return h->count ? h->entries[0] : NULL;
+}
+
+#endif
@@ -54,6 +54,9 @@
 #endif
 
 #include "qemu-timer.h"
+#include "qemu-timer-heap.h"
+#include "trace.h"
+#include "cpus.h"
 
 /* Conversion factor from emulated instructions to virtual clock ticks.  */
 int icount_time_shift;
@@ -61,6 +64,9 @@ int icount_time_shift;
 #define MAX_ICOUNT_SHIFT 10
 /* Compensate for varying guest execution speed.  */
 int64_t qemu_icount_bias;
+/* With -icount N,sleep=off, idle vCPUs do not wait for real time: the
+   virtual clock jumps straight to the next vm_clock deadline.  */
+static int icount_sleep = 1;
 static QEMUTimer *icount_rt_timer;
 static QEMUTimer *icount_vm_timer;
 
@@ -158,10 +164,10 @@ struct QEMUClock {
 
 struct QEMUTimer {
     QEMUClock *clock;
-    int64_t expire_time;
+    QEMUTimerHeapEntry heap;
     QEMUTimerCB *cb;
     void *opaque;
-    struct QEMUTimer *next;
+    EventLoopStats stats;
 };
 
 struct qemu_alarm_timer {
@@ -375,8 +381,25 @@ QEMUClock *rt_clock;
 QEMUClock *vm_clock;
 QEMUClock *host_clock;
 
+/* Pending timers of each clock are kept in a binary min-heap
+   (qemu-timer-heap.c), so arming and cancelling are O(log n).
+   active_timers[] always points to the heap root; it is what the alarm
+   signal handler looks at, so it must be updated last. */
+static QEMUTimerHeap timer_heaps[QEMU_NUM_CLOCKS];
 static QEMUTimer *active_timers[QEMU_NUM_CLOCKS];
 
+static inline QEMUTimer *timer_heap_first_timer(QEMUTimerHeap *h)
+{
+    QEMUTimerHeapEntry *e = timer_heap_first(h);
+
+    return e ? container_of(e, QEMUTimer, heap) : NULL;
+}
+
+static inline void timer_heap_update_head(int type)
+{
+    active_timers[type] = timer_heap_first_timer(&timer_heaps[type]);
+}
+
 static QEMUClock *qemu_new_clock(int type)
 {
     QEMUClock *clock;
@@ -391,7 +414,11 @@ void qemu_clock_enable(QEMUClock *clock, int enabled)
     clock->enabled = enabled;
 }
 
-QEMUTimer *qemu_new_timer(QEMUClock *clock, QEMUTimerCB *cb, void *opaque)
+/* timer whose callback qemu_run_timers is executing */
+static QEMUTimer *running_timer;
+
+QEMUTimer *qemu_new_timer_named(QEMUClock *clock, QEMUTimerCB *cb,
+                                void *opaque, const char *name)
 {
     QEMUTimer *ts;
 
@@ -399,60 +426,46 @@ QEMUTimer *qemu_new_timer(QEMUClock *clock, QEMUTimerCB *cb, void *opaque)
     ts->clock = clock;
     ts->cb = cb;
     ts->opaque = opaque;
+    ts->heap.index = -1;
+    event_loop_stats_init(&ts->stats, "timer", name, -1);
     return ts;
 }
 
 void qemu_free_timer(QEMUTimer *ts)
 {
+    qemu_del_timer(ts);
+    if (ts == running_timer) {
+        running_timer = NULL;
+    }
+    event_loop_stats_remove(&ts->stats);
     qemu_free(ts);
 }
 
 /* stop a timer, but do not dealloc it */
 void qemu_del_timer(QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
-
-    /* NOTE: this code must be signal safe because
-       qemu_timer_expired() can be called from a signal. */
-    pt = &active_timers[ts->clock->type];
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            *pt = t->next;
-            break;
-        }
-        pt = &t->next;
+    if (ts->heap.index < 0) {
+        return;
     }
+    timer_heap_remove(&timer_heaps[ts->clock->type], &ts->heap);
+    timer_heap_update_head(ts->clock->type);
 }
 
 /* modify the current timer so that it will be fired when current_time
    >= expire_time. The corresponding callback will be called. */
 void qemu_mod_timer(QEMUTimer *ts, int64_t expire_time)
 {
-    QEMUTimer **pt, *t;
-
-    qemu_del_timer(ts);
+    QEMUTimerHeap *h = &timer_heaps[ts->clock->type];
 
-    /* add the timer in the sorted list */
-    /* NOTE: this code must be signal safe because
-       qemu_timer_expired() can be called from a signal. */
-    pt = &active_timers[ts->clock->type];
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t->expire_time > expire_time)
-            break;
-        pt = &t->next;
+    if (ts->heap.index >= 0) {
+        timer_heap_remove(h, &ts->heap);
     }
-    ts->expire_time = expire_time;
-    ts->next = *pt;
-    *pt = ts;
+    ts->heap.expire_time = expire_time;
+    timer_heap_insert(h, &ts->heap);
+    timer_heap_update_head(ts->clock->type);
 
     /* Rearm if necessary  */
-    if (pt == &active_timers[ts->clock->type]) {
+    if (ts->heap.index == 0) {
         if (!alarm_timer->pending) {
             qemu_rearm_alarm_timer(alarm_timer);
         }
@@ -464,41 +477,43 @@ void qemu_mod_timer(QEMUTimer *ts, int64_t expire_time)
 
 int qemu_timer_pending(QEMUTimer *ts)
 {
-    QEMUTimer *t;
-    for(t = active_timers[ts->clock->type]; t != NULL; t = t->next) {
-        if (t == ts)
-            return 1;
-    }
-    return 0;
+    return ts->heap.index >= 0;
 }
 
 int qemu_timer_expired(QEMUTimer *timer_head, int64_t current_time)
 {
     if (!timer_head)
         return 0;
-    return (timer_head->expire_time <= current_time);
+    return (timer_head->heap.expire_time <= current_time);
 }
 
 static void qemu_run_timers(QEMUClock *clock)
 {
-    QEMUTimer **ptimer_head, *ts;
-    int64_t current_time;
-   
+    QEMUTimerHeap *h = &timer_heaps[clock->type];
+    QEMUTimer *ts;
+    int64_t current_time, start;
+
     if (!clock->enabled)
         return;
 
     current_time = qemu_get_clock (clock);
-    ptimer_head = &active_timers[clock->type];
     for(;;) {
-        ts = *ptimer_head;
-        if (!ts || ts->expire_time > current_time)
+        ts = timer_heap_first_timer(h);
+        if (!ts || ts->heap.expire_time > current_time)
             break;
-        /* remove timer from the list before calling the callback */
-        *ptimer_head = ts->next;
-        ts->next = NULL;
+        /* remove timer from the heap before calling the callback */
+        timer_heap_remove(h, &ts->heap);
+        timer_heap_update_head(clock->type);
 
-        /* run the callback (the timer list can be modified) */
+        /* run the callback (the timer heap can be modified) */
+        start = event_loop_stats_begin();
+        running_timer = ts;
         ts->cb(ts->opaque);
+        /* the callback may have freed its own timer */
+        if (running_timer) {
+            event_loop_stats_end(&ts->stats, start);
+        }
+        running_timer = NULL;
     }
 }
 
@@ -536,6 +551,84 @@ int64_t qemu_get_clock_ns(QEMUClock *clock)
     }
 }
 
+/***********************************************************/
+/* event loop accounting */
+
+int event_loop_accounting;
+
+static QLIST_HEAD(, EventLoopStats) event_loop_stats =
+    QLIST_HEAD_INITIALIZER(event_loop_stats);
+
+void event_loop_stats_init(EventLoopStats *stats, const char *kind,
+                           const char *name, int fd)
+{
+    event_loop_stats_remove(stats);
+    memset(stats, 0, sizeof(*stats));
+    stats->kind = kind;
+    stats->name = name;
+    stats->fd = fd;
+}
+
+void event_loop_stats_account(EventLoopStats *stats, int64_t start)
+{
+    int64_t ns = get_clock() - start;
+
+    if (!stats->registered) {
+        QLIST_INSERT_HEAD(&event_loop_stats, stats, next);
+        stats->registered = 1;
+    }
+    stats->count++;
+    stats->total_ns += ns;
+    if (ns > stats->max_ns) {
+        stats->max_ns = ns;
+    }
+    trace_event_loop_callback(stats->kind, stats->name, stats->fd, ns);
+}
+
+void event_loop_stats_remove(EventLoopStats *stats)
+{
+    if (stats->registered) {
+        QLIST_REMOVE(stats, next);
+        stats->registered = 0;
+    }
+}
+
+/* Turning accounting on starts over from zero */
+void event_loop_stats_enable(int enable)
+{
+    EventLoopStats *stats, *next;
+
+    if (enable && !event_loop_accounting) {
+        QLIST_FOREACH_SAFE(stats, &event_loop_stats, next, next) {
+            stats->count = 0;
+            stats->total_ns = 0;
+            stats->max_ns = 0;
+            event_loop_stats_remove(stats);
+        }
+    }
+    event_loop_accounting = enable;
+}
+
+void do_info_event_loop(Monitor *mon)
+{
+    EventLoopStats *stats;
+
+    if (!event_loop_accounting) {
+        monitor_printf(mon, "event loop accounting is off\n");
+    }
+    QLIST_FOREACH(stats, &event_loop_stats, next) {
+        monitor_printf(mon, "%-5s ", stats->kind);
+        if (stats->fd >= 0) {
+            monitor_printf(mon, "fd %-3d ", stats->fd);
+        }
+        monitor_printf(mon, "%s: calls %" PRIu64 " total %" PRId64
+                       " us avg %" PRId64 " us max %" PRId64 " us\n",
+                       stats->name, stats->count, stats->total_ns / 1000,
+                       stats->total_ns / 1000 / stats->count,
+                       stats->max_ns / 1000);
+    }
+}
+
 void init_clocks(void)
 {
     rt_clock = qemu_new_clock(QEMU_CLOCK_REALTIME);
@@ -551,7 +644,7 @@ void qemu_put_timer(QEMUFile *f, QEMUTimer *ts)
     uint64_t expire_time;
 
     if (qemu_timer_pending(ts)) {
-        expire_time = ts->expire_time;
+        expire_time = ts->heap.expire_time;
     } else {
         expire_time = -1;
     }
@@ -585,10 +678,25 @@ static const VMStateDescription vmstate_timers = {
 
 void configure_icount(const char *option)
 {
+    const char *sleep_opt;
+
     vmstate_register(NULL, 0, &vmstate_timers, &timers_state);
     if (!option)
         return;
 
+    sleep_opt = strchr(option, ',');
+    if (sleep_opt) {
+        if (strcmp(sleep_opt, ",sleep=off") != 0) {
+            fprintf(stderr, "qemu: invalid -icount option '%s'\n", option);
+            exit(1);
+        }
+        if (strncmp(option, "auto", 4) == 0) {
+            fprintf(stderr, "qemu: -icount sleep=off needs a fixed shift\n");
+            exit(1);
+        }
+        icount_sleep = 0;
+    }
+
     if (strcmp(option, "auto") != 0) {
         icount_time_shift = strtol(option, NULL, 0);
         use_icount = 1;
@@ -690,11 +798,11 @@ int64_t qemu_next_deadline(void)
     int64_t delta = INT32_MAX;
 
     if (active_timers[QEMU_CLOCK_VIRTUAL]) {
-        delta = active_timers[QEMU_CLOCK_VIRTUAL]->expire_time -
+        delta = active_timers[QEMU_CLOCK_VIRTUAL]->heap.expire_time -
                      qemu_get_clock_ns(vm_clock);
     }
     if (active_timers[QEMU_CLOCK_HOST]) {
-        int64_t hdelta = active_timers[QEMU_CLOCK_HOST]->expire_time -
+        int64_t hdelta = active_timers[QEMU_CLOCK_HOST]->heap.expire_time -
                  qemu_get_clock_ns(host_clock);
         if (hdelta < delta)
             delta = hdelta;
@@ -712,19 +820,19 @@ static int64_t qemu_next_alarm_deadline(void)
     int64_t rtdelta;
 
     if (!use_icount && active_timers[QEMU_CLOCK_VIRTUAL]) {
-        delta = active_timers[QEMU_CLOCK_VIRTUAL]->expire_time -
+        delta = active_timers[QEMU_CLOCK_VIRTUAL]->heap.expire_time -
                      qemu_get_clock(vm_clock);
     } else {
         delta = INT32_MAX;
     }
     if (active_timers[QEMU_CLOCK_HOST]) {
-        int64_t hdelta = active_timers[QEMU_CLOCK_HOST]->expire_time -
+        int64_t hdelta = active_timers[QEMU_CLOCK_HOST]->heap.expire_time -
                  qemu_get_clock_ns(host_clock);
         if (hdelta < delta)
             delta = hdelta;
     }
     if (active_timers[QEMU_CLOCK_REALTIME]) {
-        rtdelta = (active_timers[QEMU_CLOCK_REALTIME]->expire_time * 1000000 -
+        rtdelta = (active_timers[QEMU_CLOCK_REALTIME]->heap.expire_time * 1000000 -
                  qemu_get_clock_ns(rt_clock));
         if (rtdelta < delta)
             delta = rtdelta;
@@ -1072,6 +1180,24 @@ void quit_timers(void)
     t->stop(t);
 }
 
+/* Jump the virtual clock to the next vm_clock deadline.  Only used when
+   every vCPU is idle, so no instructions are skipped and the result does
+   not depend on how long the host took to get here.  */
+static int qemu_icount_warp(void)
+{
+    int64_t delta;
+
+    if (!active_timers[QEMU_CLOCK_VIRTUAL]) {
+        return 0;
+    }
+    delta = active_timers[QEMU_CLOCK_VIRTUAL]->heap.expire_time -
+            qemu_get_clock_ns(vm_clock);
+    if (delta > 0) {
+        qemu_icount_bias += delta;
+    }
+    return 1;
+}
+
 int qemu_calculate_timeout(void)
 {
     int timeout;
@@ -1085,6 +1211,18 @@ int qemu_calculate_timeout(void)
         return 5000;
     }
 
+    if (!icount_sleep) {
+        /* Never let real time leak into the virtual clock: warp when idle,
+           otherwise just wait for IO or the vCPUs to reach a deadline.  */
+        if (all_cpu_threads_idle() && qemu_icount_warp()) {
+            return 0;
+        }
+        add = qemu_next_deadline();
+        if (add > 10000000)
+            add = 10000000;
+        return add / 1000000;
+    }
+
     /* Advance virtual time to the next event.  */
     delta = qemu_icount_delta();
     if (delta > 0) {
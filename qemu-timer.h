@@ -2,6 +2,7 @@
 #define QEMU_TIMER_H
 
 #include "qemu-common.h"
+#include "qemu-queue.h"
 #include <time.h>
 #include <sys/time.h>
 
@@ -37,7 +38,11 @@ int64_t qemu_get_clock(QEMUClock *clock);
 int64_t qemu_get_clock_ns(QEMUClock *clock);
 void qemu_clock_enable(QEMUClock *clock, int enabled);
 
-QEMUTimer *qemu_new_timer(QEMUClock *clock, QEMUTimerCB *cb, void *opaque);
+QEMUTimer *qemu_new_timer_named(QEMUClock *clock, QEMUTimerCB *cb,
+                                void *opaque, const char *name);
+/* timers are named after their callback in "info event-loop" */
+#define qemu_new_timer(clock, cb, opaque) \
+    qemu_new_timer_named(clock, cb, opaque, #cb)
 void qemu_free_timer(QEMUTimer *ts);
 void qemu_del_timer(QEMUTimer *ts);
 void qemu_mod_timer(QEMUTimer *ts, int64_t expire_time);
@@ -103,6 +108,41 @@ static inline int64_t get_clock(void)
 }
 #endif
 
+/* Per-callback accounting of the main loop: how often each fd handler,
+   timer and bottom half ran and how long it took.  Only collected while
+   event_loop_accounting is set, see the event_loop_stats command. */
+typedef struct EventLoopStats {
+    const char *kind;
+    const char *name;
+    int fd;
+    uint64_t count;
+    int64_t total_ns;
+    int64_t max_ns;
+    int registered;
+    QLIST_ENTRY(EventLoopStats) next;
+} EventLoopStats;
+
+extern int event_loop_accounting;
+
+void event_loop_stats_init(EventLoopStats *stats, const char *kind,
+                           const char *name, int fd);
+void event_loop_stats_account(EventLoopStats *stats, int64_t start);
+void event_loop_stats_remove(EventLoopStats *stats);
+void event_loop_stats_enable(int enable);
+void do_info_event_loop(Monitor *mon);
+
+static inline int64_t event_loop_stats_begin(void)
+{
+    return event_loop_accounting ? get_clock() : 0;
+}
+
+static inline void event_loop_stats_end(EventLoopStats *stats, int64_t start)
+{
+    if (start) {
+        event_loop_stats_account(stats, start);
+    }
+}
+
 void qemu_get_timer(QEMUFile *f, QEMUTimer *ts);
 void qemu_put_timer(QEMUFile *f, QEMUTimer *ts);
 
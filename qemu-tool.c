@@ -73,7 +73,7 @@ void monitor_protocol_event(MonitorEvent event, QObject *data)
 {
 }
 
-QEMUBH *qemu_bh_new(QEMUBHFunc *cb, void *opaque)
+QEMUBH *qemu_bh_new_named(QEMUBHFunc *cb, void *opaque, const char *name)
 {
     QEMUBH *bh;
 
@@ -103,11 +103,13 @@ void qemu_bh_delete(QEMUBH *bh)
     qemu_free(bh);
 }
 
-int qemu_set_fd_handler2(int fd,
-                         IOCanReadHandler *fd_read_poll,
-                         IOHandler *fd_read,
-                         IOHandler *fd_write,
-                         void *opaque)
+int qemu_set_fd_handler_named(int fd,
+                              IOCanReadHandler *fd_read_poll,
+                              IOHandler *fd_read,
+                              IOHandler *fd_write,
+                              void *opaque,
+                              const char *read_name,
+                              const char *write_name)
 {
     return 0;
 }
@@ -176,6 +176,56 @@ Example:
 -> { "execute": "screendump", "arguments": { "filename": "/tmp/image" } }
 <- { "return": {} }
 
+EQMP
+
+    {
+        .name       = "screenrecord",
+        .args_type  = "filename:F",
+        .params     = "filename",
+        .help       = "record screen changes into 'filename'",
+        .user_print = monitor_user_noop,
+        .mhandler.cmd_new = do_screen_record,
+    },
+
+SQMP
+screenrecord
+------------
+
+Record the changes of the screen into a file, until screenrecord_stop.
+
+Arguments:
+
+- "filename": file path (json-string)
+
+Example:
+
+-> { "execute": "screenrecord", "arguments": { "filename": "/tmp/screen.rec" } }
+<- { "return": {} }
+
+EQMP
+
+    {
+        .name       = "screenrecord_stop",
+        .args_type  = "",
+        .params     = "",
+        .help       = "stop recording the screen",
+        .user_print = monitor_user_noop,
+        .mhandler.cmd_new = do_screen_record_stop,
+    },
+
+SQMP
+screenrecord_stop
+-----------------
+
+Stop recording the screen.
+
+Arguments: None.
+
+Example:
+
+-> { "execute": "screenrecord_stop" }
+<- { "return": {} }
+
 EQMP
 
     {
@@ -53,6 +53,15 @@ DEF_HELPER_3(sel_flags, i32, i32, i32, i32)
 DEF_HELPER_1(exception, void, i32)
 DEF_HELPER_0(wfi, void)
 
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS)
+DEF_HELPER_3(strex, i32, i32, i32, i32)
+DEF_HELPER_2(swp, i32, i32, i32)
+DEF_HELPER_2(swpb, i32, i32, i32)
+#endif
+#if defined(CONFIG_LINUX_USER)
+DEF_HELPER_0(fast_syscall, i32)
+#endif
+
 DEF_HELPER_2(cpsr_write, void, i32, i32)
 DEF_HELPER_0(cpsr_read, i32)
 
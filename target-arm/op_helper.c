@@ -18,6 +18,12 @@
  */
 #include "exec.h"
 #include "helpers.h"
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS)
+#include "qemu-atomic.h"
+#endif
+#if defined(CONFIG_LINUX_USER)
+#include "qemu.h"
+#endif
 
 #define SIGNBIT (uint32_t)0x80000000
 #define SIGNBIT64 ((uint64_t)1 << 63)
@@ -99,6 +105,62 @@ void tlb_fill (target_ulong addr, int is_write, int mmu_idx, void *retaddr)
 }
 #endif
 
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS)
+/* Guest threads run in parallel in user mode.  A store exclusive
+   succeeds if memory still holds the value seen by the load exclusive,
+   which one host compare-and-swap checks and stores.  */
+uint32_t HELPER(strex)(uint32_t addr, uint32_t val, uint32_t size)
+{
+    uint32_t expected = env->exclusive_val;
+    uint32_t old;
+
+    if (addr != env->exclusive_addr) {
+        return 1;
+    }
+    switch (size) {
+    case 0:
+        old = atomic_cmpxchg((uint8_t *)g2h(addr), expected, val);
+        break;
+    case 1:
+        old = tswap16(atomic_cmpxchg((uint16_t *)g2h(addr),
+                                     tswap16(expected), tswap16(val)));
+        break;
+    default:
+        old = tswap32(atomic_cmpxchg((uint32_t *)g2h(addr),
+                                     tswap32(expected), tswap32(val)));
+        break;
+    }
+    return old != expected;
+}
+
+uint32_t HELPER(swp)(uint32_t addr, uint32_t val)
+{
+    return tswap32(atomic_xchg((uint32_t *)g2h(addr), tswap32(val)));
+}
+
+uint32_t HELPER(swpb)(uint32_t addr, uint32_t val)
+{
+    return atomic_xchg((uint8_t *)g2h(addr), val);
+}
+#endif
+
+#if defined(CONFIG_LINUX_USER)
+/* EABI system call from translated code.  Returns 1 if it was done
+   without leaving the TB, 0 to raise EXCP_SWI as usual.  */
+uint32_t HELPER(fast_syscall)(void)
+{
+    abi_long ret;
+
+    if (!do_fast_syscall(env, env->regs[7], env->regs[0], env->regs[1],
+                         &ret)) {
+        return 0;
+    }
+    env->eabi = 1;
+    env->regs[0] = ret;
+    return 1;
+}
+#endif
+
 /* FIXME: Pass an axplicit pointer to QF to CPUState, and move saturating
    instructions into helper.c  */
 uint32_t HELPER(add_setq)(uint32_t a, uint32_t b)
@@ -58,6 +58,10 @@ typedef struct DisasContext {
     int thumb;
 #if !defined(CONFIG_USER_ONLY)
     int user;
+#endif
+#if defined(CONFIG_LINUX_USER)
+    /* Nonzero if the TB ends in an EABI system call (swi 0).  */
+    int eabi_swi;
 #endif
     int vfp_enabled;
     int vec_len;
@@ -5964,8 +5968,10 @@ static void gen_logicq_cc(TCGv_i64 val)
    regular stores.
 
    In system emulation mode only one CPU will be running at once, so
-   this sequence is effectively atomic.  In user emulation mode we
-   throw an exception and handle the atomic operation elsewhere.  */
+   this sequence is effectively atomic.  In user emulation mode the
+   store is a host compare-and-swap if the host has one; otherwise, and
+   for strexd, we throw an exception and handle the atomic operation
+   elsewhere.  */
 static void gen_load_exclusive(DisasContext *s, int rt, int rt2,
                                TCGv addr, int size)
 {
@@ -6007,6 +6013,22 @@ static void gen_clrex(DisasContext *s)
 static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
                                 TCGv addr, int size)
 {
+#ifdef CONFIG_SYNC_BUILTINS
+    if (size != 3) {
+        TCGv tmp, tmp2;
+
+        /* The helper may fault.  */
+        gen_set_condexec(s);
+        gen_set_pc_im(s->pc - 4);
+        tmp = load_reg(s, rt);
+        tmp2 = tcg_const_i32(size);
+        gen_helper_strex(cpu_R[rd], addr, tmp, tmp2);
+        tcg_temp_free_i32(tmp2);
+        tcg_temp_free_i32(tmp);
+        tcg_gen_movi_i32(cpu_exclusive_addr, -1);
+        return;
+    }
+#endif
     tcg_gen_mov_i32(cpu_exclusive_test, addr);
     tcg_gen_movi_i32(cpu_exclusive_info,
                      size | (rd << 4) | (rt << 8) | (rt2 << 12));
@@ -6788,11 +6810,23 @@ static void disas_arm_insn(CPUState * env, DisasContext *s)
                         /* SWP instruction */
                         rm = (insn) & 0xf;
 
+                        addr = load_reg(s, rn);
+                        tmp = load_reg(s, rm);
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS)
+                        /* The helper may fault.  */
+                        gen_set_condexec(s);
+                        gen_set_pc_im(s->pc - 4);
+                        tmp2 = tcg_temp_new_i32();
+                        if (insn & (1 << 22)) {
+                            gen_helper_swpb(tmp2, addr, tmp);
+                        } else {
+                            gen_helper_swp(tmp2, addr, tmp);
+                        }
+                        tcg_temp_free_i32(tmp);
+#else
                         /* ??? This is not really atomic.  However we know
                            we never have multiple CPUs running in parallel,
                            so it is good enough.  */
-                        addr = load_reg(s, rn);
-                        tmp = load_reg(s, rm);
                         if (insn & (1 << 22)) {
                             tmp2 = gen_ld8u(addr, IS_USER(s));
                             gen_st8(tmp, addr, IS_USER(s));
@@ -6800,6 +6834,7 @@ static void disas_arm_insn(CPUState * env, DisasContext *s)
                             tmp2 = gen_ld32(addr, IS_USER(s));
                             gen_st32(tmp, addr, IS_USER(s));
                         }
+#endif
                         tcg_temp_free_i32(addr);
                         store_reg(s, rd, tmp2);
                     }
@@ -7321,6 +7356,9 @@ static void disas_arm_insn(CPUState * env, DisasContext *s)
             /* swi */
             gen_set_pc_im(s->pc);
             s->is_jmp = DISAS_SWI;
+#if defined(CONFIG_LINUX_USER)
+            s->eabi_swi = (insn & 0xffffff) == 0;
+#endif
             break;
         default:
         illegal_op:
@@ -9083,6 +9121,9 @@ static void disas_thumb_insn(CPUState *env, DisasContext *s)
             /* swi */
             gen_set_pc_im(s->pc);
             s->is_jmp = DISAS_SWI;
+#if defined(CONFIG_LINUX_USER)
+            s->eabi_swi = (insn & 0xff) == 0;
+#endif
             break;
         }
         /* generate a conditional jump to next instruction */
@@ -9151,6 +9192,9 @@ static inline void gen_intermediate_code_internal(CPUState *env,
     dc->pc = pc_start;
     dc->singlestep_enabled = env->singlestep_enabled;
     dc->condjmp = 0;
+#if defined(CONFIG_LINUX_USER)
+    dc->eabi_swi = 0;
+#endif
     dc->thumb = ARM_TBFLAG_THUMB(tb->flags);
     dc->condexec_mask = (ARM_TBFLAG_CONDEXEC(tb->flags) & 0xf) << 1;
     dc->condexec_cond = ARM_TBFLAG_CONDEXEC(tb->flags) >> 4;
@@ -9366,6 +9410,20 @@ static inline void gen_intermediate_code_internal(CPUState *env,
             gen_helper_wfi();
             break;
         case DISAS_SWI:
+#if defined(CONFIG_LINUX_USER)
+            /* Try the syscalls that need no trip through cpu_loop
+               first, and go on to the next TB if that did it.  */
+            if (dc->eabi_swi) {
+                int slow = gen_new_label();
+                TCGv tmp = tcg_temp_new_i32();
+
+                gen_helper_fast_syscall(tmp);
+                tcg_gen_brcondi_i32(TCG_COND_EQ, tmp, 0, slow);
+                tcg_temp_free_i32(tmp);
+                gen_goto_tb(dc, 0, dc->pc);
+                gen_set_label(slow);
+            }
+#endif
             gen_exception(EXCP_SWI);
             break;
         }
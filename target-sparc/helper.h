@@ -32,6 +32,10 @@ DEF_HELPER_1(tick_get_count, i64, ptr)
 DEF_HELPER_2(tick_set_limit, void, ptr, i64)
 #endif
 DEF_HELPER_2(check_align, void, tl, i32)
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS)
+DEF_HELPER_1(ldstub, tl, tl)
+DEF_HELPER_2(swap, tl, tl, tl)
+#endif
 DEF_HELPER_0(debug, void)
 DEF_HELPER_0(save, void)
 DEF_HELPER_0(restore, void)
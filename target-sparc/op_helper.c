@@ -2,6 +2,9 @@
 #include "host-utils.h"
 #include "helper.h"
 #include "sysemu.h"
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS)
+#include "qemu-atomic.h"
+#endif
 
 //#define DEBUG_MMU
 //#define DEBUG_MXCC
@@ -342,6 +345,21 @@ void helper_check_align(target_ulong addr, uint32_t align)
     }
 }
 
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS)
+/* Guest threads run in parallel in user mode, so these must be atomic
+   on the host.  */
+target_ulong helper_ldstub(target_ulong addr)
+{
+    return atomic_xchg((uint8_t *)g2h(addr), 0xff);
+}
+
+target_ulong helper_swap(target_ulong addr, target_ulong val)
+{
+    helper_check_align(addr, 3);
+    return be32_to_cpu(atomic_xchg((uint32_t *)g2h(addr), cpu_to_be32(val)));
+}
+#endif
+
 #define F_HELPER(name, p) void helper_f##name##p(void)
 
 #define F_BINOP(name)                                           \
@@ -3429,6 +3447,20 @@ target_ulong helper_cas_asi(target_ulong addr, target_ulong val1,
 {
     target_ulong ret;
 
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS)
+    if (asi == 0x80 || asi == 0x88) { // Primary, Primary LE
+        uint32_t *p;
+
+        helper_check_align(addr, 3);
+        p = g2h(address_mask(env, addr));
+        if (asi == 0x88) {
+            return le32_to_cpu(atomic_cmpxchg(p, cpu_to_le32(val2),
+                                              cpu_to_le32(val1)));
+        }
+        return be32_to_cpu(atomic_cmpxchg(p, cpu_to_be32(val2),
+                                          cpu_to_be32(val1)));
+    }
+#endif
     val2 &= 0xffffffffUL;
     ret = helper_ld_asi(addr, asi, 4, 0);
     ret &= 0xffffffffUL;
@@ -3442,6 +3474,21 @@ target_ulong helper_casx_asi(target_ulong addr, target_ulong val1,
 {
     target_ulong ret;
 
+#if defined(CONFIG_USER_ONLY) && defined(CONFIG_SYNC_BUILTINS) && \
+    HOST_LONG_BITS == 64
+    if (asi == 0x80 || asi == 0x88) { // Primary, Primary LE
+        uint64_t *p;
+
+        helper_check_align(addr, 7);
+        p = g2h(address_mask(env, addr));
+        if (asi == 0x88) {
+            return le64_to_cpu(atomic_cmpxchg(p, cpu_to_le64(val2),
+                                              cpu_to_le64(val1)));
+        }
+        return be64_to_cpu(atomic_cmpxchg(p, cpu_to_be64(val2),
+                                          cpu_to_be64(val1)));
+    }
+#endif
     ret = helper_ld_asi(addr, asi, 8, 0);
     if (val2 == ret)
         helper_st_asi(addr, val1, asi, 8);
@@ -0,0 +1,209 @@
+/*
+ * Benchmark for the audio mixing engine (audio/mixeng.c)
+ *
+ * Plays a 16 bit stereo voice into a 16 bit stereo 44100 Hz output the
+ * way audio.c does: convert, resample and mix, clip, clear.  Each case
+ * runs with the plain path and with the silence shortcuts and prints the
+ * best time per output frame of three runs; the checksums of the output
+ * of both paths must match.  With -o the output of the last
+ * case is written as a WAV file, like the wav audio driver does, so
+ * the result can be listened to without audio hardware.
+ *
+ *   make mixeng-bench && ./mixeng-bench [-n periods] [-o file.wav]
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/time.h>
+#include <zlib.h>
+#include "qemu-common.h"
+#include "audio/audio.h"
+
+#define AUDIO_CAP "mixeng-bench"
+#include "audio/audio_int.h"
+
+#define OUT_RATE    44100
+#define PERIOD      1024
+
+void AUD_vlog(const char *cap, const char *fmt, va_list ap)
+{
+    vfprintf(stderr, fmt, ap);
+}
+
+void *audio_calloc(const char *funcname, int nmemb, size_t size)
+{
+    return calloc(nmemb, size);
+}
+
+void qemu_free(void *ptr)
+{
+    free(ptr);
+}
+
+typedef struct Case {
+    const char *name;
+    int rate;
+    int loud_every;     /* one period in loud_every has a tone, 0: none */
+} Case;
+
+static const Case cases[] = {
+    { "tone 44100", 44100, 1 },
+    { "tone 22050", 22050, 1 },
+    { "tone 48000", 48000, 1 },
+    { "silence 44100", 44100, 0 },
+    { "silence 48000", 48000, 0 },
+    { "mostly silent 48000", 48000, 10 },
+};
+
+static int64_t now_ns(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
+}
+
+static void put_le(uint8_t *p, uint32_t v, int bytes)
+{
+    while (bytes--) {
+        *p++ = v;
+        v >>= 8;
+    }
+}
+
+static void write_wav(const char *file, const int16_t *pcm, int frames)
+{
+    uint8_t hdr[44];
+    FILE *f = fopen(file, "wb");
+
+    if (!f) {
+        perror(file);
+        exit(1);
+    }
+    memcpy(hdr, "RIFF", 4);
+    put_le(hdr + 4, 36 + frames * 4, 4);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    put_le(hdr + 16, 16, 4);
+    put_le(hdr + 20, 1, 2);             /* PCM */
+    put_le(hdr + 22, 2, 2);             /* channels */
+    put_le(hdr + 24, OUT_RATE, 4);
+    put_le(hdr + 28, OUT_RATE * 4, 4);
+    put_le(hdr + 32, 4, 2);
+    put_le(hdr + 34, 16, 2);
+    memcpy(hdr + 36, "data", 4);
+    put_le(hdr + 40, frames * 4, 4);
+    fwrite(hdr, sizeof(hdr), 1, f);
+    fwrite(pcm, frames * 4, 1, f);
+    fclose(f);
+}
+
+/*
+ * Returns the time per output frame; *crc receives the checksum of the
+ * output and *frames its length.
+ */
+static double run(const Case *c, int periods, int fast, uLong *crc,
+                  int16_t *out, int *frames)
+{
+    t_sample *conv = mixeng_conv[1][1][0][1];
+    f_sample *clip = mixeng_clip[1][1][0][1];
+    int in_period = (int64_t)PERIOD * c->rate / OUT_RATE + 1;
+    int16_t *in = calloc(in_period, 4);
+    struct st_sample *sw_buf = calloc(in_period, sizeof(*sw_buf));
+    struct st_sample *mix_buf = calloc(PERIOD, sizeof(*mix_buf));
+    void *rate = st_rate_start(c->rate, OUT_RATE);
+    int64_t start, t = 0;
+    int p, i, phase = 0;
+
+    *crc = 0;
+    *frames = 0;
+    for (p = 0; p < periods; p++) {
+        int loud = c->loud_every && p % c->loud_every == 0;
+        int isamp = in_period, osamp = PERIOD, silent;
+
+        for (i = 0; i < in_period; i++, phase++) {
+            /* a 441 Hz triangle wave at 44100 Hz */
+            int16_t v = loud ? abs(phase % 100 - 50) * 320 - 8000 : 0;
+
+            in[2 * i] = in[2 * i + 1] = v;
+        }
+
+        start = now_ns();
+        /* like audio.c, look at the guest buffer; zeros are silence */
+        silent = fast;
+        for (i = 0; i < in_period && silent; i++) {
+            silent = ((uint32_t *)in)[i] == 0;
+        }
+        if (silent) {
+            st_rate_flow_mix_silence(rate, mix_buf, &isamp, &osamp);
+        } else {
+            conv(sw_buf, in, in_period);
+            st_rate_flow_mix(rate, sw_buf, mix_buf, &isamp, &osamp);
+        }
+        if (fast && mixeng_silent(mix_buf, osamp)) {
+            memset(out, 0, osamp * 4);
+        } else {
+            clip(out, mix_buf, osamp);
+        }
+        mixeng_clear(mix_buf, PERIOD);
+        t += now_ns() - start;
+
+        *crc = crc32(*crc, (uint8_t *)out, osamp * 4);
+        out += osamp * 2;
+        *frames += osamp;
+    }
+
+    st_rate_stop(rate);
+    free(in);
+    free(sw_buf);
+    free(mix_buf);
+    return (double)t / *frames;
+}
+
+int main(int argc, char **argv)
+{
+    const char *wav = NULL;
+    int periods = 2000, frames = 0, c, i;
+    int16_t *out;
+
+    while ((c = getopt(argc, argv, "n:o:")) != -1) {
+        switch (c) {
+        case 'n':
+            periods = atoi(optarg);
+            break;
+        case 'o':
+            wav = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n periods] [-o file.wav]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    out = calloc(periods, PERIOD * 4);
+    for (i = 0; i < ARRAY_SIZE(cases); i++) {
+        uLong crc_plain, crc_fast;
+        double plain = 1e9, fast = 1e9;
+        int j;
+
+        /* best of three, alternating, so that warm-up favours neither */
+        for (j = 0; j < 3; j++) {
+            plain = MIN(plain, run(&cases[i], periods, 0, &crc_plain, out,
+                                   &frames));
+            fast = MIN(fast, run(&cases[i], periods, 1, &crc_fast, out,
+                                 &frames));
+        }
+        printf("%-20s plain %6.2f ns/frame  fast %6.2f ns/frame  %s\n",
+               cases[i].name, plain, fast,
+               crc_plain == crc_fast ? "same output" : "OUTPUT DIFFERS");
+    }
+    if (wav) {
+        write_wav(wav, out, frames);
+    }
+    free(out);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Multi-threaded mmap benchmark for the linux-user emulation
+ *
+ * Each thread maps an anonymous area, touches it, has the kernel fill
+ * part of it with read(), makes it read-only and unmaps it again, like
+ * an allocator with one arena per thread.  The other half of the
+ * threads only do read() into a buffer, which needs nothing but the
+ * lookup of the guest mappings.  The rate is printed for 1, 2, 4 ...
+ * threads.
+ *
+ *   make mmap-bench && qemu-i386 ./mmap-bench [max-threads [iterations]]
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define AREA_SIZE   (64 * 1024)
+#define READ_SIZE   8192
+
+static int iterations = 20000;
+static int zero_fd;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *mapper(void *arg)
+{
+    long errors = 0;
+    int i;
+
+    for (i = 0; i < iterations; i++) {
+        char *p = mmap(NULL, AREA_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (p == MAP_FAILED) {
+            errors++;
+            continue;
+        }
+        p[0] = 1;
+        p[AREA_SIZE - 1] = 1;
+        if (read(zero_fd, p + 100, READ_SIZE) != READ_SIZE || p[100]) {
+            errors++;
+        }
+        if (mprotect(p, AREA_SIZE, PROT_READ) || munmap(p, AREA_SIZE)) {
+            errors++;
+        }
+    }
+    return (void *)errors;
+}
+
+static void *reader(void *arg)
+{
+    char buf[READ_SIZE];
+    long errors = 0;
+    int i;
+
+    for (i = 0; i < iterations; i++) {
+        if (read(zero_fd, buf, sizeof(buf)) != sizeof(buf)) {
+            errors++;
+        }
+    }
+    return (void *)errors;
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = 8, n, i;
+
+    if (argc > 1) {
+        max_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        iterations = atoi(argv[2]);
+    }
+    zero_fd = open("/dev/zero", O_RDONLY);
+    if (zero_fd < 0) {
+        perror("/dev/zero");
+        return 1;
+    }
+
+    for (n = 1; n <= max_threads; n *= 2) {
+        pthread_t threads[n];
+        long errors = 0;
+        double start, t;
+
+        start = now();
+        for (i = 0; i < n; i++) {
+            pthread_create(&threads[i], NULL, i % 2 ? reader : mapper, NULL);
+        }
+        for (i = 0; i < n; i++) {
+            void *ret;
+
+            pthread_join(threads[i], &ret);
+            errors += (long)ret;
+        }
+        t = now() - start;
+        printf("%2d threads: %8.0f ops/s%s\n", n, n * iterations / t,
+               errors ? "  ERRORS" : "");
+    }
+    return 0;
+}
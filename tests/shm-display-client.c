@@ -0,0 +1,155 @@
+/*
+ * Test viewer for the shared memory display (ui/shm.c)
+ *
+ * Connects to a QEMU started with -shm-display, maps the framebuffer,
+ * waits for a number of wakeups while checking the update ring and
+ * writes the final screen as a PPM file, which can be compared with the
+ * monitor's screendump.
+ *
+ *   make shm-display-client
+ *   ./shm-display-client path [wakeups] [file.ppm]
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ui/shm.h"
+
+static int connect_display(const char *path, ShmDisplayHello *hello,
+                           int *mem_fd)
+{
+    struct sockaddr_un addr;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char control[CMSG_SPACE(sizeof(int))];
+    int sock;
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+
+    iov.iov_base = hello;
+    iov.iov_len = sizeof(*hello);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sock, &msg, 0) != sizeof(*hello) ||
+        hello->magic != SHM_DISPLAY_MAGIC ||
+        hello->version != SHM_DISPLAY_VERSION) {
+        fprintf(stderr, "bad hello from QEMU\n");
+        exit(1);
+    }
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+        fprintf(stderr, "no segment passed\n");
+        exit(1);
+    }
+    memcpy(mem_fd, CMSG_DATA(cmsg), sizeof(int));
+    return sock;
+}
+
+static void write_ppm(const char *file, volatile ShmDisplayHeader *hdr,
+                      const uint8_t *fb)
+{
+    FILE *f = fopen(file, "wb");
+    uint32_t x, y;
+
+    if (!f) {
+        perror(file);
+        exit(1);
+    }
+    if (hdr->bits_per_pixel != 32) {
+        fprintf(stderr, "only 32 bpp screens are written\n");
+        exit(1);
+    }
+    fprintf(f, "P6\n%d %d\n255\n", hdr->width, hdr->height);
+    for (y = 0; y < hdr->height; y++) {
+        const uint32_t *line = (const uint32_t *)(fb + y * hdr->linesize);
+
+        for (x = 0; x < hdr->width; x++) {
+            uint32_t v = line[x];
+
+            fputc((v >> 16) & 0xff, f);
+            fputc((v >> 8) & 0xff, f);
+            fputc(v & 0xff, f);
+        }
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    ShmDisplayHello hello;
+    volatile ShmDisplayHeader *hdr;
+    const uint8_t *fb;
+    uint32_t tail, head, gen;
+    uint64_t pixels = 0;
+    int sock, mem_fd, wakeups, i, rects = 0, overruns = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s path [wakeups] [file.ppm]\n", argv[0]);
+        return 1;
+    }
+    wakeups = argc > 2 ? atoi(argv[2]) : 100;
+
+    sock = connect_display(argv[1], &hello, &mem_fd);
+    hdr = mmap(NULL, hello.size, PROT_READ, MAP_SHARED, mem_fd, 0);
+    if (hdr == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    fb = (const uint8_t *)hdr + hdr->data_offset;
+
+    gen = hdr->generation;
+    tail = hdr->ring_head;
+    for (i = 0; i < wakeups; i++) {
+        if (read(sock, &head, sizeof(head)) != sizeof(head)) {
+            fprintf(stderr, "QEMU went away\n");
+            return 1;
+        }
+        head = hdr->ring_head;
+        if (head - tail > SHM_DISPLAY_RING) {
+            overruns++;
+        } else {
+            for (; tail != head; tail++) {
+                volatile ShmDisplayRect *r =
+                    &hdr->ring[tail % SHM_DISPLAY_RING];
+
+                if (r->x + r->w > hdr->width || r->y + r->h > hdr->height) {
+                    fprintf(stderr, "rect %dx%d+%d+%d outside %dx%d\n",
+                            r->w, r->h, r->x, r->y, hdr->width, hdr->height);
+                    return 1;
+                }
+                pixels += r->w * r->h;
+                rects++;
+            }
+        }
+        tail = head;
+    }
+
+    printf("%dx%d %d bpp, generation %d -> %d, %d rects, %" PRIu64
+           " pixels, %d overruns\n", hdr->width, hdr->height,
+           hdr->bits_per_pixel, gen, hdr->generation, rects, pixels,
+           overruns);
+    if (argc > 3) {
+        write_ppm(argv[3], hdr, fb);
+    }
+    return 0;
+}
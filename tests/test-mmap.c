@@ -29,6 +29,7 @@
 #include <unistd.h>
 
 #include <sys/mman.h>
+#include <sys/time.h>
 
 #define D(x)
 
@@ -133,6 +134,77 @@ void check_large_anonymous_unfixed_mmap(void)
 	fprintf (stderr, " passed\n");
 }
 
+static long now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+/* Resident set of the process, which under qemu is the emulator's.  */
+static long rss_kb(void)
+{
+	char line[128];
+	long kb = 0;
+	FILE *f;
+
+	f = fopen("/proc/self/status", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof line, f))
+		if (sscanf(line, "VmRSS: %ld", &kb) == 1)
+			break;
+	fclose(f);
+	return kb;
+}
+
+/* A large reservation, like the heap of a JVM.  Only a few pages are
+   used, so neither the time nor the memory needed to map it should
+   depend on its size.  */
+void check_large_reservation(void)
+{
+	char *p1;
+	size_t len;
+	long rss, t0, t1, t2, t3;
+
+	fprintf (stderr, "%s", __func__);
+
+	/* As large as the address space allows.  */
+	p1 = MAP_FAILED;
+	for (len = sizeof (long) > 4 ? 0x1000000000ULL : 0x40000000;
+	     len >= 0x1000000 && p1 == MAP_FAILED; len >>= 1)
+		p1 = mmap(NULL, len, PROT_NONE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+			  -1, 0);
+	len <<= 1;
+	fail_unless (p1 != MAP_FAILED);
+	fail_unless (((uintptr_t) p1 & pagemask) == 0);
+	munmap (p1, len);
+
+	rss = rss_kb();
+	t0 = now_us();
+	p1 = mmap(NULL, len, PROT_NONE,
+		  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	fail_unless (p1 != MAP_FAILED);
+	t1 = now_us();
+	fail_unless (mprotect(p1, len, PROT_READ | PROT_WRITE) == 0);
+	t2 = now_us();
+
+	/* Use the first and the last page.  */
+	p1[0] = 1;
+	p1[len - 1] = 2;
+	fail_unless (p1[0] == 1 && p1[len - 1] == 2);
+	rss = rss_kb() - rss;
+
+	t3 = now_us();
+	fail_unless (munmap (p1, len) == 0);
+	fprintf (stderr, " %zu MB: mmap %ld us, mprotect %ld us, munmap %ld us,"
+		 " RSS +%ld kB", len >> 20, t1 - t0, t2 - t1, now_us() - t3,
+		 rss);
+	fprintf (stderr, " passed\n");
+}
+
 void check_aligned_anonymous_unfixed_colliding_mmaps(void)
 {
 	char *p1;
@@ -468,6 +540,7 @@ int main(int argc, char **argv)
 	check_file_fixed_mmaps();
 	check_file_fixed_eof_mmaps();
 	check_file_unfixed_eof_mmaps();
+	check_large_reservation();
 
 	/* Fails at the moment.  */
 	/* check_aligned_anonymous_fixed_mmaps_collide_with_host(); */
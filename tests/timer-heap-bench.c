@@ -0,0 +1,275 @@
+/*
+ * Micro-benchmark for the timer heap (qemu-timer-heap.c)
+ *
+ * Arms, rearms and cancels N timers in random order with random
+ * deadlines, once with the heap and once with the sorted list that
+ * qemu_mod_timer and qemu_del_timer used to walk, and prints the time
+ * per operation of each phase.  Both must hand the timers back in the
+ * same order, timers with equal deadlines in the order they were armed.
+ *
+ *   make timer-heap-bench && ./timer-heap-bench [operations]
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "qemu-common.h"
+#include "qemu-timer-heap.h"
+
+#define MAX_TIMERS  4096
+
+void *qemu_realloc(void *ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+typedef struct TimerImpl {
+    const char *name;
+    void (*mod)(int id, int64_t expire_time);
+    void (*del)(int id);
+    /* remove the earliest pending timer and return it, -1 if none */
+    int (*pop)(void);
+} TimerImpl;
+
+typedef struct HeapTimer {
+    QEMUTimerHeapEntry heap;
+    int id;
+} HeapTimer;
+
+static QEMUTimerHeap heap;
+static HeapTimer heap_timers[MAX_TIMERS];
+
+static void heap_del(int id)
+{
+    HeapTimer *ts = &heap_timers[id];
+
+    if (ts->heap.index >= 0) {
+        timer_heap_remove(&heap, &ts->heap);
+    }
+}
+
+static void heap_mod(int id, int64_t expire_time)
+{
+    HeapTimer *ts = &heap_timers[id];
+
+    heap_del(id);
+    ts->heap.expire_time = expire_time;
+    timer_heap_insert(&heap, &ts->heap);
+}
+
+static int heap_pop(void)
+{
+    QEMUTimerHeapEntry *e = timer_heap_first(&heap);
+
+    if (!e) {
+        return -1;
+    }
+    timer_heap_remove(&heap, e);
+    return container_of(e, HeapTimer, heap)->id;
+}
+
+/* The sorted list, as qemu-timer.c kept it before the heap */
+typedef struct ListTimer {
+    int64_t expire_time;
+    struct ListTimer *next;
+    int id;
+} ListTimer;
+
+static ListTimer *list_head;
+static ListTimer list_timers[MAX_TIMERS];
+
+static void list_del(int id)
+{
+    ListTimer **pt, *t, *ts = &list_timers[id];
+
+    pt = &list_head;
+    for (;;) {
+        t = *pt;
+        if (!t) {
+            break;
+        }
+        if (t == ts) {
+            *pt = t->next;
+            break;
+        }
+        pt = &t->next;
+    }
+}
+
+static void list_mod(int id, int64_t expire_time)
+{
+    ListTimer **pt, *t, *ts = &list_timers[id];
+
+    list_del(id);
+    pt = &list_head;
+    for (;;) {
+        t = *pt;
+        if (!t) {
+            break;
+        }
+        if (t->expire_time > expire_time) {
+            break;
+        }
+        pt = &t->next;
+    }
+    ts->expire_time = expire_time;
+    ts->next = *pt;
+    *pt = ts;
+}
+
+static int list_pop(void)
+{
+    ListTimer *t = list_head;
+
+    if (!t) {
+        return -1;
+    }
+    list_head = t->next;
+    return t->id;
+}
+
+static const TimerImpl impls[] = {
+    { "list", list_mod, list_del, list_pop },
+    { "heap", heap_mod, heap_del, heap_pop },
+};
+
+static int perm[MAX_TIMERS];
+static int64_t deadline[MAX_TIMERS];
+
+static int64_t now_ns(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
+}
+
+/* Shuffle the timers and pick deadlines; a small range gives ties */
+static void prepare(int n, int64_t range)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        perm[i] = i;
+    }
+    for (i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = perm[i];
+
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+    for (i = 0; i < n; i++) {
+        deadline[i] = rand() % range;
+    }
+}
+
+static void init_timers(void)
+{
+    int i;
+
+    memset(&heap_timers, 0, sizeof(heap_timers));
+    memset(&list_timers, 0, sizeof(list_timers));
+    for (i = 0; i < MAX_TIMERS; i++) {
+        heap_timers[i].heap.index = -1;
+        heap_timers[i].id = i;
+        list_timers[i].id = i;
+    }
+}
+
+/* ns[0..2]: arm, rearm and cancel time per operation */
+static void run(const TimerImpl *impl, int n, int rounds, double *ns)
+{
+    int64_t total[3] = { 0, 0, 0 };
+    int64_t start;
+    int r, i;
+
+    init_timers();
+    for (r = 0; r < rounds; r++) {
+        srand(r);
+        prepare(n, 1000000);
+        start = now_ns();
+        for (i = 0; i < n; i++) {
+            impl->mod(perm[i], deadline[i]);
+        }
+        total[0] += now_ns() - start;
+
+        prepare(n, 1000000);
+        start = now_ns();
+        for (i = 0; i < n; i++) {
+            impl->mod(perm[i], deadline[i]);
+        }
+        total[1] += now_ns() - start;
+
+        prepare(n, 1000000);
+        start = now_ns();
+        for (i = 0; i < n; i++) {
+            impl->del(perm[i]);
+        }
+        total[2] += now_ns() - start;
+    }
+    for (i = 0; i < 3; i++) {
+        ns[i] = (double)total[i] / ((int64_t)rounds * n);
+    }
+}
+
+static int check_order(int n)
+{
+    int order[2][MAX_TIMERS];
+    int k, i;
+
+    init_timers();
+    for (k = 0; k < 2; k++) {
+        srand(n);
+        prepare(n, n / 4 + 1);
+        for (i = 0; i < n; i++) {
+            impls[k].mod(perm[i], deadline[i]);
+        }
+        prepare(n, n / 4 + 1);
+        for (i = 0; i < n / 2; i++) {
+            impls[k].mod(perm[i], deadline[i]);
+            impls[k].del(perm[n - 1 - i]);
+        }
+        for (i = 0; i < n; i++) {
+            order[k][i] = impls[k].pop();
+        }
+        if (impls[k].pop() != -1) {
+            return -1;
+        }
+    }
+    return memcmp(order[0], order[1], sizeof(int) * n) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[] = { 4, 16, 64, 256, 1024, MAX_TIMERS };
+    int ops = argc > 1 ? atoi(argv[1]) : 200000;
+    unsigned int s;
+    int k;
+
+    for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+        int n = sizes[s];
+        int rounds = (ops + n - 1) / n;
+        double ns[2][3];
+
+        if (check_order(n) < 0) {
+            fprintf(stderr, "%d timers: heap order differs from the list\n",
+                    n);
+            return 1;
+        }
+        for (k = 0; k < 2; k++) {
+            run(&impls[k], n, rounds, ns[k]);
+        }
+        printf("%4d timers, ns/op:", n);
+        for (k = 0; k < 2; k++) {
+            printf("  %s arm %.1f rearm %.1f cancel %.1f",
+                   impls[k].name, ns[k][0], ns[k][1], ns[k][2]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Micro-benchmark for the VNC surface comparison (ui/vnc-dirty.c)
+ *
+ * Runs vnc_sync_row and the plain memcmp reference over a 1920x1200
+ * 32 bpp surface with a given fraction of changed chunks, checks that
+ * both give the same result and prints the time per full-surface pass.
+ * It then scrolls the surface vertically and horizontally and checks
+ * that vnc_detect_scroll finds the moves.
+ *
+ *   make vnc-dirty-bench && ./vnc-dirty-bench [percent-changed] [passes]
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "qemu-common.h"
+#include "bitmap.h"
+#include "ui/vnc-dirty.h"
+
+#define WIDTH   1920
+#define HEIGHT  1200
+#define BPP     4
+#define NCHUNKS (WIDTH / 16)
+#define NWORDS  BITS_TO_LONGS(NCHUNKS)
+
+typedef int SyncRowFunc(uint8_t *server, const uint8_t *guest,
+                        int chunk_bytes, int nchunks, unsigned long *dirty,
+                        unsigned long *changed);
+
+static uint8_t *guest, *server, *server_ref;
+static unsigned long changed[HEIGHT][NWORDS], changed_ref[HEIGHT][NWORDS];
+
+static int64_t now_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* Mark every chunk dirty and change percent of them in the guest */
+static void prepare(uint8_t *srv, int percent, unsigned int seed)
+{
+    int i;
+
+    memcpy(srv, guest, WIDTH * HEIGHT * BPP);
+    srand(seed);
+    for (i = 0; i < HEIGHT * NCHUNKS; i++) {
+        if (rand() % 100 < percent) {
+            srv[i * 16 * BPP + (rand() % (16 * BPP))] ^= 0x5a;
+        }
+    }
+}
+
+static int64_t run(SyncRowFunc *fn, uint8_t *srv,
+                   unsigned long (*chg)[NWORDS], int percent, int passes,
+                   int *nchanged)
+{
+    unsigned long dirty[NWORDS];
+    int64_t total = 0;
+    int p, y;
+
+    for (p = 0; p < passes; p++) {
+        int64_t start;
+
+        prepare(srv, percent, p);
+        memset(chg, 0, sizeof(changed));
+        *nchanged = 0;
+        start = now_us();
+        for (y = 0; y < HEIGHT; y++) {
+            bitmap_fill(dirty, NCHUNKS);
+            *nchanged += fn(srv + y * WIDTH * BPP, guest + y * WIDTH * BPP,
+                            16 * BPP, NCHUNKS, dirty, chg[y]);
+        }
+        total += now_us() - start;
+    }
+    return total / passes;
+}
+
+/* Scroll server into guest by (dx, dy) and check what is detected */
+static int check_scroll(int dx, int dy)
+{
+    VncScroll sc;
+    int64_t start;
+    int x, y, ok;
+
+    for (y = 0; y < HEIGHT; y++) {
+        for (x = 0; x < WIDTH; x++) {
+            int sx = x - dx, sy = y - dy;
+            uint32_t v;
+
+            if (sx >= 0 && sx < WIDTH && sy >= 0 && sy < HEIGHT) {
+                memcpy(&v, server + (sy * WIDTH + sx) * BPP, BPP);
+            } else {
+                v = rand();
+            }
+            memcpy(guest + (y * WIDTH + x) * BPP, &v, BPP);
+        }
+    }
+    start = now_us();
+    ok = vnc_detect_scroll(server, guest, WIDTH * BPP, BPP, 0, 0,
+                           WIDTH, HEIGHT, &sc);
+    printf("scroll by (%d, %d): ", dx, dy);
+    if (!ok || sc.dst_x - sc.src_x != dx || sc.dst_y - sc.src_y != dy ||
+        sc.w != WIDTH - abs(dx) || sc.h != HEIGHT - abs(dy)) {
+        printf("not detected\n");
+        return 1;
+    }
+    printf("%dx%d block detected in %" PRId64 " us\n", sc.w, sc.h,
+           now_us() - start);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int percent = argc > 1 ? atoi(argv[1]) : 10;
+    int passes = argc > 2 ? atoi(argv[2]) : 20;
+    int64_t t, t_ref;
+    int n, n_ref, i;
+
+    guest = malloc(WIDTH * HEIGHT * BPP);
+    server = malloc(WIDTH * HEIGHT * BPP);
+    server_ref = malloc(WIDTH * HEIGHT * BPP);
+    for (i = 0; i < WIDTH * HEIGHT * BPP; i++) {
+        guest[i] = i * 7;
+    }
+
+    t_ref = run(vnc_sync_row_ref, server_ref, changed_ref, percent, passes,
+                &n_ref);
+    t = run(vnc_sync_row, server, changed, percent, passes, &n);
+
+    if (n != n_ref || memcmp(changed, changed_ref, sizeof(changed)) ||
+        memcmp(server, server_ref, WIDTH * HEIGHT * BPP)) {
+        fprintf(stderr, "vnc_sync_row differs from the reference\n");
+        return 1;
+    }
+    printf("%dx%d, %d%% of chunks changed (%d): "
+           "reference %" PRId64 " us, vnc_sync_row %" PRId64 " us\n",
+           WIDTH, HEIGHT, percent, n, t_ref, t);
+
+    for (i = 0; i < WIDTH * HEIGHT; i++) {
+        uint32_t v = rand();
+
+        memcpy(server + i * BPP, &v, BPP);
+    }
+    return check_scroll(0, -24) | check_scroll(0, 40) |
+           check_scroll(-8, 0) | check_scroll(33, 0);
+}
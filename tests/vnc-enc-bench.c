@@ -0,0 +1,346 @@
+/*
+ * Benchmark for the VNC hextile, ZRLE and ZYWRLE encoders
+ *
+ * Encodes framebuffers with each encoding and prints the encoded size
+ * and the time per pixel.  Frames are read from PPM files, such as the
+ * ones written by the monitor's screendump command; without arguments a
+ * text console, a desktop and a photo-like frame are generated.
+ *
+ *   make vnc-enc-bench && ./vnc-enc-bench [-n passes] [file.ppm...]
+ *
+ * Only the encoders themselves are linked; the parts of vnc.c they use
+ * are replaced by the minimal versions below.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "qemu-common.h"
+#include "ui/vnc.h"
+
+void *qemu_malloc(size_t size)
+{
+    return malloc(size ? size : 1);
+}
+
+void *qemu_mallocz(size_t size)
+{
+    return calloc(1, size ? size : 1);
+}
+
+void qemu_free(void *ptr)
+{
+    free(ptr);
+}
+
+void buffer_reserve(Buffer *buffer, size_t len)
+{
+    if ((buffer->capacity - buffer->offset) < len) {
+        buffer->capacity += (len + 1024);
+        buffer->buffer = realloc(buffer->buffer, buffer->capacity);
+    }
+}
+
+void buffer_reset(Buffer *buffer)
+{
+    buffer->offset = 0;
+}
+
+void buffer_free(Buffer *buffer)
+{
+    free(buffer->buffer);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+void vnc_write(VncState *vs, const void *data, size_t len)
+{
+    buffer_reserve(&vs->output, len);
+    memcpy(vs->output.buffer + vs->output.offset, data, len);
+    vs->output.offset += len;
+}
+
+void vnc_write_u8(VncState *vs, uint8_t value)
+{
+    vnc_write(vs, &value, 1);
+}
+
+void vnc_write_u32(VncState *vs, uint32_t value)
+{
+    value = cpu_to_be32(value);
+    vnc_write(vs, &value, 4);
+}
+
+void vnc_framebuffer_update(VncState *vs, int x, int y, int w, int h,
+                            int32_t encoding)
+{
+    uint8_t hdr[12] = { 0 };
+
+    vnc_write(vs, hdr, sizeof(hdr));
+}
+
+/* the client uses the server's pixel format */
+void vnc_convert_pixel(VncState *vs, uint8_t *buf, uint32_t v)
+{
+    memcpy(buf, &v, vs->clientds.pf.bytes_per_pixel);
+}
+
+static void write_pixels(VncState *vs, struct PixelFormat *pf,
+                         void *pixels, int size)
+{
+    vnc_write(vs, pixels, size);
+}
+
+int vnc_raw_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
+{
+    DisplaySurface *s = vs->vd->server;
+    uint8_t *row = s->data + y * s->linesize + x * s->pf.bytes_per_pixel;
+    int i;
+
+    for (i = 0; i < h; i++) {
+        vs->write_pixels(vs, &s->pf, row, w * s->pf.bytes_per_pixel);
+        row += s->linesize;
+    }
+    return 1;
+}
+
+void *vnc_zlib_zalloc(void *x, unsigned items, unsigned size)
+{
+    return calloc(items, size);
+}
+
+void vnc_zlib_zfree(void *x, void *addr)
+{
+    free(addr);
+}
+
+typedef struct Frame {
+    const char *name;
+    int width;
+    int height;
+    uint32_t *data;
+} Frame;
+
+typedef struct Encoding {
+    const char *name;
+    int (*send)(VncState *vs, int x, int y, int w, int h);
+} Encoding;
+
+static const Encoding encodings[] = {
+    { "raw", vnc_raw_send_framebuffer_update },
+    { "hextile", vnc_hextile_send_framebuffer_update },
+    { "zrle", vnc_zrle_send_framebuffer_update },
+    { "zywrle", vnc_zywrle_send_framebuffer_update },
+};
+
+static int64_t now_ns(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
+}
+
+static int load_ppm(const char *file, Frame *f)
+{
+    FILE *fp = fopen(file, "rb");
+    int maxval, i;
+
+    if (!fp || fscanf(fp, "P6 %d %d %d", &f->width, &f->height,
+                      &maxval) != 3 || maxval != 255) {
+        fprintf(stderr, "%s: not a PPM file\n", file);
+        return -1;
+    }
+    fgetc(fp);
+    f->name = file;
+    f->data = malloc(f->width * f->height * 4);
+    for (i = 0; i < f->width * f->height; i++) {
+        uint8_t rgb[3];
+
+        if (fread(rgb, 3, 1, fp) != 1) {
+            fprintf(stderr, "%s: truncated\n", file);
+            return -1;
+        }
+        f->data[i] = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* 80x25 cells of 9x16 pixels with random glyphs, two colors per cell */
+static void gen_text(Frame *f)
+{
+    uint8_t glyphs[25][80][16];
+    int x, y;
+
+    f->name = "text";
+    f->width = 720;
+    f->height = 400;
+    f->data = malloc(f->width * f->height * 4);
+    srand(1);
+    for (y = 0; y < 25; y++) {
+        int len = rand() % 80;
+
+        for (x = 0; x < 80; x++) {
+            int i;
+
+            for (i = 0; i < 16; i++) {
+                glyphs[y][x][i] = x < len && i > 2 && i < 14 ? rand() : 0;
+            }
+        }
+    }
+    for (y = 0; y < f->height; y++) {
+        for (x = 0; x < f->width; x++) {
+            int bits = glyphs[y / 16][x / 9][y % 16];
+            int lit = (x % 9) < 8 && (bits >> (x % 9)) & 1;
+
+            f->data[y * f->width + x] = lit ? 0xaaaaaa : 0x000000;
+        }
+    }
+}
+
+/* solid background, a few windows with title bars, text and a gradient */
+static void gen_desktop(Frame *f)
+{
+    int x, y;
+
+    f->name = "desktop";
+    f->width = 1280;
+    f->height = 1024;
+    f->data = malloc(f->width * f->height * 4);
+    for (y = 0; y < f->height; y++) {
+        for (x = 0; x < f->width; x++) {
+            uint32_t c = 0x3a6ea5;
+
+            if (x >= 100 && x < 900 && y >= 80 && y < 700) {
+                if (y < 104) {
+                    c = 0x000080 + ((x - 100) * 0x7f / 800);
+                } else if (((x / 7 + y / 13) % 5) == 0 && (y % 13) > 2) {
+                    c = 0x000000;
+                } else {
+                    c = 0xffffff;
+                }
+            }
+            if (x >= 600 && x < 1200 && y >= 400 && y < 900) {
+                c = ((x - 600) * 255 / 600) << 16 | ((y - 400) * 255 / 500);
+            }
+            if (y >= 992) {
+                c = 0xc0c0c0;
+            }
+            f->data[y * f->width + x] = c;
+        }
+    }
+}
+
+/* smooth shading with noise, like a photo or a video */
+static void gen_photo(Frame *f)
+{
+    int x, y;
+
+    f->name = "photo";
+    f->width = 800;
+    f->height = 600;
+    f->data = malloc(f->width * f->height * 4);
+    srand(1);
+    for (y = 0; y < f->height; y++) {
+        for (x = 0; x < f->width; x++) {
+            int r = (x * 200 / f->width) + rand() % 24;
+            int g = (y * 200 / f->height) + rand() % 24;
+            int b = ((x + y) * 100 / (f->width + f->height)) + rand() % 24;
+
+            f->data[y * f->width + x] = (r << 16) | (g << 8) | b;
+        }
+    }
+}
+
+static void bench(Frame *f, int passes)
+{
+    static VncDisplay vd;
+    static VncState vs;
+    static DisplayState ds;
+    DisplaySurface surface;
+    int e, p;
+
+    memset(&surface, 0, sizeof(surface));
+    surface.width = f->width;
+    surface.height = f->height;
+    surface.linesize = f->width * 4;
+    surface.pf.bits_per_pixel = 32;
+    surface.pf.bytes_per_pixel = 4;
+    surface.pf.depth = 24;
+    surface.pf.rmask = 0xff0000;
+    surface.pf.gmask = 0xff00;
+    surface.pf.bmask = 0xff;
+    surface.pf.rmax = surface.pf.gmax = surface.pf.bmax = 255;
+    surface.pf.rshift = 16;
+    surface.pf.gshift = 8;
+    surface.pf.rbits = surface.pf.gbits = surface.pf.bbits = 8;
+    surface.data = (uint8_t *)f->data;
+
+    memset(&vd, 0, sizeof(vd));
+    vd.server = &surface;
+    vd.lossy = true;
+    ds.surface = &surface;
+
+    for (e = 0; e < ARRAY_SIZE(encodings); e++) {
+        size_t bytes = 0;
+        uLong crc = 0;
+        int64_t start, t;
+
+        vnc_zrle_clear(&vs);
+        memset(&vs, 0, sizeof(vs));
+        vs.vd = &vd;
+        vs.ds = &ds;
+        vs.clientds = surface;
+        vs.write_pixels = write_pixels;
+        vs.tight.quality = 5;
+        vnc_hextile_set_pixel_conversion(&vs, 0);
+
+        start = now_ns();
+        for (p = 0; p < passes; p++) {
+            buffer_reset(&vs.output);
+            encodings[e].send(&vs, 0, 0, f->width, f->height);
+            /* later passes compress against the first in the zlib window */
+            if (p == 0) {
+                bytes = vs.output.offset;
+                crc = crc32(0, vs.output.buffer, bytes);
+            }
+        }
+        t = now_ns() - start;
+        printf("%-16s %4dx%-4d %-8s %10zu bytes (crc %08lx) %7.2f ns/pixel\n",
+               f->name, f->width, f->height, encodings[e].name, bytes, crc,
+               (double)t / passes / (f->width * f->height));
+        buffer_free(&vs.output);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int passes = 10, i = 1;
+    Frame f;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        passes = atoi(argv[2]);
+        i = 3;
+    }
+    if (i == argc) {
+        gen_text(&f);
+        bench(&f, passes);
+        gen_desktop(&f);
+        bench(&f, passes);
+        gen_photo(&f);
+        bench(&f, passes);
+        return 0;
+    }
+    for (; i < argc; i++) {
+        if (load_ppm(argv[i], &f) < 0) {
+            return 1;
+        }
+        bench(&f, passes);
+        free(f.data);
+    }
+    return 0;
+}
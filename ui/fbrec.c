@@ -0,0 +1,557 @@
+/*
+ * QEMU framebuffer recorder
+ *
+ * Records the screen to a file of zlib compressed delta frames, see
+ * fbrec.h for the format and qemu-fbrec for turning it into images.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <zlib.h>
+
+#include "qemu-common.h"
+#include "qemu-timer.h"
+#include "qemu-queue.h"
+#include "console.h"
+#include "monitor.h"
+#include "bitmap.h"
+#include "qemu-error.h"
+#ifdef CONFIG_THREAD
+#include "qemu-thread.h"
+#endif
+#include "fbrec.h"
+
+#define FBREC_TILE          16
+#define FBREC_INTERVAL      40          /* ms between two captures */
+#define FBREC_MAX_QUEUED    (64 << 20)  /* raw bytes waiting for zlib */
+
+typedef struct FbRecFrame {
+    FbRecFrameHeader hdr;
+    uint8_t *data;
+    QTAILQ_ENTRY(FbRecFrame) next;
+} FbRecFrame;
+
+typedef struct FbRecorder {
+    DisplayState *ds;
+    DisplayChangeListener dcl;
+    QEMUTimer *timer;
+    FILE *f;
+    char *filename;
+    int64_t start;
+
+    /* the last recorded frame and the tiles changed since */
+    int width;
+    int height;
+    uint32_t *shadow;
+    uint32_t *row;
+    unsigned long *dirty;
+    int tiles_x;
+    int tiles_y;
+    FbRecRect *rects;
+    int need_key;
+
+    uint64_t frames;
+    uint64_t dropped;
+    uint64_t raw_bytes;
+    uint64_t bytes;
+    int write_error;    /* errno of the first failed write, 0 if none */
+    size_t queued;
+    QTAILQ_HEAD(, FbRecFrame) queue;
+#ifdef CONFIG_THREAD
+    QemuThread thread;
+    QemuMutex lock;
+    QemuCond cond;
+    int quit;
+#endif
+} FbRecorder;
+
+static FbRecorder *recorder;
+
+static void fbrec_lock(FbRecorder *rec)
+{
+#ifdef CONFIG_THREAD
+    qemu_mutex_lock(&rec->lock);
+#endif
+}
+
+static void fbrec_unlock(FbRecorder *rec)
+{
+#ifdef CONFIG_THREAD
+    qemu_mutex_unlock(&rec->lock);
+#endif
+}
+
+static void fbrec_mark(FbRecorder *rec, int x, int y, int w, int h)
+{
+    int tx0, tx1, ty0, ty1, ty;
+
+    w = MIN(x + w, rec->width) - MAX(x, 0);
+    h = MIN(y + h, rec->height) - MAX(y, 0);
+    x = MAX(x, 0);
+    y = MAX(y, 0);
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    tx0 = x / FBREC_TILE;
+    tx1 = (x + w - 1) / FBREC_TILE;
+    ty0 = y / FBREC_TILE;
+    ty1 = (y + h - 1) / FBREC_TILE;
+    for (ty = ty0; ty <= ty1; ty++) {
+        bitmap_set(rec->dirty, ty * rec->tiles_x + tx0, tx1 - tx0 + 1);
+    }
+}
+
+static void fbrec_setup(FbRecorder *rec)
+{
+    int ntiles;
+
+    rec->width = ds_get_width(rec->ds);
+    rec->height = ds_get_height(rec->ds);
+    rec->tiles_x = DIV_ROUND_UP(rec->width, FBREC_TILE);
+    rec->tiles_y = DIV_ROUND_UP(rec->height, FBREC_TILE);
+    ntiles = rec->tiles_x * rec->tiles_y;
+
+    qemu_free(rec->shadow);
+    qemu_free(rec->row);
+    qemu_free(rec->dirty);
+    qemu_free(rec->rects);
+    rec->shadow = qemu_mallocz(rec->width * rec->height * sizeof(uint32_t));
+    rec->row = qemu_malloc(rec->width * sizeof(uint32_t));
+    rec->dirty = bitmap_new(ntiles);
+    rec->rects = qemu_malloc(ntiles * sizeof(FbRecRect));
+    bitmap_set(rec->dirty, 0, ntiles);
+    rec->need_key = 1;
+}
+
+/* Read w pixels of the surface as 0x00RRGGBB */
+static void fbrec_read_row(DisplaySurface *surface, int x, int y, int w,
+                           uint32_t *dst)
+{
+    PixelFormat *pf = &surface->pf;
+    uint8_t *src = surface->data + y * surface->linesize +
+                   x * pf->bytes_per_pixel;
+    int i;
+
+    if (pf->bytes_per_pixel == 4 && pf->rmask == 0xff0000 &&
+        pf->gmask == 0xff00 && pf->bmask == 0xff) {
+        for (i = 0; i < w; i++) {
+            dst[i] = ((uint32_t *)src)[i] & 0xffffff;
+        }
+        return;
+    }
+
+    for (i = 0; i < w; i++) {
+        uint32_t v, r, g, b;
+
+        switch (pf->bytes_per_pixel) {
+        case 1:
+            v = src[i];
+            break;
+        case 2:
+            v = ((uint16_t *)src)[i];
+            break;
+        default:
+            v = ((uint32_t *)src)[i];
+            break;
+        }
+        r = ((v & pf->rmask) >> pf->rshift) << (8 - pf->rbits);
+        g = ((v & pf->gmask) >> pf->gshift) << (8 - pf->gbits);
+        b = ((v & pf->bmask) >> pf->bshift) << (8 - pf->bbits);
+        dst[i] = (r << 16) | (g << 8) | b;
+    }
+}
+
+/*
+ * Fold the rectangle into the shadow copy and, if out is not NULL,
+ * store the XOR of old and new pixels there.  Returns whether anything
+ * changed.
+ */
+static int fbrec_delta(FbRecorder *rec, DisplaySurface *surface,
+                       FbRecRect *r, uint32_t *out)
+{
+    uint32_t changed = 0;
+    int i, j;
+
+    for (j = 0; j < r->h; j++) {
+        uint32_t *shadow = rec->shadow + (r->y + j) * rec->width + r->x;
+
+        fbrec_read_row(surface, r->x, r->y + j, r->w, rec->row);
+        for (i = 0; i < r->w; i++) {
+            uint32_t d = shadow[i] ^ rec->row[i];
+
+            changed |= d;
+            if (out) {
+                *out++ = cpu_to_le32(d);
+            }
+        }
+        memcpy(shadow, rec->row, r->w * sizeof(uint32_t));
+    }
+    return changed != 0;
+}
+
+static void fbrec_put_rect(uint8_t *p, FbRecRect *r)
+{
+    FbRecRect le;
+
+    le.x = cpu_to_le16(r->x);
+    le.y = cpu_to_le16(r->y);
+    le.w = cpu_to_le16(r->w);
+    le.h = cpu_to_le16(r->h);
+    memcpy(p, &le, sizeof(le));
+}
+
+/* Returns the bytes written, or 0 with errno set if the write failed */
+static size_t fbrec_write_frame(FbRecorder *rec, FbRecFrame *frame)
+{
+    FbRecFrameHeader hdr = frame->hdr;
+    uLongf size = compressBound(hdr.raw_size);
+    uint8_t *buf = qemu_malloc(size);
+    size_t ret = 0;
+
+    compress2(buf, &size, frame->data, hdr.raw_size, Z_BEST_SPEED);
+    hdr.size = size;
+
+    cpu_to_le32s(&hdr.type);
+    cpu_to_le32s(&hdr.nrects);
+    cpu_to_le32s(&hdr.width);
+    cpu_to_le32s(&hdr.height);
+    cpu_to_le64s(&hdr.timestamp);
+    cpu_to_le32s(&hdr.raw_size);
+    cpu_to_le32s(&hdr.size);
+    errno = EIO;
+    if (fwrite(&hdr, sizeof(hdr), 1, rec->f) == 1 &&
+        fwrite(buf, size, 1, rec->f) == 1) {
+        ret = sizeof(hdr) + size;
+    }
+
+    qemu_free(buf);
+    qemu_free(frame->data);
+    qemu_free(frame);
+    return ret;
+}
+
+#ifdef CONFIG_THREAD
+static void *fbrec_thread(void *opaque)
+{
+    FbRecorder *rec = opaque;
+    FbRecFrame *frame;
+    size_t raw_size, size;
+
+    qemu_mutex_lock(&rec->lock);
+    for (;;) {
+        while (QTAILQ_EMPTY(&rec->queue) && !rec->quit) {
+            qemu_cond_wait(&rec->cond, &rec->lock);
+        }
+        frame = QTAILQ_FIRST(&rec->queue);
+        if (!frame) {
+            break;
+        }
+        QTAILQ_REMOVE(&rec->queue, frame, next);
+        qemu_mutex_unlock(&rec->lock);
+
+        raw_size = frame->hdr.raw_size;
+        if (rec->write_error) {
+            /* the timer stops the recording, just drain the queue */
+            qemu_free(frame->data);
+            qemu_free(frame);
+            size = 0;
+        } else {
+            size = fbrec_write_frame(rec, frame);
+        }
+
+        qemu_mutex_lock(&rec->lock);
+        if (!size && !rec->write_error) {
+            rec->write_error = errno;
+        }
+        rec->queued -= raw_size;
+        rec->bytes += size;
+    }
+    qemu_mutex_unlock(&rec->lock);
+    return NULL;
+}
+#endif
+
+/* Hand the frame to the compression thread, or compress it right away */
+static void fbrec_queue(FbRecorder *rec, FbRecFrame *frame)
+{
+#ifdef CONFIG_THREAD
+    qemu_mutex_lock(&rec->lock);
+    if (rec->queued + frame->hdr.raw_size > FBREC_MAX_QUEUED) {
+        /* the disk cannot keep up; restart from a key frame later */
+        rec->dropped++;
+        rec->need_key = 1;
+        qemu_mutex_unlock(&rec->lock);
+        qemu_free(frame->data);
+        qemu_free(frame);
+        return;
+    }
+    rec->frames++;
+    rec->raw_bytes += frame->hdr.raw_size;
+    rec->queued += frame->hdr.raw_size;
+    QTAILQ_INSERT_TAIL(&rec->queue, frame, next);
+    qemu_cond_signal(&rec->cond);
+    qemu_mutex_unlock(&rec->lock);
+#else
+    size_t size;
+
+    if (rec->write_error) {
+        qemu_free(frame->data);
+        qemu_free(frame);
+        return;
+    }
+    rec->frames++;
+    rec->raw_bytes += frame->hdr.raw_size;
+    size = fbrec_write_frame(rec, frame);
+    if (!size) {
+        rec->write_error = errno;
+    }
+    rec->bytes += size;
+#endif
+}
+
+static void fbrec_capture(FbRecorder *rec)
+{
+    DisplaySurface *surface = rec->ds->surface;
+    FbRecFrame *frame;
+    uint8_t *p;
+    size_t size;
+    int nrects, n, i, ty, tx, end;
+
+    if (surface->width != rec->width || surface->height != rec->height) {
+        fbrec_setup(rec);
+    }
+
+    /* one rectangle for each run of dirty tiles in a row of tiles */
+    nrects = 0;
+    size = 0;
+    for (ty = 0; ty < rec->tiles_y; ty++) {
+        unsigned long base = ty * rec->tiles_x;
+        unsigned long limit = base + rec->tiles_x;
+
+        tx = find_next_bit(rec->dirty, limit, base);
+        while (tx < limit) {
+            FbRecRect *r = &rec->rects[nrects++];
+
+            end = find_next_zero_bit(rec->dirty, limit, tx);
+            r->x = (tx - base) * FBREC_TILE;
+            r->y = ty * FBREC_TILE;
+            r->w = MIN((end - base) * FBREC_TILE, rec->width) - r->x;
+            r->h = MIN(FBREC_TILE, rec->height - r->y);
+            size += sizeof(FbRecRect) + r->w * r->h * sizeof(uint32_t);
+            tx = find_next_bit(rec->dirty, limit, end);
+        }
+    }
+    if (!nrects) {
+        return;
+    }
+    bitmap_clear(rec->dirty, 0, rec->tiles_x * rec->tiles_y);
+
+    frame = qemu_mallocz(sizeof(*frame));
+    frame->hdr.width = rec->width;
+    frame->hdr.height = rec->height;
+    frame->hdr.timestamp = qemu_get_clock(rt_clock) - rec->start;
+
+    if (rec->need_key) {
+        FbRecRect all = { 0, 0, rec->width, rec->height };
+
+        for (i = 0; i < nrects; i++) {
+            fbrec_delta(rec, surface, &rec->rects[i], NULL);
+        }
+        frame->hdr.type = FBREC_FRAME_KEY;
+        frame->hdr.nrects = 1;
+        frame->hdr.raw_size = sizeof(FbRecRect) +
+                              rec->width * rec->height * sizeof(uint32_t);
+        frame->data = p = qemu_malloc(frame->hdr.raw_size);
+        fbrec_put_rect(p, &all);
+        p += sizeof(FbRecRect);
+        for (i = 0; i < rec->width * rec->height; i++) {
+            ((uint32_t *)p)[i] = cpu_to_le32(rec->shadow[i]);
+        }
+        rec->need_key = 0;
+    } else {
+        frame->hdr.type = FBREC_FRAME_DELTA;
+        frame->data = p = qemu_malloc(size);
+        for (i = n = 0; i < nrects; i++) {
+            FbRecRect *r = &rec->rects[i];
+
+            /* rectangles that were redrawn unchanged are left out */
+            if (fbrec_delta(rec, surface, r,
+                            (uint32_t *)(p + sizeof(FbRecRect)))) {
+                fbrec_put_rect(p, r);
+                p += sizeof(FbRecRect) + r->w * r->h * sizeof(uint32_t);
+                n++;
+            }
+        }
+        if (!n) {
+            qemu_free(frame->data);
+            qemu_free(frame);
+            return;
+        }
+        frame->hdr.nrects = n;
+        frame->hdr.raw_size = p - frame->data;
+    }
+    fbrec_queue(rec, frame);
+}
+
+static void fbrec_timer(void *opaque)
+{
+    FbRecorder *rec = opaque;
+    int err;
+
+    fbrec_lock(rec);
+    err = rec->write_error;
+    fbrec_unlock(rec);
+    if (err) {
+        error_report("screen recording to %s stopped: %s", rec->filename,
+                     strerror(err));
+        fbrec_stop();
+        return;
+    }
+
+    vga_hw_update();
+    fbrec_capture(rec);
+    qemu_mod_timer(rec->timer, qemu_get_clock(rt_clock) + FBREC_INTERVAL);
+}
+
+static void fbrec_update(DisplayState *ds, int x, int y, int w, int h)
+{
+    fbrec_mark(recorder, x, y, w, h);
+}
+
+static void fbrec_resize(DisplayState *ds)
+{
+    FbRecorder *rec = recorder;
+
+    if (ds_get_width(ds) != rec->width || ds_get_height(ds) != rec->height) {
+        fbrec_setup(rec);
+    } else {
+        fbrec_mark(rec, 0, 0, rec->width, rec->height);
+    }
+}
+
+int fbrec_active(void)
+{
+    return recorder != NULL;
+}
+
+/*
+ * Do not lose the frames still queued when QEMU quits.  exit() may be
+ * called from any thread, so only the writer is finished here: the
+ * display belongs to the I/O thread, and stdio flushes the file.
+ */
+static void fbrec_exit(void)
+{
+#ifdef CONFIG_THREAD
+    FbRecorder *rec = recorder;
+
+    if (!rec) {
+        return;
+    }
+    qemu_mutex_lock(&rec->lock);
+    rec->quit = 1;
+    qemu_cond_signal(&rec->cond);
+    qemu_mutex_unlock(&rec->lock);
+    qemu_thread_join(&rec->thread);
+#endif
+}
+
+int fbrec_start(DisplayState *ds, const char *filename)
+{
+    static int exit_registered;
+    FbRecorder *rec;
+    FbRecFileHeader hdr;
+    FILE *f;
+
+    f = fopen(filename, "wb");
+    if (!f) {
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FBREC_MAGIC, sizeof(hdr.magic));
+    hdr.version = cpu_to_le32(FBREC_VERSION);
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        fclose(f);
+        return -1;
+    }
+
+    rec = qemu_mallocz(sizeof(*rec));
+    rec->ds = ds;
+    rec->f = f;
+    rec->filename = qemu_strdup(filename);
+    rec->start = qemu_get_clock(rt_clock);
+    QTAILQ_INIT(&rec->queue);
+    fbrec_setup(rec);
+    recorder = rec;
+
+    rec->dcl.dpy_update = fbrec_update;
+    rec->dcl.dpy_resize = fbrec_resize;
+    rec->dcl.dpy_setdata = fbrec_resize;
+    register_displaychangelistener(ds, &rec->dcl);
+
+#ifdef CONFIG_THREAD
+    qemu_mutex_init(&rec->lock);
+    qemu_cond_init(&rec->cond);
+    qemu_thread_create(&rec->thread, fbrec_thread, rec);
+#endif
+    rec->timer = qemu_new_timer(rt_clock, fbrec_timer, rec);
+    qemu_mod_timer(rec->timer, qemu_get_clock(rt_clock));
+
+    if (!exit_registered) {
+        atexit(fbrec_exit);
+        exit_registered = 1;
+    }
+    return 0;
+}
+
+void fbrec_stop(void)
+{
+    FbRecorder *rec = recorder;
+
+    if (!rec) {
+        return;
+    }
+    qemu_del_timer(rec->timer);
+    qemu_free_timer(rec->timer);
+    fbrec_capture(rec);
+    unregister_displaychangelistener(rec->ds, &rec->dcl);
+
+#ifdef CONFIG_THREAD
+    qemu_mutex_lock(&rec->lock);
+    rec->quit = 1;
+    qemu_cond_signal(&rec->cond);
+    qemu_mutex_unlock(&rec->lock);
+    qemu_thread_join(&rec->thread);
+    qemu_cond_destroy(&rec->cond);
+    qemu_mutex_destroy(&rec->lock);
+#endif
+
+    if (fclose(rec->f) != 0 && !rec->write_error) {
+        error_report("screen recording to %s is incomplete: %s",
+                     rec->filename, strerror(errno));
+    }
+    qemu_free(rec->filename);
+    qemu_free(rec->shadow);
+    qemu_free(rec->row);
+    qemu_free(rec->dirty);
+    qemu_free(rec->rects);
+    qemu_free(rec);
+    recorder = NULL;
+}
+
+void do_info_screenrecord(Monitor *mon)
+{
+    FbRecorder *rec = recorder;
+
+    if (!rec) {
+        monitor_printf(mon, "Not recording\n");
+        return;
+    }
+    fbrec_lock(rec);
+    monitor_printf(mon, "Recording %dx%d to %s\n", rec->width, rec->height,
+                   rec->filename);
+    monitor_printf(mon, "frames %" PRIu64 " dropped %" PRIu64
+                   " raw %" PRIu64 " bytes, written %" PRIu64 " bytes\n",
+                   rec->frames, rec->dropped, rec->raw_bytes, rec->bytes);
+    fbrec_unlock(rec);
+}
@@ -0,0 +1,57 @@
+/*
+ * QEMU framebuffer recorder: file format
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_FBREC_H
+#define QEMU_FBREC_H
+
+#include <stdint.h>
+
+/*
+ * A recording starts with an FbRecFileHeader and continues with frames,
+ * each an FbRecFrameHeader followed by size bytes of zlib data.  Once
+ * inflated, the raw_size bytes of a frame are nrects times an
+ * FbRecRect followed by w * h pixels of that rectangle, row by row.
+ *
+ * Pixels are 32 bit 0x00RRGGBB values.  In a key frame they are the
+ * pixels themselves; in a delta frame they are XORed with the same
+ * pixels of the previous frame, so that unchanged parts of a rectangle
+ * are zero.  The first frame and every frame following a change of
+ * resolution or a dropped frame is a key frame covering the screen.
+ *
+ * All fields are little endian.
+ */
+
+#define FBREC_MAGIC         "QEMUFREC"
+#define FBREC_VERSION       1
+
+#define FBREC_FRAME_KEY     1
+#define FBREC_FRAME_DELTA   2
+
+typedef struct FbRecFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+} FbRecFileHeader;
+
+typedef struct FbRecFrameHeader {
+    uint32_t type;
+    uint32_t nrects;
+    uint32_t width;
+    uint32_t height;
+    uint64_t timestamp;     /* milliseconds since the recording started */
+    uint32_t raw_size;
+    uint32_t size;
+} FbRecFrameHeader;
+
+typedef struct FbRecRect {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+} FbRecRect;
+
+#endif /* QEMU_FBREC_H */
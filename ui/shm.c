@@ -0,0 +1,438 @@
+/*
+ * QEMU shared memory display driver
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "qemu-common.h"
+#ifdef CONFIG_LINUX
+#include <sys/syscall.h>
+#endif
+#include "qemu-char.h"
+#include "qemu_socket.h"
+#include "qemu-barrier.h"
+#include "console.h"
+#include "shm.h"
+
+/*
+ * The segment is sized once for the largest screen we export, so that
+ * viewers never have to remap it.  Pages that are never touched are not
+ * backed by memory.
+ */
+#define SHM_DISPLAY_MAX_WIDTH   2560
+#define SHM_DISPLAY_MAX_HEIGHT  2048
+
+#ifdef CONFIG_LINUX
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING       0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS             1033
+#define F_SEAL_SHRINK           0x0002
+#define F_SEAL_GROW             0x0004
+#endif
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE     0x0010
+#endif
+#endif
+
+typedef struct ShmDisplayClient {
+    int fd;
+    QLIST_ENTRY(ShmDisplayClient) next;
+} ShmDisplayClient;
+
+/*
+ * Viewers can write to the segment, so the geometry and the ring head we
+ * act on are kept here and only copied out to the header.
+ */
+typedef struct ShmDisplay {
+    DisplayState *ds;
+    int listen_fd;
+    int mem_fd;
+    int viewer_fd;
+    size_t mem_size;
+    ShmDisplayHeader *hdr;
+    uint8_t *fb;
+    size_t fb_size;
+    int width;          /* 0 while the screen does not fit */
+    int height;
+    int linesize;
+    uint32_t ring_head;
+    uint32_t notified;
+    QLIST_HEAD(, ShmDisplayClient) clients;
+} ShmDisplay;
+
+static ShmDisplay shm_display;
+
+/* Surfaces handed out by our allocator are drawn straight into the segment */
+static int shm_display_owns(DisplaySurface *surface)
+{
+    ShmDisplay *s = &shm_display;
+
+    return surface->data >= s->fb && surface->data < s->fb + s->fb_size;
+}
+
+static DisplaySurface *shm_create_displaysurface(int width, int height)
+{
+    ShmDisplay *s = &shm_display;
+    DisplaySurface *surface = qemu_mallocz(sizeof(DisplaySurface));
+
+    surface->width = width;
+    surface->height = height;
+    surface->linesize = width * 4;
+    surface->pf = qemu_default_pixelformat(32);
+    if ((size_t)surface->linesize * height <= s->fb_size) {
+        surface->data = s->fb;
+        surface->flags = QEMU_REALPIXELS_FLAG;
+    } else {
+        surface->data = qemu_mallocz(surface->linesize * height);
+        surface->flags = QEMU_ALLOCATED_FLAG;
+    }
+#ifdef HOST_WORDS_BIGENDIAN
+    surface->flags |= QEMU_BIG_ENDIAN_FLAG;
+#endif
+    return surface;
+}
+
+static void shm_free_displaysurface(DisplaySurface *surface)
+{
+    if (surface == NULL) {
+        return;
+    }
+    if (surface->flags & QEMU_ALLOCATED_FLAG) {
+        qemu_free(surface->data);
+    }
+    qemu_free(surface);
+}
+
+static DisplaySurface *shm_resize_displaysurface(DisplaySurface *surface,
+                                                 int width, int height)
+{
+    shm_free_displaysurface(surface);
+    return shm_create_displaysurface(width, height);
+}
+
+static void shm_display_post(ShmDisplay *s, int x, int y, int w, int h)
+{
+    ShmDisplayHeader *hdr = s->hdr;
+    ShmDisplayRect *rect = &hdr->ring[s->ring_head % SHM_DISPLAY_RING];
+
+    rect->x = x;
+    rect->y = y;
+    rect->w = w;
+    rect->h = h;
+    smp_wmb();
+    hdr->ring_head = ++s->ring_head;
+}
+
+/* Surfaces we did not allocate (guest memory, another allocator) are copied */
+static void shm_display_copy(ShmDisplay *s, DisplaySurface *surface,
+                             int x, int y, int w, int h)
+{
+    int bpp = surface->pf.bytes_per_pixel;
+    int linesize = s->linesize;
+    uint8_t *src = surface->data + y * surface->linesize + x * bpp;
+    uint8_t *dst = s->fb + y * linesize + x * bpp;
+
+    for (; h > 0; h--) {
+        memcpy(dst, src, w * bpp);
+        src += surface->linesize;
+        dst += linesize;
+    }
+}
+
+static void shm_update(DisplayState *ds, int x, int y, int w, int h)
+{
+    ShmDisplay *s = &shm_display;
+    DisplaySurface *surface = ds->surface;
+
+    if (!s->width) {
+        return;
+    }
+    x = MAX(x, 0);
+    y = MAX(y, 0);
+    w = MIN(x + w, s->width) - x;
+    h = MIN(y + h, s->height) - y;
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    if (!shm_display_owns(surface)) {
+        shm_display_copy(s, surface, x, y, w, h);
+    }
+    shm_display_post(s, x, y, w, h);
+}
+
+static void shm_resize(DisplayState *ds)
+{
+    ShmDisplay *s = &shm_display;
+    ShmDisplayHeader *hdr = s->hdr;
+    DisplaySurface *surface = ds->surface;
+    int linesize;
+
+    if (shm_display_owns(surface)) {
+        linesize = surface->linesize;
+    } else {
+        linesize = surface->width * surface->pf.bytes_per_pixel;
+    }
+
+    if ((size_t)linesize * surface->height > s->fb_size) {
+        s->width = 0;
+        s->height = 0;
+    } else {
+        s->width = surface->width;
+        s->height = surface->height;
+    }
+    s->linesize = linesize;
+
+    hdr->generation++;
+    smp_wmb();
+    hdr->width = s->width;
+    hdr->height = s->height;
+    hdr->linesize = s->linesize;
+    hdr->bits_per_pixel = surface->pf.bits_per_pixel;
+    hdr->depth = surface->pf.depth;
+    hdr->rmask = surface->pf.rmask;
+    hdr->gmask = surface->pf.gmask;
+    hdr->bmask = surface->pf.bmask;
+    hdr->flags = (surface->flags & QEMU_BIG_ENDIAN_FLAG) ?
+                 SHM_DISPLAY_BIG_ENDIAN : 0;
+    smp_wmb();
+    hdr->generation++;
+
+    shm_update(ds, 0, 0, surface->width, surface->height);
+}
+
+static void shm_display_notify(ShmDisplay *s)
+{
+    ShmDisplayClient *client;
+    uint32_t head = s->ring_head;
+
+    QLIST_FOREACH(client, &s->clients, next) {
+        /* a full socket means the viewer is busy; it reads the header */
+        send(client->fd, (void *)&head, sizeof(head), 0);
+    }
+    s->notified = head;
+}
+
+static void shm_refresh(DisplayState *ds)
+{
+    ShmDisplay *s = &shm_display;
+
+    vga_hw_update();
+    if (s->ring_head != s->notified) {
+        shm_display_notify(s);
+    }
+}
+
+static void shm_client_close(ShmDisplayClient *client)
+{
+    qemu_set_fd_handler2(client->fd, NULL, NULL, NULL, NULL);
+    closesocket(client->fd);
+    QLIST_REMOVE(client, next);
+    qemu_free(client);
+}
+
+/* Viewers do not talk to us; reading only notices that they went away */
+static void shm_client_read(void *opaque)
+{
+    ShmDisplayClient *client = opaque;
+    char buf[64];
+    int ret;
+
+    ret = recv(client->fd, buf, sizeof(buf), 0);
+    if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR)) {
+        shm_client_close(client);
+    }
+}
+
+static int shm_send_hello(ShmDisplay *s, int fd)
+{
+    ShmDisplayHello hello;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char control[CMSG_SPACE(sizeof(int))];
+
+    hello.magic = SHM_DISPLAY_MAGIC;
+    hello.version = SHM_DISPLAY_VERSION;
+    hello.size = s->mem_size;
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &s->viewer_fd, sizeof(int));
+
+    return sendmsg(fd, &msg, 0) == sizeof(hello) ? 0 : -1;
+}
+
+static void shm_listen_read(void *opaque)
+{
+    ShmDisplay *s = opaque;
+    ShmDisplayClient *client;
+    struct sockaddr_un addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd;
+
+    fd = qemu_accept(s->listen_fd, (struct sockaddr *)&addr, &addrlen);
+    if (fd < 0) {
+        return;
+    }
+    if (shm_send_hello(s, fd) < 0) {
+        closesocket(fd);
+        return;
+    }
+    socket_set_nonblock(fd);
+
+    client = qemu_mallocz(sizeof(*client));
+    client->fd = fd;
+    QLIST_INSERT_HEAD(&s->clients, client, next);
+    qemu_set_fd_handler2(fd, NULL, shm_client_read, NULL, client);
+}
+
+/*
+ * Creates the segment and sizes it.  *viewer_fd is what viewers get: a
+ * read-only descriptor of a segment whose mode no longer allows writing,
+ * so they can neither modify the pixels we serve elsewhere nor, for the
+ * sealed memfd, resize it and make our accesses fault.  Only the
+ * returned descriptor is writable, and it never leaves QEMU.
+ */
+static int shm_display_memfd(size_t size, int *viewer_fd)
+{
+    char path[] = "/dev/shm/qemu-display-XXXXXX";
+    int fd;
+
+#if defined(CONFIG_LINUX) && defined(__NR_memfd_create)
+    fd = syscall(__NR_memfd_create, "qemu-display", MFD_ALLOW_SEALING);
+    if (fd >= 0) {
+        char proc_path[32];
+
+        if (ftruncate(fd, size) < 0 || fchmod(fd, 0400) < 0 ||
+            fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+            close(fd);
+            return -1;
+        }
+        snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+        *viewer_fd = open(proc_path, O_RDONLY);
+        if (*viewer_fd < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+#endif
+    fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    *viewer_fd = open(path, O_RDONLY);
+    unlink(path);
+    if (*viewer_fd < 0 || fchmod(fd, 0400) < 0 || ftruncate(fd, size) < 0) {
+        if (*viewer_fd >= 0) {
+            close(*viewer_fd);
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void shm_display_close(ShmDisplay *s)
+{
+    close(s->viewer_fd);
+    close(s->mem_fd);
+}
+
+int shm_display_init(DisplayState *ds, const char *path)
+{
+    ShmDisplay *s = &shm_display;
+    DisplayChangeListener *dcl;
+    DisplayAllocator *da;
+    size_t hdr_size;
+    void *mem;
+
+    hdr_size = (sizeof(ShmDisplayHeader) + 4095) & ~(size_t)4095;
+    s->fb_size = SHM_DISPLAY_MAX_WIDTH * SHM_DISPLAY_MAX_HEIGHT * 4;
+    s->mem_size = hdr_size + s->fb_size;
+
+    s->mem_fd = shm_display_memfd(s->mem_size, &s->viewer_fd);
+    if (s->mem_fd < 0) {
+        fprintf(stderr, "shm display: cannot create segment: %s\n",
+                strerror(errno));
+        return -1;
+    }
+    mem = mmap(NULL, s->mem_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               s->mem_fd, 0);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "shm display: cannot map segment: %s\n",
+                strerror(errno));
+        shm_display_close(s);
+        return -1;
+    }
+#ifdef CONFIG_LINUX
+    /* Our mapping stays writable; write() and new writable mappings fail.
+       Older kernels reject the seal, the read-only viewer_fd remains. */
+    fcntl(s->mem_fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE);
+#endif
+
+    s->listen_fd = unix_listen(path, NULL, 0);
+    if (s->listen_fd < 0) {
+        munmap(mem, s->mem_size);
+        shm_display_close(s);
+        return -1;
+    }
+
+    s->ds = ds;
+    s->hdr = mem;
+    s->fb = (uint8_t *)mem + hdr_size;
+    s->hdr->magic = SHM_DISPLAY_MAGIC;
+    s->hdr->version = SHM_DISPLAY_VERSION;
+    s->hdr->data_offset = hdr_size;
+    s->hdr->data_size = s->fb_size;
+    QLIST_INIT(&s->clients);
+    qemu_set_fd_handler2(s->listen_fd, NULL, shm_listen_read, NULL, s);
+
+    /* if another display already owns the allocator we copy updates */
+    da = qemu_mallocz(sizeof(DisplayAllocator));
+    da->create_displaysurface = shm_create_displaysurface;
+    da->resize_displaysurface = shm_resize_displaysurface;
+    da->free_displaysurface = shm_free_displaysurface;
+    if (register_displayallocator(ds, da) != da) {
+        qemu_free(da);
+    }
+
+    dcl = qemu_mallocz(sizeof(DisplayChangeListener));
+    dcl->dpy_update = shm_update;
+    dcl->dpy_resize = shm_resize;
+    dcl->dpy_setdata = shm_resize;
+    dcl->dpy_refresh = shm_refresh;
+    register_displaychangelistener(ds, dcl);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * QEMU shared memory display: protocol definitions
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef QEMU_SHM_DISPLAY_H
+#define QEMU_SHM_DISPLAY_H
+
+#include <stdint.h>
+
+/*
+ * A viewer connects to the unix socket given with -shm-display and
+ * receives a ShmDisplayHello together with the file descriptor of the
+ * shared segment (SCM_RIGHTS).  The segment starts with a
+ * ShmDisplayHeader; the pixels live at data_offset, laid out as
+ * described by the header.  The descriptor is read-only and the segment
+ * cannot be resized, so a viewer must map it PROT_READ.
+ *
+ * The header's generation is odd while QEMU rewrites the geometry and
+ * even otherwise; a viewer rereads the geometry whenever it changes.
+ * Every update is appended to ring[ring_head % SHM_DISPLAY_RING] before
+ * ring_head is incremented.  A viewer that falls more than
+ * SHM_DISPLAY_RING entries behind must redraw the whole screen.
+ *
+ * After each refresh that produced updates, QEMU writes the current
+ * ring_head (4 bytes, host endian) to every connected viewer so that it
+ * can sleep in poll().  These wakeups are dropped when the viewer does
+ * not drain its socket; the header is always authoritative.
+ *
+ * All fields are host endian.  A width of zero means the guest screen
+ * does not fit in the segment and is not exported.
+ */
+
+#define SHM_DISPLAY_MAGIC       0x51454d55 /* "QEMU" */
+#define SHM_DISPLAY_VERSION     1
+#define SHM_DISPLAY_RING        256
+
+#define SHM_DISPLAY_BIG_ENDIAN  (1 << 0)
+
+typedef struct ShmDisplayHello {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+} ShmDisplayHello;
+
+typedef struct ShmDisplayRect {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+} ShmDisplayRect;
+
+typedef struct ShmDisplayHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t data_offset;
+    uint64_t data_size;
+
+    uint32_t generation;
+    uint32_t width;
+    uint32_t height;
+    uint32_t linesize;
+    uint32_t bits_per_pixel;
+    uint32_t depth;
+    uint32_t rmask, gmask, bmask;
+    uint32_t flags;
+
+    uint32_t ring_head;
+    uint32_t padding;
+    ShmDisplayRect ring[SHM_DISPLAY_RING];
+} ShmDisplayHeader;
+
+#endif /* QEMU_SHM_DISPLAY_H */
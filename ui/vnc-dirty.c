@@ -0,0 +1,331 @@
+/*
+ * QEMU VNC display driver: guest/server surface comparison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "qemu-common.h"
+#include "bitmap.h"
+#include "host-utils.h"
+#include "vnc-dirty.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+/* chunk_bytes is a multiple of 16 for 8, 16, 24 and 32 bpp surfaces */
+static inline int chunk_equal(const uint8_t *a, const uint8_t *b, int len)
+{
+    __m128i acc = _mm_set1_epi8(-1);
+    int i;
+
+    for (i = 0; i < len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        acc = _mm_and_si128(acc, _mm_cmpeq_epi8(va, vb));
+    }
+    return _mm_movemask_epi8(acc) == 0xffff;
+}
+
+static inline void chunk_copy(uint8_t *dst, const uint8_t *src, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i += 16) {
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_loadu_si128((const __m128i *)(src + i)));
+    }
+}
+
+#define CHUNK_ALIGN 16
+
+#else
+
+/* surface rows need not be word aligned (e.g. 4 bytes on sparc64) */
+static inline int chunk_equal(const uint8_t *a, const uint8_t *b, int len)
+{
+    return memcmp(a, b, len) == 0;
+}
+
+static inline void chunk_copy(uint8_t *dst, const uint8_t *src, int len)
+{
+    memcpy(dst, src, len);
+}
+
+#define CHUNK_ALIGN 1
+
+#endif
+
+int vnc_sync_row(uint8_t *server, const uint8_t *guest, int chunk_bytes,
+                 int nchunks, unsigned long *dirty, unsigned long *changed)
+{
+    int nwords = BITS_TO_LONGS(nchunks);
+    int w, n = 0;
+
+    if (chunk_bytes % CHUNK_ALIGN) {
+        return vnc_sync_row_ref(server, guest, chunk_bytes, nchunks,
+                                dirty, changed);
+    }
+
+    for (w = 0; w < nwords; w++) {
+        unsigned long bits = dirty[w];
+        unsigned long diff = 0;
+
+        if (!bits) {
+            continue;
+        }
+        if (w == nwords - 1 && nchunks % BITS_PER_LONG) {
+            bits &= BITMAP_LAST_WORD_MASK(nchunks);
+        }
+        dirty[w] &= ~bits;
+
+        while (bits) {
+            int bit = ctz64(bits);
+            int off = (w * BITS_PER_LONG + bit) * chunk_bytes;
+
+            bits &= bits - 1;
+            if (!chunk_equal(server + off, guest + off, chunk_bytes)) {
+                chunk_copy(server + off, guest + off, chunk_bytes);
+                diff |= 1UL << bit;
+                n++;
+            }
+        }
+        changed[w] |= diff;
+    }
+    return n;
+}
+
+int vnc_sync_row_ref(uint8_t *server, const uint8_t *guest, int chunk_bytes,
+                     int nchunks, unsigned long *dirty,
+                     unsigned long *changed)
+{
+    int i, n = 0;
+
+    for (i = 0; i < nchunks; i++) {
+        int off = i * chunk_bytes;
+
+        if (!test_and_clear_bit(i, dirty)) {
+            continue;
+        }
+        if (memcmp(server + off, guest + off, chunk_bytes) == 0) {
+            continue;
+        }
+        memcpy(server + off, guest + off, chunk_bytes);
+        set_bit(i, changed);
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Scroll detection.  Every row of the band is hashed on both surfaces and
+ * the changed rows of the guest surface vote for the vertical offset at
+ * which their contents sit on the server surface.  Horizontal moves are
+ * searched on one sample row and then checked on the others.  Either way
+ * a move is only accepted if it explains a long enough run of rows.
+ */
+
+#define SCROLL_HASH_SIZE    (2 * VNC_SCROLL_MAX_ROWS)
+#define SCROLL_MIN_VOTES    4
+#define SCROLL_MAX_TRIES    8
+#define SCROLL_ROW_EMPTY    -1
+#define SCROLL_ROW_REPEATED -2
+
+static uint32_t row_hash(const uint8_t *p, int len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    uint64_t v;
+    int i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&v, p + i, 8);
+        h = (h ^ v) * 0x100000001b3ULL;
+    }
+    for (; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h ^ (h >> 32);
+}
+
+static int scroll_lookup(const uint32_t *keys, const int16_t *rows,
+                         uint32_t key)
+{
+    int k = key & (SCROLL_HASH_SIZE - 1);
+
+    while (rows[k] != SCROLL_ROW_EMPTY && keys[k] != key) {
+        k = (k + 1) & (SCROLL_HASH_SIZE - 1);
+    }
+    return k;
+}
+
+/* Most popular vertical offset of the changed guest rows, or 0 */
+static int scroll_vote(const uint32_t *hs, const uint32_t *hg, int h)
+{
+    uint32_t keys[SCROLL_HASH_SIZE];
+    int16_t rows[SCROLL_HASH_SIZE];
+    int votes[2 * VNC_SCROLL_MAX_ROWS];
+    int i, j, k, best = 0, dy = 0;
+
+    memset(rows, -1, sizeof(rows));
+    memset(votes, 0, 2 * h * sizeof(votes[0]));
+
+    for (i = 0; i < h; i++) {
+        k = scroll_lookup(keys, rows, hs[i]);
+        if (rows[k] == SCROLL_ROW_EMPTY) {
+            keys[k] = hs[i];
+            rows[k] = i;
+        } else {
+            /* a row that occurs more than once cannot place a move */
+            rows[k] = SCROLL_ROW_REPEATED;
+        }
+    }
+    for (j = 0; j < h; j++) {
+        if (hg[j] == hs[j]) {
+            continue;
+        }
+        k = scroll_lookup(keys, rows, hg[j]);
+        if (rows[k] >= 0 && rows[k] != j) {
+            int d = j - rows[k];
+
+            if (++votes[d + h] > best) {
+                best = votes[d + h];
+                dy = d;
+            }
+        }
+    }
+    return best >= SCROLL_MIN_VOTES ? dy : 0;
+}
+
+/* Horizontal offset of the middle changed row, or 0 */
+static int scroll_find_dx(const uint8_t *server, const uint8_t *guest,
+                          int linesize, int bpp, int w, int h,
+                          const uint32_t *hs, const uint32_t *hg)
+{
+    const uint8_t *srow, *grow, *needle;
+    int j, dx, pos, tries = 0;
+
+    for (j = h / 2; j < h && hg[j] == hs[j]; j++) {
+        /* nothing */
+    }
+    if (j == h) {
+        return 0;
+    }
+    srow = server + j * linesize;
+    grow = guest + j * linesize;
+
+    /* look for a 16 pixel piece of the guest row on the server row */
+    pos = w / 2 - 8;
+    needle = grow + pos * bpp;
+    for (dx = 1; dx <= MIN(VNC_SCROLL_MAX_DX, w - VNC_SCROLL_MIN_WIDTH); dx++) {
+        int d;
+
+        for (d = dx; d >= -dx; d -= 2 * dx) {
+            int len = (w - dx) * bpp;
+
+            if (pos - d < 0 || pos - d + 16 > w ||
+                memcmp(needle, srow + (pos - d) * bpp, 16 * bpp)) {
+                continue;
+            }
+            if (d > 0 ? !memcmp(grow + d * bpp, srow, len)
+                      : !memcmp(grow, srow + dx * bpp, len)) {
+                return d;
+            }
+            if (++tries == SCROLL_MAX_TRIES) {
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Longest run of rows j for which the guest row equals server row j - dy
+ * moved right by dx pixels.  Rows that were equal on both surfaces to
+ * begin with do not count towards making the run worth a copy.
+ */
+static int scroll_run(const uint8_t *server, const uint8_t *guest,
+                      int linesize, int bpp, int w, int h, int dx, int dy,
+                      const uint32_t *hs, const uint32_t *hg, int *run_start)
+{
+    int dst_off = MAX(dx, 0) * bpp, src_off = MAX(-dx, 0) * bpp;
+    int len = (w - abs(dx)) * bpp;
+    int best = 0, start = 0, moved = 0, j;
+
+    for (j = 0; j <= h; j++) {
+        int i = j - dy;
+
+        if (j < h && i >= 0 && i < h && (dx || hg[j] == hs[i]) &&
+            !memcmp(guest + j * linesize + dst_off,
+                    server + i * linesize + src_off, len)) {
+            moved += hg[j] != hs[j];
+            continue;
+        }
+        if (j - start > best && moved >= VNC_SCROLL_MIN_ROWS / 2) {
+            best = j - start;
+            *run_start = start;
+        }
+        start = j + 1;
+        moved = 0;
+    }
+    return best >= VNC_SCROLL_MIN_ROWS ? best : 0;
+}
+
+int vnc_detect_scroll(const uint8_t *server, const uint8_t *guest,
+                      int linesize, int bpp, int x, int y, int w, int h,
+                      VncScroll *sc)
+{
+    uint32_t hs[VNC_SCROLL_MAX_ROWS], hg[VNC_SCROLL_MAX_ROWS];
+    int j, dx = 0, dy, n = 0, start = 0;
+
+    h = MIN(h, VNC_SCROLL_MAX_ROWS);
+    if (h < VNC_SCROLL_MIN_ROWS || w < VNC_SCROLL_MIN_WIDTH) {
+        return 0;
+    }
+    server += y * linesize + x * bpp;
+    guest += y * linesize + x * bpp;
+    for (j = 0; j < h; j++) {
+        hs[j] = row_hash(server + j * linesize, w * bpp);
+        hg[j] = row_hash(guest + j * linesize, w * bpp);
+    }
+
+    dy = scroll_vote(hs, hg, h);
+    if (dy) {
+        n = scroll_run(server, guest, linesize, bpp, w, h, 0, dy, hs, hg,
+                       &start);
+    }
+    if (!n) {
+        dy = 0;
+        dx = scroll_find_dx(server, guest, linesize, bpp, w, h, hs, hg);
+        if (!dx) {
+            return 0;
+        }
+        n = scroll_run(server, guest, linesize, bpp, w, h, dx, 0, hs, hg,
+                       &start);
+        if (!n) {
+            return 0;
+        }
+    }
+
+    sc->src_x = x + MAX(-dx, 0);
+    sc->dst_x = x + MAX(dx, 0);
+    sc->src_y = y + start - dy;
+    sc->dst_y = y + start;
+    sc->w = w - abs(dx);
+    sc->h = n;
+    return 1;
+}
@@ -0,0 +1,67 @@
+/*
+ * QEMU VNC display driver: guest/server surface comparison
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef VNC_DIRTY_H
+#define VNC_DIRTY_H
+
+#include <stdint.h>
+
+/*
+ * Compare one row of the guest surface with the server copy, in chunks
+ * of chunk_bytes (16 pixels).  Only the chunks flagged in dirty are
+ * looked at, and their flags are cleared.  Chunks whose contents differ
+ * are copied to the server row and flagged in changed, which the caller
+ * must have cleared.  Returns the number of changed chunks.
+ */
+int vnc_sync_row(uint8_t *server, const uint8_t *guest, int chunk_bytes,
+                 int nchunks, unsigned long *dirty, unsigned long *changed);
+
+/* The same, with plain memcmp/memcpy; reference for vnc-dirty-bench */
+int vnc_sync_row_ref(uint8_t *server, const uint8_t *guest, int chunk_bytes,
+                     int nchunks, unsigned long *dirty,
+                     unsigned long *changed);
+
+#define VNC_SCROLL_MAX_ROWS  2048
+#define VNC_SCROLL_MIN_ROWS  16
+#define VNC_SCROLL_MIN_WIDTH 32
+#define VNC_SCROLL_MAX_DX    256
+
+typedef struct VncScroll {
+    int src_x;
+    int src_y;
+    int dst_x;
+    int dst_y;
+    int w;
+    int h;
+} VncScroll;
+
+/*
+ * Look for a block of the band (x, y, w, h) of the guest surface that is
+ * a vertically or horizontally moved copy of the server surface.  On
+ * success the move is stored in sc and 1 is returned; the surfaces are
+ * not modified.
+ */
+int vnc_detect_scroll(const uint8_t *server, const uint8_t *guest,
+                      int linesize, int bpp, int x, int y, int w, int h,
+                      VncScroll *sc);
+
+#endif /* VNC_DIRTY_H */
@@ -22,46 +22,21 @@ static void CONCAT(send_hextile_tile_, NAME)(VncState *vs,
     pixel_t bg = 0;
     pixel_t fg = 0;
     int n_colors = 0;
-    int bg_count = 0;
-    int fg_count = 0;
+    int counts[2];
+    uint32_t colors[2];
     int flags = 0;
     uint8_t data[(vs->clientds.pf.bytes_per_pixel + 2) * 16 * 16];
     int n_data = 0;
     int n_subtiles = 0;
 
-    for (j = 0; j < h; j++) {
-	for (i = 0; i < w; i++) {
-	    switch (n_colors) {
-	    case 0:
-		bg = irow[i];
-		n_colors = 1;
-		break;
-	    case 1:
-		if (irow[i] != bg) {
-		    fg = irow[i];
-		    n_colors = 2;
-		}
-		break;
-	    case 2:
-		if (irow[i] != bg && irow[i] != fg) {
-		    n_colors = 3;
-		} else {
-		    if (irow[i] == bg)
-			bg_count++;
-		    else if (irow[i] == fg)
-			fg_count++;
-		}
-		break;
-	    default:
-		break;
-	    }
-	}
-	if (n_colors > 2)
-	    break;
-	irow += ds_get_linesize(vs->ds) / sizeof(pixel_t);
+    n_colors = palette_tile_colors(row, ds_get_linesize(vs->ds),
+                                   sizeof(pixel_t), w, h, colors, counts);
+    bg = colors[0];
+    if (n_colors > 1) {
+	fg = colors[1];
     }
 
-    if (n_colors > 1 && fg_count > bg_count) {
+    if (n_colors > 1 && counts[1] > counts[0]) {
 	pixel_t tmp = fg;
 	fg = bg;
 	bg = tmp;
@@ -104,14 +104,33 @@ static void ZRLE_ENCODE_TILE(VncState *vs, ZRLE_PIXEL *data, int w, int h,
     bool use_rle;
     bool use_palette;
 
-    int i;
+    int i, n;
+    uint32_t colors2[2];
 
     ZRLE_PIXEL *ptr = data;
     ZRLE_PIXEL *end = ptr + h * w;
+
+    /* Solid tile is a special case */
+
+    n = palette_tile_colors((uint8_t *)data, w * sizeof(ZRLE_PIXEL),
+                            sizeof(ZRLE_PIXEL), w, h, colors2, NULL);
+    if (n == 1) {
+        vnc_write_u8(vs, 1);
+        ZRLE_WRITE_PIXEL(vs, colors2[0]);
+        return;
+    }
+
     *end = ~*(end-1); /* one past the end is different so the while loop ends */
 
-    /* Real limit is 127 but we wan't a way to know if there is more than 127 */
-    palette_init(palette, 256, ZRLE_BPP);
+    /*
+     * Real limit is 127 but we wan't a way to know if there is more than 127;
+     * once the palette is full there is no point in looking up more colors.
+     */
+    palette_init(palette, 128, ZRLE_BPP);
+    if (n == 2) {
+        palette_put(palette, colors2[0]);
+        palette_put(palette, colors2[1]);
+    }
 
     while (ptr < end) {
         ZRLE_PIXEL pix = *ptr;
@@ -121,17 +140,9 @@ static void ZRLE_ENCODE_TILE(VncState *vs, ZRLE_PIXEL *data, int w, int h,
             while (*++ptr == pix) ;
             runs++;
         }
-        palette_put(palette, pix);
-    }
-
-    /* Solid tile is a special case */
-
-    if (palette_size(palette) == 1) {
-        bool found;
-
-        vnc_write_u8(vs, 1);
-        ZRLE_WRITE_PIXEL(vs, palette_color(palette, 0, &found));
-        return;
+        if (n > 2 && !palette_put(palette, pix)) {
+            n = 2;
+        }
     }
 
     zrle_choose_palette_rle(vs, w, h, palette, ZRLE_BPP_OUT,
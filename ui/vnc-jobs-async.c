@@ -36,23 +36,49 @@
  * - jobs queue lock: for each operation on the queue (push, pop, isEmpty?)
  * - VncDisplay global lock: mainly used for framebuffer updates to avoid
  *                      screen corruption if the framebuffer is updated
- *			while the worker is doing something.
+ *			while the workers are doing something.
  * - VncState::output lock: used to make sure the output buffer is not corrupted
  * 		   	 if two threads try to write on it at the same time
  *
- * While the VNC worker thread is working, the VncDisplay global lock is hold
- * to avoid screen corruptions (this does not block vnc_refresh() because it
- * uses trylock()) but the output lock is not hold because the thread work on
- * its own output buffer.
+ * While a VNC worker thread encodes a rectangle, it holds a shared reference
+ * on the VncDisplay lock, so several workers can encode for clients of the
+ * same display while vnc_refresh() is kept out.  A vnc_refresh() whose
+ * trylock failed holds off new rectangles until it has run.  The
+ * output lock is not held because each worker has its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * Scheduling:
+ *
+ * Jobs sit on a single FIFO queue that all workers take from.  Each
+ * client is handled by one worker only, picked round-robin when its first
+ * job is queued: the zlib streams of the tight, zlib and zrle encodings
+ * are per client, must see the rectangles in order, and check that they
+ * are used at the address they were set up at.  So the worker encodes in
+ * a copy of the client state that stays in place (VncWorker.vs).
+ * Different clients are encoded in parallel.
+ * Each client may have at most VNC_JOBS_PER_CLIENT jobs queued.  After
+ * that, vnc_update_client() leaves the dirty bits alone until the client
+ * has caught up, so a slow client does not fill the queue.
 */
 
+#define VNC_WORKERS_MAX     16
+#define VNC_WORKERS_DEFAULT 4
+#define VNC_JOBS_PER_CLIENT 2
+
+typedef struct VncWorker {
+    QemuThread thread;
+    Buffer buffer;
+    VncState vs;
+} VncWorker;
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
-    Buffer buffer;
+    VncWorker workers[VNC_WORKERS_MAX];
+    int nb_workers;
+    int next_worker;
+    int running;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
 };
@@ -60,8 +86,7 @@ struct VncJobQueue {
 typedef struct VncJobQueue VncJobQueue;
 
 /*
- * We use a single global queue, but most of the functions are
- * already reetrant, so we can easilly add more than one encoding thread
+ * We use a single global queue, shared by all the encoding threads
  */
 static VncJobQueue *queue;
 
@@ -80,6 +105,7 @@ VncJob *vnc_job_new(VncState *vs)
     VncJob *job = qemu_mallocz(sizeof(VncJob));
 
     job->vs = vs;
+    job->quality = vs->rate.quality;
     vnc_lock_queue(queue);
     QLIST_INIT(&job->rectangles);
     vnc_unlock_queue(queue);
@@ -101,28 +127,42 @@ int vnc_job_add_rect(VncJob *job, int x, int y, int w, int h)
     return 1;
 }
 
+static void vnc_job_free(VncJob *job)
+{
+    VncRectEntry *entry, *tmp;
+
+    QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
+        qemu_free(entry);
+    }
+    qemu_free(job);
+}
+
 void vnc_job_push(VncJob *job)
 {
     vnc_lock_queue(queue);
     if (queue->exit || QLIST_EMPTY(&job->rectangles)) {
-        qemu_free(job);
+        vnc_job_free(job);
     } else {
+        if (!job->vs->worker) {
+            job->vs->worker = queue->next_worker++ % queue->nb_workers + 1;
+        }
         QTAILQ_INSERT_TAIL(&queue->jobs, job, next);
         qemu_cond_broadcast(&queue->cond);
     }
     vnc_unlock_queue(queue);
 }
 
-static bool vnc_has_job_locked(VncState *vs)
+static int vnc_count_jobs_locked(VncState *vs)
 {
     VncJob *job;
+    int n = 0;
 
     QTAILQ_FOREACH(job, &queue->jobs, next) {
         if (job->vs == vs || !vs) {
-            return true;
+            n++;
         }
     }
-    return false;
+    return n;
 }
 
 bool vnc_has_job(VncState *vs)
@@ -130,19 +170,31 @@ bool vnc_has_job(VncState *vs)
     bool ret;
 
     vnc_lock_queue(queue);
-    ret = vnc_has_job_locked(vs);
+    ret = vnc_count_jobs_locked(vs) > 0;
+    vnc_unlock_queue(queue);
+    return ret;
+}
+
+bool vnc_jobs_full(VncState *vs)
+{
+    bool ret;
+
+    vnc_lock_queue(queue);
+    ret = vnc_count_jobs_locked(vs) >= VNC_JOBS_PER_CLIENT;
     vnc_unlock_queue(queue);
     return ret;
 }
 
+/* Jobs that a worker already started are left to finish */
 void vnc_jobs_clear(VncState *vs)
 {
     VncJob *job, *tmp;
 
     vnc_lock_queue(queue);
     QTAILQ_FOREACH_SAFE(job, &queue->jobs, next, tmp) {
-        if (job->vs == vs || !vs) {
+        if ((job->vs == vs || !vs) && !job->running) {
             QTAILQ_REMOVE(&queue->jobs, job, next);
+            vnc_job_free(job);
         }
     }
     vnc_unlock_queue(queue);
@@ -150,17 +202,38 @@ void vnc_jobs_clear(VncState *vs)
 
 void vnc_jobs_join(VncState *vs)
 {
+    /* the refresh cannot run while we wait, don't let it stall the job */
+    vnc_cancel_refresh(vs->vd);
     vnc_lock_queue(queue);
-    while (vnc_has_job_locked(vs)) {
+    while (vnc_count_jobs_locked(vs) > 0) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
     vnc_unlock_queue(queue);
 }
 
+/*
+ * The first queued job of a client this worker encodes for.  Jobs of one
+ * client are queued in order, so this is always the oldest job of its
+ * client.
+ */
+static VncJob *vnc_next_job_locked(VncJobQueue *queue, VncWorker *worker)
+{
+    int id = worker - queue->workers + 1;
+    VncJob *job;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        if (job->vs->worker == id) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
 /*
  * Copy data for local use
  */
-static void vnc_async_encoding_start(VncState *orig, VncState *local)
+static void vnc_async_encoding_start(VncWorker *worker,
+                                     VncState *orig, VncState *local)
 {
     local->vnc_encoding = orig->vnc_encoding;
     local->features = orig->features;
@@ -173,13 +246,14 @@ static void vnc_async_encoding_start(VncState *orig, VncState *local)
     local->zlib = orig->zlib;
     local->hextile = orig->hextile;
     local->zrle = orig->zrle;
-    local->output =  queue->buffer;
+    local->output =  worker->buffer;
     local->csock = -1; /* Don't do any network work on this thread */
 
     buffer_reset(&local->output);
 }
 
-static void vnc_async_encoding_end(VncState *orig, VncState *local)
+static void vnc_async_encoding_end(VncWorker *worker,
+                                   VncState *orig, VncState *local)
 {
     orig->tight = local->tight;
     orig->zlib = local->zlib;
@@ -187,29 +261,34 @@ static void vnc_async_encoding_end(VncState *orig, VncState *local)
     orig->zrle = local->zrle;
     orig->lossy_rect = local->lossy_rect;
 
-    queue->buffer = local->output;
+    worker->buffer = local->output;
 }
 
-static int vnc_worker_thread_loop(VncJobQueue *queue)
+static int vnc_worker_thread_loop(VncJobQueue *queue, VncWorker *worker)
 {
     VncJob *job;
     VncRectEntry *entry, *tmp;
-    VncState vs;
+    VncState *vs = &worker->vs;
     int n_rectangles;
     int saved_offset;
     bool flush;
 
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    while (!queue->exit && !(job = vnc_next_job_locked(queue, worker))) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
-    /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
-    vnc_unlock_queue(queue);
-
     if (queue->exit) {
+        vnc_unlock_queue(queue);
         return -1;
     }
+    job->running = true;
+    vnc_unlock_queue(queue);
+
+    /* Make a local copy of vs and switch output buffers */
+    vnc_async_encoding_start(worker, job->vs, vs);
+    /* the quality picked when the update was queued, not what the
+     * previous job of this client copied back */
+    vs->tight.quality = job->quality;
 
     vnc_lock_output(job->vs);
     if (job->vs->csock == -1 || job->vs->abort == true) {
@@ -217,22 +296,17 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     }
     vnc_unlock_output(job->vs);
 
-    /* Make a local copy of vs and switch output buffers */
-    vnc_async_encoding_start(job->vs, &vs);
-
     /* Start sending rectangles */
     n_rectangles = 0;
-    vnc_write_u8(&vs, VNC_MSG_SERVER_FRAMEBUFFER_UPDATE);
-    vnc_write_u8(&vs, 0);
-    saved_offset = vs.output.offset;
-    vnc_write_u16(&vs, 0);
+    vnc_write_u8(vs, VNC_MSG_SERVER_FRAMEBUFFER_UPDATE);
+    vnc_write_u8(vs, 0);
+    saved_offset = vs->output.offset;
+    vnc_write_u16(vs, 0);
 
-    vnc_lock_display(job->vs->vd);
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
         int n;
 
         if (job->vs->csock == -1) {
-            vnc_unlock_display(job->vs->vd);
             /* output mutex must be locked before going to
              * disconnected:
              */
@@ -240,19 +314,21 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
             goto disconnected;
         }
 
-        n = vnc_send_framebuffer_update(&vs, entry->rect.x, entry->rect.y,
+        vnc_lock_display_shared(job->vs->vd);
+        n = vnc_send_framebuffer_update(vs, entry->rect.x, entry->rect.y,
                                         entry->rect.w, entry->rect.h);
+        vnc_unlock_display_shared(job->vs->vd);
 
         if (n >= 0) {
             n_rectangles += n;
         }
+        QLIST_REMOVE(entry, next);
         qemu_free(entry);
     }
-    vnc_unlock_display(job->vs->vd);
 
     /* Put n_rectangles at the beginning of the message */
-    vs.output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
-    vs.output.buffer[saved_offset + 1] = n_rectangles & 0xFF;
+    vs->output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
+    vs->output.buffer[saved_offset + 1] = n_rectangles & 0xFF;
 
     /* Switch back buffers */
     vnc_lock_output(job->vs);
@@ -260,11 +336,11 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
         goto disconnected;
     }
 
-    vnc_write(job->vs, vs.output.buffer, vs.output.offset);
+    vnc_write(job->vs, vs->output.buffer, vs->output.offset);
 
 disconnected:
     /* Copy persistent encoding data */
-    vnc_async_encoding_end(job->vs, &vs);
+    vnc_async_encoding_end(worker, job->vs, vs);
     flush = (job->vs->csock != -1 && job->vs->abort != true);
     vnc_unlock_output(job->vs);
 
@@ -276,7 +352,7 @@ disconnected:
     QTAILQ_REMOVE(&queue->jobs, job, next);
     vnc_unlock_queue(queue);
     qemu_cond_broadcast(&queue->cond);
-    qemu_free(job);
+    vnc_job_free(job);
     return 0;
 }
 
@@ -292,34 +368,64 @@ static VncJobQueue *vnc_queue_init(void)
 
 static void vnc_queue_clear(VncJobQueue *q)
 {
-    qemu_cond_destroy(&queue->cond);
-    qemu_mutex_destroy(&queue->mutex);
-    buffer_free(&queue->buffer);
+    int i;
+
+    qemu_cond_destroy(&q->cond);
+    qemu_mutex_destroy(&q->mutex);
+    for (i = 0; i < q->nb_workers; i++) {
+        buffer_free(&q->workers[i].buffer);
+    }
     qemu_free(q);
-    queue = NULL; /* Unset global queue */
 }
 
 static void *vnc_worker_thread(void *arg)
 {
-    VncJobQueue *queue = arg;
+    VncWorker *worker = arg;
+    VncJobQueue *q = queue;
+    bool last;
 
-    qemu_thread_self(&queue->thread);
+    qemu_thread_self(&worker->thread);
 
-    while (!vnc_worker_thread_loop(queue)) ;
-    vnc_queue_clear(queue);
+    while (!vnc_worker_thread_loop(q, worker)) ;
+
+    /* the last worker out frees the queue */
+    vnc_lock_queue(q);
+    last = --q->running == 0;
+    vnc_unlock_queue(q);
+    if (last) {
+        queue = NULL; /* Unset global queue */
+        vnc_queue_clear(q);
+    }
     return NULL;
 }
 
+/* Grow the pool to n encoding threads; it never shrinks */
+void vnc_start_worker_threads(int n)
+{
+    VncWorker *worker;
+
+    if (!queue) {
+        queue = vnc_queue_init(); /* Set global queue */
+    }
+
+    n = MIN(n, VNC_WORKERS_MAX);
+    vnc_lock_queue(queue);
+    while (queue->nb_workers < n && !queue->exit) {
+        worker = &queue->workers[queue->nb_workers++];
+        queue->running++;
+        qemu_thread_create(&worker->thread, vnc_worker_thread, worker);
+    }
+    vnc_unlock_queue(queue);
+}
+
 void vnc_start_worker_thread(void)
 {
-    VncJobQueue *q;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
 
     if (vnc_worker_thread_running())
         return ;
 
-    q = vnc_queue_init();
-    qemu_thread_create(&q->thread, vnc_worker_thread, q);
-    queue = q; /* Set global queue */
+    vnc_start_worker_threads(MAX(1, MIN(ncpus, VNC_WORKERS_DEFAULT)));
 }
 
 bool vnc_worker_thread_running(void)
@@ -332,10 +438,10 @@ void vnc_stop_worker_thread(void)
     if (!vnc_worker_thread_running())
         return ;
 
-    /* Remove all jobs and wake up the thread */
+    /* Remove all jobs and wake up the threads */
+    vnc_jobs_clear(NULL);
     vnc_lock_queue(queue);
     queue->exit = true;
     vnc_unlock_queue(queue);
-    vnc_jobs_clear(NULL);
     qemu_cond_broadcast(&queue->cond);
 }
@@ -39,7 +39,9 @@ void vnc_jobs_join(VncState *vs)
 VncJob *vnc_job_new(VncState *vs)
 {
     vs->job.vs = vs;
+    vs->job.quality = vs->rate.quality;
     vs->job.rectangles = 0;
+    vs->tight.quality = vs->job.quality;
 
     vnc_write_u8(vs, VNC_MSG_SERVER_FRAMEBUFFER_UPDATE);
     vnc_write_u8(vs, 0);
@@ -71,3 +73,8 @@ bool vnc_has_job(VncState *vs)
 {
     return false;
 }
+
+bool vnc_jobs_full(VncState *vs)
+{
+    return false;
+}
@@ -35,37 +35,86 @@ VncJob *vnc_job_new(VncState *vs);
 int vnc_job_add_rect(VncJob *job, int x, int y, int w, int h);
 void vnc_job_push(VncJob *job);
 bool vnc_has_job(VncState *vs);
+bool vnc_jobs_full(VncState *vs);
 void vnc_jobs_clear(VncState *vs);
 void vnc_jobs_join(VncState *vs);
 
 #ifdef CONFIG_VNC_THREAD
 
 void vnc_start_worker_thread(void);
+void vnc_start_worker_threads(int n);
 bool vnc_worker_thread_running(void);
 void vnc_stop_worker_thread(void);
 
 #endif /* CONFIG_VNC_THREAD */
 
 /* Locks */
+
+/* vnc_refresh() copies the guest surface into the server surface with
+ * the display locked exclusively; encoding threads only read the server
+ * surface and share it, one rectangle at a time.  The refresh runs in the
+ * I/O thread and must not block behind an encoder: when its trylock fails
+ * it marks itself pending, which keeps encoders from starting another
+ * rectangle, and retries shortly.
+ */
 static inline int vnc_trylock_display(VncDisplay *vd)
 {
 #ifdef CONFIG_VNC_THREAD
-    return qemu_mutex_trylock(&vd->mutex);
+    qemu_mutex_lock(&vd->mutex);
+    if (vd->encoders) {
+        vd->refresh_pending = 1;
+        qemu_mutex_unlock(&vd->mutex);
+        return -1;
+    }
+    return 0;
 #else
     return 0;
 #endif
 }
 
-static inline void vnc_lock_display(VncDisplay *vd)
+static inline void vnc_unlock_display(VncDisplay *vd)
+{
+#ifdef CONFIG_VNC_THREAD
+    if (vd->refresh_pending) {
+        vd->refresh_pending = 0;
+        qemu_cond_broadcast(&vd->encoders_cond);
+    }
+    qemu_mutex_unlock(&vd->mutex);
+#endif
+}
+
+/* Lets held-off encoders go on without the refresh.  Called when the
+ * I/O thread is about to wait for them, or drops the refresh timer.
+ */
+static inline void vnc_cancel_refresh(VncDisplay *vd)
 {
 #ifdef CONFIG_VNC_THREAD
     qemu_mutex_lock(&vd->mutex);
+    if (vd->refresh_pending) {
+        vd->refresh_pending = 0;
+        qemu_cond_broadcast(&vd->encoders_cond);
+    }
+    qemu_mutex_unlock(&vd->mutex);
 #endif
 }
 
-static inline void vnc_unlock_display(VncDisplay *vd)
+static inline void vnc_lock_display_shared(VncDisplay *vd)
 {
 #ifdef CONFIG_VNC_THREAD
+    qemu_mutex_lock(&vd->mutex);
+    while (vd->refresh_pending) {
+        qemu_cond_wait(&vd->encoders_cond, &vd->mutex);
+    }
+    vd->encoders++;
+    qemu_mutex_unlock(&vd->mutex);
+#endif
+}
+
+static inline void vnc_unlock_display_shared(VncDisplay *vd)
+{
+#ifdef CONFIG_VNC_THREAD
+    qemu_mutex_lock(&vd->mutex);
+    vd->encoders--;
     qemu_mutex_unlock(&vd->mutex);
 #endif
 }
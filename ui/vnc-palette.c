@@ -27,28 +27,29 @@
  */
 
 #include "vnc-palette.h"
+#include "host-utils.h"
 
-static VncPaletteEntry *palette_find(const VncPalette *palette,
-                                     uint32_t color, unsigned int hash)
-{
-    VncPaletteEntry *entry;
-
-    QLIST_FOREACH(entry, &palette->table[hash], next) {
-        if (entry->color == color) {
-            return entry;
-        }
-    }
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-    return NULL;
+/* Fibonacci hashing: the top bits of the product mix all color bits */
+static inline unsigned int palette_hash(uint32_t color)
+{
+    return (color * 2654435761U) >> (32 - 9);
 }
 
-static unsigned int palette_hash(uint32_t rgb, int bpp)
+/* Returns the slot holding color, or the free slot where it belongs */
+static inline unsigned int palette_slot(const VncPalette *palette,
+                                        uint32_t color)
 {
-    if (bpp == 16) {
-        return ((unsigned int)(((rgb >> 8) + rgb) & 0xFF));
-    } else {
-        return ((unsigned int)(((rgb >> 16) + (rgb >> 8)) & 0xFF));
+    unsigned int slot = palette_hash(color);
+
+    while (palette->table[slot] &&
+           palette->colors[palette->table[slot] - 1] != color) {
+        slot = (slot + 1) % VNC_PALETTE_HASH_SIZE;
     }
+    return slot;
 }
 
 VncPalette *palette_new(size_t max, int bpp)
@@ -62,50 +63,35 @@ VncPalette *palette_new(size_t max, int bpp)
 
 void palette_init(VncPalette *palette, size_t max, int bpp)
 {
-    memset(palette, 0, sizeof (*palette));
+    /* colors[] is only read below size and need not be cleared */
+    memset(palette->table, 0, sizeof(palette->table));
+    palette->size = 0;
     palette->max = max;
     palette->bpp = bpp;
 }
 
 void palette_destroy(VncPalette *palette)
 {
-    if (palette == NULL) {
-        qemu_free(palette);
-    }
+    qemu_free(palette);
 }
 
 int palette_put(VncPalette *palette, uint32_t color)
 {
-    unsigned int hash;
-    unsigned int idx = palette->size;
-    VncPaletteEntry *entry;
-
-    hash = palette_hash(color, palette->bpp) % VNC_PALETTE_HASH_SIZE;
-    entry = palette_find(palette, color, hash);
+    unsigned int slot = palette_slot(palette, color);
 
-    if (!entry && palette->size >= palette->max) {
-        return 0;
-    }
-    if (!entry) {
-        VncPaletteEntry *entry;
-
-        entry = &palette->pool[palette->size];
-        entry->color = color;
-        entry->idx = idx;
-        QLIST_INSERT_HEAD(&palette->table[hash], entry, next);
-        palette->size++;
+    if (!palette->table[slot]) {
+        if (palette->size >= palette->max) {
+            return 0;
+        }
+        palette->colors[palette->size] = color;
+        palette->table[slot] = ++palette->size;
     }
     return palette->size;
 }
 
 int palette_idx(const VncPalette *palette, uint32_t color)
 {
-    VncPaletteEntry *entry;
-    unsigned int hash;
-
-    hash = palette_hash(color, palette->bpp) % VNC_PALETTE_HASH_SIZE;
-    entry = palette_find(palette, color, hash);
-    return (entry == NULL ? -1 : entry->idx);
+    return palette->table[palette_slot(palette, color)] - 1;
 }
 
 size_t palette_size(const VncPalette *palette)
@@ -118,43 +104,125 @@ void palette_iter(const VncPalette *palette,
                   void *opaque)
 {
     int i;
-    VncPaletteEntry *entry;
 
-    for (i = 0; i < VNC_PALETTE_HASH_SIZE; i++) {
-        QLIST_FOREACH(entry, &palette->table[i], next) {
-            iter(entry->idx, entry->color, opaque);
-        }
+    for (i = 0; i < palette->size; i++) {
+        iter(i, palette->colors[i], opaque);
     }
 }
 
 uint32_t palette_color(const VncPalette *palette, int idx, bool *found)
 {
-    int i;
-    VncPaletteEntry *entry;
-
-    for (i = 0; i < VNC_PALETTE_HASH_SIZE; i++) {
-        QLIST_FOREACH(entry, &palette->table[i], next) {
-            if (entry->idx == idx) {
-                *found = true;
-                return entry->color;
-            }
-        }
+    if (idx >= 0 && idx < palette->size) {
+        *found = true;
+        return palette->colors[idx];
     }
-
     *found = false;
     return -1;
 }
 
-static void palette_fill_cb(int idx, uint32_t color, void *opaque)
+size_t palette_fill(const VncPalette *palette,
+                    uint32_t colors[VNC_PALETTE_MAX_SIZE])
 {
-    uint32_t *colors = opaque;
-
-    colors[idx] = color;
+    memcpy(colors, palette->colors, palette->size * sizeof(uint32_t));
+    return palette->size;
 }
 
-size_t palette_fill(const VncPalette *palette,
-                    uint32_t colors[VNC_PALETTE_MAX_SIZE])
+#define TILE_COLORS_ROW(type)                                           \
+    do {                                                                \
+        const type *p = (const type *)row;                              \
+        for (; i < w; i++) {                                            \
+            if (p[i] == (type)c0) {                                     \
+                n0++;                                                   \
+            } else if (n == 1) {                                        \
+                c1 = p[i];                                              \
+                n = 2;                                                  \
+                n1++;                                                   \
+            } else if (p[i] == (type)c1) {                              \
+                n1++;                                                   \
+            } else {                                                    \
+                n = 3;                                                  \
+                goto out;                                               \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
+int palette_tile_colors(const uint8_t *data, int linesize, int bytes_pp,
+                        int w, int h, uint32_t colors[2], int counts[2])
 {
-    palette_iter(palette, palette_fill_cb, colors);
-    return palette_size(palette);
+    uint32_t c0, c1 = 0;
+    int n = 1, n0 = 0, n1 = 0, i, j;
+#ifdef __SSE2__
+    __m128i v0 = _mm_setzero_si128(), v1 = _mm_setzero_si128();
+#endif
+
+    switch (bytes_pp) {
+    case 1:
+        c0 = *data;
+        break;
+    case 2:
+        c0 = *(const uint16_t *)data;
+        break;
+    default:
+        c0 = *(const uint32_t *)data;
+#ifdef __SSE2__
+        v0 = _mm_set1_epi32(c0);
+#endif
+        break;
+    }
+    colors[0] = c1 = c0;
+
+    for (j = 0; j < h; j++) {
+        const uint8_t *row = data + j * linesize;
+
+        i = 0;
+        switch (bytes_pp) {
+        case 1:
+            TILE_COLORS_ROW(uint8_t);
+            break;
+        case 2:
+            TILE_COLORS_ROW(uint16_t);
+            break;
+        default:
+#ifdef __SSE2__
+            /* four pixels at a time against the one or two known colors */
+            for (; i + 4 <= w; i += 4) {
+                __m128i px = _mm_loadu_si128((const __m128i *)row + i / 4);
+                int m0, m1;
+
+                m0 = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(px, v0)));
+                if (m0 == 0xf) {
+                    n0 += 4;
+                    continue;
+                }
+                n0 += ctpop32(m0);
+                if (n == 1) {
+                    c1 = ((const uint32_t *)row)[i + ctz32(~m0)];
+                    v1 = _mm_set1_epi32(c1);
+                    n = 2;
+                }
+                m1 = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(px, v1)));
+                if ((m0 | m1) != 0xf) {
+                    n = 3;
+                    goto out;
+                }
+                n1 += ctpop32(m1);
+            }
+#endif
+            TILE_COLORS_ROW(uint32_t);
+#ifdef __SSE2__
+            if (n == 2) {
+                v1 = _mm_set1_epi32(c1);
+            }
+#endif
+            break;
+        }
+    }
+
+out:
+    colors[1] = c1;
+    if (counts) {
+        counts[0] = n0;
+        counts[1] = n1;
+    }
+    return n;
 }
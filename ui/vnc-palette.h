@@ -33,21 +33,21 @@
 #include "qemu-queue.h"
 #include <stdint.h>
 
-#define VNC_PALETTE_HASH_SIZE 256
+#define VNC_PALETTE_HASH_SIZE 512
 #define VNC_PALETTE_MAX_SIZE  256
 
-typedef struct VncPaletteEntry {
-    int idx;
-    uint32_t color;
-    QLIST_ENTRY(VncPaletteEntry) next;
-} VncPaletteEntry;
-
+/*
+ * Colors are kept in insertion order, so that a color's index is its
+ * position in colors[].  The hash table is open addressed and holds the
+ * index plus one, 0 marking a free slot; with at most half of the slots
+ * used, lookups rarely probe more than one or two of them.
+ */
 typedef struct VncPalette {
-    VncPaletteEntry pool[VNC_PALETTE_MAX_SIZE];
+    uint32_t colors[VNC_PALETTE_MAX_SIZE];
     size_t size;
     size_t max;
     int bpp;
-    QLIST_HEAD(,VncPaletteEntry) table[VNC_PALETTE_HASH_SIZE];
+    uint16_t table[VNC_PALETTE_HASH_SIZE];
 } VncPalette;
 
 VncPalette *palette_new(size_t max, int bpp);
@@ -65,4 +65,15 @@ uint32_t palette_color(const VncPalette *palette, int idx, bool *found);
 size_t palette_fill(const VncPalette *palette,
                     uint32_t colors[VNC_PALETTE_MAX_SIZE]);
 
+/*
+ * Look at the colors of a w x h tile of bytes_pp (1, 2 or 4) byte pixels.
+ * Returns 1 for a solid tile, 2 for a tile of two colors and 3 for more.
+ * colors[0] is set to the first pixel and, unless the tile is solid,
+ * colors[1] to the first other color.  If counts is not NULL it receives
+ * the number of pixels of both colors seen before the scan stopped, which
+ * is all of them unless a third color was found.
+ */
+int palette_tile_colors(const uint8_t *data, int linesize, int bytes_pp,
+                        int w, int h, uint32_t colors[2], int counts[2]);
+
 #endif /* VNC_PALETTE_H */
@@ -26,6 +26,7 @@
 
 #include "vnc.h"
 #include "vnc-jobs.h"
+#include "vnc-dirty.h"
 #include "sysemu.h"
 #include "qemu_socket.h"
 #include "qemu-timer.h"
@@ -38,6 +39,11 @@
 static const struct timeval VNC_REFRESH_STATS = { 0, 500000 };
 static const struct timeval VNC_REFRESH_LOSSY = { 2, 0 };
 
+/* JPEG quality control, see vnc_rate_update() */
+#define VNC_RATE_WINDOW 1000 /* ms */
+#define VNC_RATE_RAISE  3    /* clean windows before raising the quality */
+#define VNC_RATE_HEADROOM 0.75 /* share of the capacity a raise may start at */
+
 #include "vnc_keysym.h"
 #include "d3des.h"
 
@@ -359,6 +365,7 @@ void do_info_vnc(Monitor *mon, QObject **ret_data)
 
 static int vnc_update_client(VncState *vs, int has_dirty);
 static int vnc_update_client_sync(VncState *vs, int has_dirty);
+static int vnc_rate_update(VncState *vs);
 static void vnc_disconnect_start(VncState *vs);
 static void vnc_disconnect_finish(VncState *vs);
 static void vnc_init_timer(VncDisplay *vd);
@@ -835,10 +842,19 @@ static int vnc_update_client(VncState *vs, int has_dirty)
         int width, height;
         int n = 0;
 
+        has_dirty += vnc_rate_update(vs);
 
-        if (vs->output.offset && !vs->audio_cap && !vs->force_update)
+        if (vs->output.offset && !vs->audio_cap && !vs->force_update) {
             /* kernel send buffers are full -> drop frames to throttle */
+            vs->rate.stalls += !!has_dirty;
+            return 0;
+        }
+
+        if (vnc_jobs_full(vs)) {
+            /* the encoders are behind -> keep the dirty bits for later */
+            vs->rate.stalls += !!has_dirty;
             return 0;
+        }
 
         if (!has_dirty && !vs->audio_cap && !vs->force_update)
             return 0;
@@ -882,6 +898,7 @@ static int vnc_update_client(VncState *vs, int has_dirty)
 
         vnc_job_push(job);
         vs->force_update = 0;
+        vs->rate.updates += n > 0;
         return n;
     }
 
@@ -1121,6 +1138,7 @@ static long vnc_client_write_plain(VncState *vs)
 
     memmove(vs->output.buffer, vs->output.buffer + ret, (vs->output.offset - ret));
     vs->output.offset -= ret;
+    vs->rate.bytes += ret;
 
     if (vs->output.offset == 0) {
         qemu_set_fd_handler2(vs->csock, NULL, vnc_client_read, NULL, vs);
@@ -1693,6 +1711,7 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
     vs->vnc_encoding = 0;
     vs->tight.compression = 9;
     vs->tight.quality = -1; /* Lossless by default */
+    vs->rate.quality_req = -1;
     vs->absolute = -1;
 
     /*
@@ -1757,6 +1776,7 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
         case VNC_ENCODING_QUALITYLEVEL0 ... VNC_ENCODING_QUALITYLEVEL0 + 9:
             if (vs->vd->lossy) {
                 vs->tight.quality = (enc & 0x0F);
+                vs->rate.quality_req = vs->tight.quality;
             }
             break;
         default:
@@ -1764,6 +1784,9 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
             break;
         }
     }
+    /* start from the client's choice, vnc_rate_update() moves it */
+    vs->rate.quality = vs->rate.quality_req;
+    vs->rate.clean_windows = 0;
     vnc_desktop_resize(vs);
     check_pointer_type_change(&vs->mouse_mode_notifier);
 }
@@ -2256,36 +2279,154 @@ void vnc_sent_lossy_rect(VncState *vs, int x, int y, int w, int h)
     }
 }
 
-static int vnc_refresh_lossy_rect(VncDisplay *vd, int x, int y)
+/* Mark a lossy stat rect of the client dirty so it is sent again */
+static int vnc_refresh_client_lossy_rect(VncState *vs, int x, int y)
 {
-    VncState *vs;
     int sty = y / VNC_STAT_RECT;
     int stx = x / VNC_STAT_RECT;
-    int has_dirty = 0;
+    int j;
 
-    y = y / VNC_STAT_RECT * VNC_STAT_RECT;
-    x = x / VNC_STAT_RECT * VNC_STAT_RECT;
+    if (!vs->lossy_rect[sty][stx]) {
+        return 0;
+    }
 
-    QTAILQ_FOREACH(vs, &vd->clients, next) {
-        int j;
+    y = sty * VNC_STAT_RECT;
+    x = stx * VNC_STAT_RECT;
+
+    vs->lossy_rect[sty][stx] = 0;
+    for (j = 0; j < VNC_STAT_RECT; ++j) {
+        bitmap_set(vs->dirty[y + j], x / 16, VNC_STAT_RECT / 16);
+    }
+    return 1;
+}
 
+static int vnc_refresh_lossy_rect(VncDisplay *vd, int x, int y)
+{
+    VncState *vs;
+    int has_dirty = 0;
+
+    QTAILQ_FOREACH(vs, &vd->clients, next) {
         /* kernel send buffers are full -> refresh later */
         if (vs->output.offset) {
             continue;
         }
 
-        if (!vs->lossy_rect[sty][stx]) {
-            continue;
+        has_dirty += vnc_refresh_client_lossy_rect(vs, x, y);
+    }
+
+    return has_dirty;
+}
+
+/*
+ * vnc_refresh_lossy_rect() only gets one chance per rect, when it goes
+ * idle; a client that is behind at that moment keeps the lossy pixels.
+ * Catch up on those once the client has room again.
+ */
+static int vnc_refresh_idle_lossy_rects(VncState *vs)
+{
+    VncDisplay *vd = vs->vd;
+    struct timeval tv, res;
+    int x, y, has_dirty = 0;
+
+    if (vs->output.offset) {
+        return 0;
+    }
+
+    gettimeofday(&tv, NULL);
+    for (y = 0; y < vd->guest.ds->height; y += VNC_STAT_RECT) {
+        for (x = 0; x < vd->guest.ds->width; x += VNC_STAT_RECT) {
+            VncRectStat *rect = vnc_stat_rect(vd, x, y);
+            int count = ARRAY_SIZE(rect->times);
+            struct timeval *last = &rect->times[(rect->idx + count - 1) % count];
+
+            timersub(&tv, last, &res);
+            if (timerisset(last) && !timercmp(&res, &VNC_REFRESH_LOSSY, >)) {
+                continue;
+            }
+            has_dirty += vnc_refresh_client_lossy_rect(vs, x, y);
         }
+    }
+    return has_dirty;
+}
+
+static double vnc_rate_smooth(double avg, double sample)
+{
+    return avg ? avg * 0.75 + sample * 0.25 : sample;
+}
+
+/*
+ * Called before each update of the client.  At the end of every window
+ * the bytes sent are folded into the smoothed bandwidth, and the JPEG
+ * quality is moved: down as soon as updates had to be held back because
+ * the link or the encoders did not keep up, up one step (and past the
+ * top, to lossless) after a few windows in which they did.
+ *
+ * A window with stalls saturated the link, so its bandwidth is what the
+ * link can carry.  The quality is only raised while the client uses less
+ * than VNC_RATE_HEADROOM of that capacity, so a link that is just keeping
+ * up does not bounce between two levels.  Returns the number of lossy
+ * rects marked for a lossless refresh.
+ */
+static int vnc_rate_update(VncState *vs)
+{
+    VncRate *rate = &vs->rate;
+    int64_t now = qemu_get_clock(rt_clock);
+    int64_t elapsed = now - rate->window_start;
+    uint64_t bytes;
+    double bandwidth;
+
+    if (elapsed < VNC_RATE_WINDOW) {
+        return 0;
+    }
+
+    vnc_lock_output(vs);
+    bytes = rate->bytes;
+    rate->bytes = 0;
+    vnc_unlock_output(vs);
 
-        vs->lossy_rect[sty][stx] = 0;
-        for (j = 0; j < VNC_STAT_RECT; ++j) {
-            bitmap_set(vs->dirty[y + j], x / 16, VNC_STAT_RECT / 16);
+    bandwidth = bytes * 1000. / elapsed;
+    rate->bandwidth = vnc_rate_smooth(rate->bandwidth, bandwidth);
+    if (rate->stalls) {
+        rate->capacity = vnc_rate_smooth(rate->capacity, bandwidth);
+    } else if (bandwidth > rate->capacity) {
+        /* the link carried more than we thought it could */
+        rate->capacity = 0;
+    }
+
+    if (rate->quality_req == -1 || vs->vd->non_adaptive) {
+        rate->quality = rate->quality_req;
+    } else if (rate->stalls) {
+        rate->clean_windows = 0;
+        if (rate->quality == -1) {
+            rate->quality = rate->quality_req;
+        } else {
+            /* most updates held back: the link is far too slow */
+            rate->quality -= rate->stalls > rate->updates ? 2 : 1;
+            rate->quality = MAX(rate->quality, 0);
+        }
+    } else if (rate->capacity &&
+               rate->bandwidth > rate->capacity * VNC_RATE_HEADROOM) {
+        /* no stalls, but too close to the link's limit to ask for more */
+        rate->clean_windows = 0;
+    } else if (rate->updates && ++rate->clean_windows >= VNC_RATE_RAISE) {
+        rate->clean_windows = 0;
+        if (rate->quality == 9) {
+            rate->quality = -1;
+        } else if (rate->quality != -1) {
+            rate->quality++;
         }
-        has_dirty++;
     }
 
-    return has_dirty;
+    VNC_DEBUG("rate: %.0f bytes/s, capacity %.0f, %d stalls, quality %d\n",
+              rate->bandwidth, rate->capacity, rate->stalls, rate->quality);
+
+    rate->window_start = now;
+    rate->updates = 0;
+    if (rate->stalls) {
+        rate->stalls = 0;
+        return 0;
+    }
+    return vnc_refresh_idle_lossy_rects(vs);
 }
 
 static int vnc_update_stats(VncDisplay *vd,  struct timeval * tv)
@@ -2377,13 +2518,133 @@ static void vnc_rect_updated(VncDisplay *vd, int x, int y, struct timeval * tv)
     rect->updated = true;
 }
 
+#define VNC_SCROLL_BACKOFF_MAX 15
+
+/* Move the client's dirty bits along with a CopyRect */
+static void vnc_scroll_client_dirty(VncState *vs, VncScroll *sc)
+{
+    int src_c0 = sc->src_x / 16, dst_c0 = sc->dst_x / 16;
+    int nc = DIV_ROUND_UP(sc->src_x + sc->w, 16) - src_c0;
+    int i, c, src_y, dst_y, inc = 1;
+
+    src_y = sc->src_y;
+    dst_y = sc->dst_y;
+    if (sc->dst_y > sc->src_y) {
+        src_y += sc->h - 1;
+        dst_y += sc->h - 1;
+        inc = -1;
+    }
+    for (i = 0; i < sc->h; i++, src_y += inc, dst_y += inc) {
+        if (sc->src_x == sc->dst_x) {
+            /* vertical moves start and end on chunk boundaries */
+            for (c = src_c0; c < src_c0 + nc; c++) {
+                if (test_bit(c, vs->dirty[src_y])) {
+                    set_bit(c, vs->dirty[dst_y]);
+                } else {
+                    clear_bit(c, vs->dirty[dst_y]);
+                }
+            }
+        } else if (find_next_bit(vs->dirty[src_y], src_c0 + nc, src_c0) <
+                   src_c0 + nc) {
+            bitmap_set(vs->dirty[dst_y], dst_c0,
+                       DIV_ROUND_UP(sc->dst_x + sc->w, 16) - dst_c0);
+        }
+    }
+}
+
+/*
+ * Look for a scrolled block in the dirty part of the guest surface.  If
+ * there is one, move it on the server surface and send it as CopyRect to
+ * the clients that support it; the comparison that follows then only
+ * finds the newly exposed strip.  Clients without CopyRect, or with jobs
+ * in flight that could still paint the source area, get the block marked
+ * dirty instead.  Returns the number of chunks marked dirty.
+ */
+static int vnc_refresh_scroll(VncDisplay *vd)
+{
+    unsigned long cols[VNC_DIRTY_WORDS] = { 0 };
+    int nchunks = DIV_ROUND_UP(vd->guest.ds->width, 16);
+    int pitch = ds_get_linesize(vd->ds);
+    int depth = ds_get_bytes_per_pixel(vd->ds);
+    int y, y0 = -1, y1 = 0, c0, c1, copyrect = 0;
+    uint8_t *src_row, *dst_row;
+    VncState *vs;
+    VncScroll sc;
+
+    QTAILQ_FOREACH(vs, &vd->clients, next) {
+        if (vnc_has_feature(vs, VNC_FEATURE_COPYRECT) && !vnc_has_job(vs)) {
+            copyrect = 1;
+        }
+    }
+    if (!copyrect) {
+        return 0;
+    }
+
+    for (y = 0; y < vd->guest.ds->height; y++) {
+        if (!bitmap_empty(vd->guest.dirty[y], nchunks)) {
+            if (y0 < 0) {
+                y0 = y;
+            }
+            y1 = y + 1;
+            bitmap_or(cols, cols, vd->guest.dirty[y], nchunks);
+        }
+    }
+    if (y0 < 0 || y1 - y0 < VNC_SCROLL_MIN_ROWS) {
+        return 0;
+    }
+    if (vd->scroll_skip) {
+        vd->scroll_skip--;
+        return 0;
+    }
+    c0 = find_first_bit(cols, nchunks);
+    c1 = find_last_bit(cols, nchunks) + 1;
+
+    if (!vnc_detect_scroll(vd->server->data, vd->guest.ds->data, pitch,
+                           depth, c0 * 16, y0,
+                           MIN(c1 * 16, vd->guest.ds->width) - c0 * 16,
+                           y1 - y0, &sc)) {
+        /* back off while large updates are not scrolls, e.g. video */
+        vd->scroll_backoff = MIN(vd->scroll_backoff * 2 + 1,
+                                 VNC_SCROLL_BACKOFF_MAX);
+        vd->scroll_skip = vd->scroll_backoff;
+        return 0;
+    }
+    vd->scroll_backoff = 0;
+
+    /* do the move on the server surface */
+    src_row = vd->server->data + pitch * sc.src_y + depth * sc.src_x;
+    dst_row = vd->server->data + pitch * sc.dst_y + depth * sc.dst_x;
+    if (sc.dst_y > sc.src_y) {
+        src_row += pitch * (sc.h - 1);
+        dst_row += pitch * (sc.h - 1);
+        pitch = -pitch;
+    }
+    for (y = 0; y < sc.h; y++) {
+        memmove(dst_row, src_row, sc.w * depth);
+        src_row += pitch;
+        dst_row += pitch;
+    }
+
+    QTAILQ_FOREACH(vs, &vd->clients, next) {
+        if (vnc_has_feature(vs, VNC_FEATURE_COPYRECT) && !vnc_has_job(vs)) {
+            vnc_scroll_client_dirty(vs, &sc);
+            vnc_copy(vs, sc.src_x, sc.src_y, sc.dst_x, sc.dst_y, sc.w, sc.h);
+            continue;
+        }
+        for (y = sc.dst_y; y < sc.dst_y + sc.h; y++) {
+            bitmap_set(vs->dirty[y], sc.dst_x / 16,
+                       DIV_ROUND_UP(sc.dst_x + sc.w, 16) - sc.dst_x / 16);
+        }
+    }
+    return sc.h * DIV_ROUND_UP(sc.w, 16);
+}
+
 static int vnc_refresh_server_surface(VncDisplay *vd)
 {
     int y;
     uint8_t *guest_row;
     uint8_t *server_row;
-    int cmp_bytes;
-    unsigned long width_mask[VNC_DIRTY_WORDS];
+    int cmp_bytes, nchunks;
     VncState *vs;
     int has_dirty = 0;
 
@@ -2399,35 +2660,31 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
      * Check and copy modified bits from guest to server surface.
      * Update server dirty map.
      */
-    bitmap_set(width_mask, 0, (ds_get_width(vd->ds) / 16));
-    bitmap_clear(width_mask, (ds_get_width(vd->ds) / 16),
-                 VNC_DIRTY_WORDS * BITS_PER_LONG);
+    nchunks = DIV_ROUND_UP(vd->guest.ds->width, 16);
     cmp_bytes = 16 * ds_get_bytes_per_pixel(vd->ds);
+    has_dirty += vnc_refresh_scroll(vd);
+
     guest_row  = vd->guest.ds->data;
     server_row = vd->server->data;
     for (y = 0; y < vd->guest.ds->height; y++) {
-        if (bitmap_intersects(vd->guest.dirty[y], width_mask, VNC_DIRTY_WORDS)) {
-            int x;
-            uint8_t *guest_ptr;
-            uint8_t *server_ptr;
-
-            guest_ptr  = guest_row;
-            server_ptr = server_row;
-
-            for (x = 0; x < vd->guest.ds->width;
-                    x += 16, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
-                if (!test_and_clear_bit((x / 16), vd->guest.dirty[y]))
-                    continue;
-                if (memcmp(server_ptr, guest_ptr, cmp_bytes) == 0)
-                    continue;
-                memcpy(server_ptr, guest_ptr, cmp_bytes);
-                if (!vd->non_adaptive)
-                    vnc_rect_updated(vd, x, y, &tv);
-                QTAILQ_FOREACH(vs, &vd->clients, next) {
-                    set_bit((x / 16), vs->dirty[y]);
+        unsigned long changed[VNC_DIRTY_WORDS] = { 0 };
+        int n;
+
+        n = vnc_sync_row(server_row, guest_row, cmp_bytes, nchunks,
+                         vd->guest.dirty[y], changed);
+        if (n) {
+            if (!vd->non_adaptive) {
+                int x;
+
+                for (x = find_first_bit(changed, nchunks); x < nchunks;
+                     x = find_next_bit(changed, nchunks, x + 1)) {
+                    vnc_rect_updated(vd, x * 16, y, &tv);
                 }
-                has_dirty++;
             }
+            QTAILQ_FOREACH(vs, &vd->clients, next) {
+                bitmap_or(vs->dirty[y], vs->dirty[y], changed, nchunks);
+            }
+            has_dirty += n;
         }
         guest_row  += ds_get_linesize(vd->ds);
         server_row += ds_get_linesize(vd->ds);
@@ -2444,9 +2701,9 @@ static void vnc_refresh(void *opaque)
     vga_hw_update();
 
     if (vnc_trylock_display(vd)) {
+        /* the encoders stop at their next rectangle, come back soon */
         vd->timer_interval = VNC_REFRESH_INTERVAL_BASE;
-        qemu_mod_timer(vd->timer, qemu_get_clock(rt_clock) +
-                       vd->timer_interval);
+        qemu_mod_timer(vd->timer, qemu_get_clock(rt_clock) + 1);
         return;
     }
 
@@ -2491,6 +2748,7 @@ static void vnc_remove_timer(VncDisplay *vd)
         qemu_del_timer(vd->timer);
         qemu_free_timer(vd->timer);
         vd->timer = NULL;
+        vnc_cancel_refresh(vd);
     }
 }
 
@@ -2518,6 +2776,10 @@ static void vnc_connect(VncDisplay *vd, int csock)
     vs->last_x = -1;
     vs->last_y = -1;
 
+    vs->rate.window_start = qemu_get_clock(rt_clock);
+    vs->rate.quality = -1;
+    vs->rate.quality_req = -1;
+
     vs->as.freq = 44100;
     vs->as.nchannels = 2;
     vs->as.fmt = AUD_FMT_S16;
@@ -2587,6 +2849,7 @@ void vnc_display_init(DisplayState *ds)
 
 #ifdef CONFIG_VNC_THREAD
     qemu_mutex_init(&vs->mutex);
+    qemu_cond_init(&vs->encoders_cond);
     vnc_start_worker_thread();
 #endif
 
@@ -2760,6 +3023,10 @@ int vnc_display_open(DisplayState *ds, const char *display)
             vs->lossy = true;
         } else if (strncmp(options, "non-adapative", 13) == 0) {
             vs->non_adaptive = true;
+        } else if (strncmp(options, "workers=", 8) == 0) {
+#ifdef CONFIG_VNC_THREAD
+            vnc_start_worker_threads(strtol(options + 8, NULL, 10));
+#endif
         }
     }
 
@@ -130,6 +130,9 @@ struct VncDisplay
     int lock_key_sync;
 #ifdef CONFIG_VNC_THREAD
     QemuMutex mutex;
+    QemuCond encoders_cond;
+    int encoders;       /* workers reading the server surface */
+    int refresh_pending; /* vnc_refresh() failed to lock, hold off encoders */
 #endif
 
     QEMUCursor *cursor;
@@ -139,6 +142,10 @@ struct VncDisplay
     struct VncSurface guest;   /* guest visible surface (aka ds->surface) */
     DisplaySurface *server;  /* vnc server surface */
 
+    /* refreshes to skip before looking for scrolled blocks again */
+    int scroll_skip;
+    int scroll_backoff;
+
     char *display;
     char *password;
     time_t expires;
@@ -154,6 +161,24 @@ struct VncDisplay
 #endif
 };
 
+/*
+ * Link estimate of one client, used to adapt the tight JPEG quality:
+ * bytes written to the socket and framebuffer updates sent during the
+ * current window, and the updates that were held back because the
+ * previous ones had not been sent or encoded yet.
+ */
+typedef struct VncRate {
+    int64_t window_start;   /* rt_clock */
+    uint64_t bytes;         /* under the output lock */
+    int updates;
+    int stalls;
+    int clean_windows;      /* consecutive windows without stalls */
+    double bandwidth;       /* bytes/s sent, smoothed */
+    double capacity;        /* bytes/s the link managed when saturated */
+    int quality;            /* JPEG quality in use, -1 for lossless */
+    int quality_req;        /* JPEG quality asked for by the client */
+} VncRate;
+
 typedef struct VncTight {
     int type;
     uint8_t quality;
@@ -216,6 +241,8 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    bool running;
+    int quality;        /* tight JPEG quality to encode with, -1 lossless */
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
@@ -224,6 +251,7 @@ struct VncJob
 struct VncJob
 {
     VncState *vs;
+    int quality;
     int rectangles;
     size_t saved_offset;
 };
@@ -269,6 +297,8 @@ struct VncState
     VncWritePixels *write_pixels;
     DisplaySurface clientds;
 
+    VncRate rate;
+
     CaptureVoiceOut *audio_cap;
     struct audsettings as;
 
@@ -283,6 +313,8 @@ struct VncState
     VncJob job;
 #else
     QemuMutex output_mutex;
+    int worker;         /* 1 + index of our encoding thread, 0 before the
+                           first job; under the queue lock */
 #endif
 
     /* Encoding specific, if you add something here, don't forget to
@@ -67,6 +67,9 @@
 #include <linux/ppdev.h>
 #include <linux/parport.h>
 #endif
+#ifdef CONFIG_EPOLL
+#include <sys/epoll.h>
+#endif
 #ifdef __sun__
 #include <sys/stat.h>
 #include <sys/ethernet.h>
@@ -180,9 +183,8 @@ int display_remote = 0;
 const char* keyboard_layout = NULL;
 ram_addr_t ram_size;
 const char *mem_path = NULL;
-#ifdef MAP_POPULATE
 int mem_prealloc = 0; /* force preallocation of physical target memory */
-#endif
+int mem_prealloc_threads = 1;
 int nb_nics;
 NICInfo nd_table[MAX_NICS];
 int vm_running;
@@ -209,6 +211,9 @@ int max_cpus = 0;
 int smp_cores = 1;
 int smp_threads = 1;
 const char *vnc_display;
+#ifndef _WIN32
+static const char *shm_display;
+#endif
 int acpi_enabled = 1;
 int no_hpet = 0;
 int fd_bootchk = 1;
@@ -243,6 +248,7 @@ QTAILQ_HEAD(, FWBootEntry) fw_boot_order = QTAILQ_HEAD_INITIALIZER(fw_boot_order
 int nb_numa_nodes;
 uint64_t node_mem[MAX_NODES];
 uint64_t node_cpumask[MAX_NODES];
+int node_host[MAX_NODES];
 
 static QEMUTimer *nographic_timer;
 
@@ -807,6 +813,7 @@ char *get_boot_devices_list(uint32_t *size)
 static void numa_add(const char *optarg)
 {
     char option[128];
+    const char *p;
     char *endptr;
     unsigned long long value, endvalue;
     int nodenr;
@@ -852,6 +859,20 @@ static void numa_add(const char *optarg)
             }
             node_cpumask[nodenr] = value;
         }
+        p = optarg;
+        if (get_next_param_value(option, 128, "hostnode", &p) == 0 &&
+            p == optarg) {
+            /* not given; an empty hostnode= is rejected below */
+            node_host[nodenr] = -1;
+        } else {
+            unsigned long host = strtoul(option, &endptr, 10);
+
+            if (endptr == option || *endptr || host > INT_MAX) {
+                fprintf(stderr, "qemu: invalid numa hostnode: %s\n", option);
+                exit(1);
+            }
+            node_host[nodenr] = host;
+        }
         nb_numa_nodes++;
     }
     return;
@@ -1032,25 +1053,293 @@ typedef struct IOHandlerRecord {
     IOHandler *fd_write;
     int deleted;
     void *opaque;
+    EventLoopStats read_stats;
+    EventLoopStats write_stats;
     /* temporary data */
     struct pollfd *ufd;
     QLIST_ENTRY(IOHandlerRecord) next;
+#ifdef CONFIG_EPOLL
+    /* events currently in the epoll interest set */
+    uint32_t events;
+    int registered;
+    /* re-registered: the fd may have been closed and reused since, so
+       the next update must reach the kernel even if events match */
+    int reregistered;
+    /* fd cannot be watched by epoll (e.g. regular files) */
+    int no_epoll;
+    /* last epoll_ctl error reported for this handler */
+    int epoll_errno;
+    /* on io_polled_handlers: state must be recomputed each iteration */
+    int polled;
+    QLIST_ENTRY(IOHandlerRecord) poll_next;
+#endif
 } IOHandlerRecord;
 
 static QLIST_HEAD(, IOHandlerRecord) io_handlers =
     QLIST_HEAD_INITIALIZER(io_handlers);
 
+#ifdef CONFIG_EPOLL
+/* epoll backend.  Handlers are added to the kernel interest set when they
+   are (re)registered and only updated when their event mask changes, so a
+   main loop iteration only costs the handlers that have an fd_read_poll
+   callback plus the ones that are actually ready.  If epoll is not
+   available at runtime we fall back to select(). */
+
+#define IO_EPOLL_MAX_EVENTS 128
+
+static int io_epoll_fd = -1;
+static int io_epoll_initialized;
+static int io_handlers_deleted;
+
+/* handlers whose event mask must be recomputed on every iteration */
+static QLIST_HEAD(, IOHandlerRecord) io_polled_handlers =
+    QLIST_HEAD_INITIALIZER(io_polled_handlers);
+
+/* fd -> handler lookup for epoll dispatch */
+static IOHandlerRecord **io_handler_table;
+static int io_handler_table_size;
+
+/* slirp still works on fd_sets; remember which of its fds are in the
+   interest set, with which events, and which socket they were (slirp
+   reuses numbers and closing a socket drops it from the interest set) */
+static uint8_t slirp_fd_events[FD_SETSIZE];
+static ino_t slirp_fd_ino[FD_SETSIZE];
+static int slirp_max_fd = -1;
+
+#define SLIRP_EV_READ   1
+#define SLIRP_EV_WRITE  2
+#define SLIRP_EV_EXCEPT 4
+
+static void io_epoll_init(void)
+{
+    if (io_epoll_initialized) {
+        return;
+    }
+    io_epoll_initialized = 1;
+#ifdef CONFIG_EPOLL_CREATE1
+    io_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    io_epoll_fd = epoll_create(IO_EPOLL_MAX_EVENTS);
+    if (io_epoll_fd >= 0) {
+        qemu_set_cloexec(io_epoll_fd);
+    }
+#endif
+}
+
+static IOHandlerRecord *io_handler_lookup(int fd)
+{
+    if (fd < 0 || fd >= io_handler_table_size) {
+        return NULL;
+    }
+    return io_handler_table[fd];
+}
+
+static void io_handler_table_set(int fd, IOHandlerRecord *ioh)
+{
+    if (fd >= io_handler_table_size) {
+        int new_size = MAX(fd + 1, io_handler_table_size * 2);
+
+        io_handler_table = qemu_realloc(io_handler_table,
+                                        new_size * sizeof(*io_handler_table));
+        memset(io_handler_table + io_handler_table_size, 0,
+               (new_size - io_handler_table_size) * sizeof(*io_handler_table));
+        io_handler_table_size = new_size;
+    }
+    io_handler_table[fd] = ioh;
+}
+
+static uint32_t io_handler_wanted_events(IOHandlerRecord *ioh)
+{
+    uint32_t events = 0;
+
+    if (ioh->deleted) {
+        return 0;
+    }
+    if (ioh->fd_read &&
+        (!ioh->fd_read_poll || ioh->fd_read_poll(ioh->opaque) != 0)) {
+        events |= EPOLLIN;
+    }
+    if (ioh->fd_write) {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+
+static void io_epoll_update(IOHandlerRecord *ioh, uint32_t events)
+{
+    struct epoll_event ev;
+    int op, ret;
+
+    if (ioh->no_epoll) {
+        ioh->events = events;
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    if (!events) {
+        /* epoll reports EPOLLHUP and EPOLLERR even with an empty mask,
+           so leave the interest set or epoll_wait never sleeps */
+        if (ioh->registered) {
+            epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, ioh->fd, &ev);
+            ioh->registered = 0;
+        }
+        ioh->reregistered = 0;
+        ioh->events = 0;
+        return;
+    }
+    if (ioh->registered && !ioh->reregistered && events == ioh->events) {
+        return;
+    }
+
+    ioh->reregistered = 0;
+
+    ev.events = events;
+    ev.data.fd = ioh->fd;
+    op = ioh->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    ret = epoll_ctl(io_epoll_fd, op, ioh->fd, &ev);
+    if (ret < 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+        /* the fd was closed and reopened under the same number, which
+           dropped it from the interest set */
+        ret = epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, ioh->fd, &ev);
+    }
+    if (ret < 0 && errno == EPERM) {
+        /* select() reports these (e.g. regular files) as always ready,
+           so do the same */
+        ioh->no_epoll = 1;
+        ioh->registered = 0;
+        if (!ioh->polled) {
+            ioh->polled = 1;
+            QLIST_INSERT_HEAD(&io_polled_handlers, ioh, poll_next);
+        }
+    } else if (ret < 0) {
+        /* not always ready either: keep the handler silent and retry
+           on every iteration until it can be added */
+        if (errno != ioh->epoll_errno) {
+            fprintf(stderr, "qemu: epoll_ctl failed for fd %d: %s\n",
+                    ioh->fd, strerror(errno));
+            ioh->epoll_errno = errno;
+        }
+        ioh->registered = 0;
+        ioh->events = 0;
+        if (!ioh->polled) {
+            ioh->polled = 1;
+            QLIST_INSERT_HEAD(&io_polled_handlers, ioh, poll_next);
+        }
+        return;
+    } else {
+        ioh->registered = 1;
+        ioh->epoll_errno = 0;
+    }
+    ioh->events = events;
+}
+
+static void io_epoll_remove(IOHandlerRecord *ioh)
+{
+    struct epoll_event ev;
+
+    if (ioh->registered) {
+        /* the fd may already be closed, ignore errors */
+        memset(&ev, 0, sizeof(ev));
+        epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, ioh->fd, &ev);
+        ioh->registered = 0;
+    }
+    ioh->events = 0;
+    if (ioh->polled) {
+        ioh->polled = 0;
+        QLIST_REMOVE(ioh, poll_next);
+    }
+    if (io_handler_lookup(ioh->fd) == ioh) {
+        io_handler_table_set(ioh->fd, NULL);
+    }
+    io_handlers_deleted = 1;
+}
+
+static void io_epoll_set_handler(IOHandlerRecord *ioh)
+{
+    int polled = ioh->fd_read_poll != NULL || ioh->no_epoll;
+
+    io_handler_table_set(ioh->fd, ioh);
+    ioh->reregistered = ioh->registered;
+    if (polled && !ioh->polled) {
+        QLIST_INSERT_HEAD(&io_polled_handlers, ioh, poll_next);
+    } else if (!polled && ioh->polled) {
+        QLIST_REMOVE(ioh, poll_next);
+    }
+    ioh->polled = polled;
+    if (!polled) {
+        io_epoll_update(ioh, io_handler_wanted_events(ioh));
+    }
+}
+#endif
 
 /* XXX: fd_read_poll should be suppressed, but an API change is
    necessary in the character devices to suppress fd_can_read(). */
-int qemu_set_fd_handler2(int fd,
-                         IOCanReadHandler *fd_read_poll,
-                         IOHandler *fd_read,
-                         IOHandler *fd_write,
-                         void *opaque)
+/* Keep the accounting across re-registrations of the same callbacks,
+   which character devices do all the time to throttle input. */
+static void io_handler_set_names(IOHandlerRecord *ioh, int fd,
+                                 const char *read_name,
+                                 const char *write_name)
+{
+    if (!ioh->read_stats.name || strcmp(ioh->read_stats.name, read_name)) {
+        event_loop_stats_init(&ioh->read_stats, "read", read_name, fd);
+    }
+    if (!ioh->write_stats.name || strcmp(ioh->write_stats.name, write_name)) {
+        event_loop_stats_init(&ioh->write_stats, "write", write_name, fd);
+    }
+}
+
+static void io_handler_free(IOHandlerRecord *ioh)
+{
+    event_loop_stats_remove(&ioh->read_stats);
+    event_loop_stats_remove(&ioh->write_stats);
+    qemu_free(ioh);
+}
+
+static void io_handler_call(IOHandlerRecord *ioh, IOHandler *fn,
+                            EventLoopStats *stats)
+{
+    int64_t start = event_loop_stats_begin();
+
+    fn(ioh->opaque);
+    event_loop_stats_end(stats, start);
+}
+
+int qemu_set_fd_handler_named(int fd,
+                              IOCanReadHandler *fd_read_poll,
+                              IOHandler *fd_read,
+                              IOHandler *fd_write,
+                              void *opaque,
+                              const char *read_name,
+                              const char *write_name)
 {
     IOHandlerRecord *ioh;
 
+#ifdef CONFIG_EPOLL
+    io_epoll_init();
+    if (io_epoll_fd >= 0) {
+        ioh = io_handler_lookup(fd);
+        if (!fd_read && !fd_write) {
+            if (ioh) {
+                ioh->deleted = 1;
+                io_epoll_remove(ioh);
+            }
+            return 0;
+        }
+        if (!ioh) {
+            ioh = qemu_mallocz(sizeof(IOHandlerRecord));
+            QLIST_INSERT_HEAD(&io_handlers, ioh, next);
+        }
+        ioh->fd = fd;
+        ioh->fd_read_poll = fd_read_poll;
+        ioh->fd_read = fd_read;
+        ioh->fd_write = fd_write;
+        ioh->opaque = opaque;
+        ioh->deleted = 0;
+        io_handler_set_names(ioh, fd, read_name, write_name);
+        io_epoll_set_handler(ioh);
+        return 0;
+    }
+#endif
+
     if (!fd_read && !fd_write) {
         QLIST_FOREACH(ioh, &io_handlers, next) {
             if (ioh->fd == fd) {
@@ -1072,18 +1361,11 @@ int qemu_set_fd_handler2(int fd,
         ioh->fd_write = fd_write;
         ioh->opaque = opaque;
         ioh->deleted = 0;
+        io_handler_set_names(ioh, fd, read_name, write_name);
     }
     return 0;
 }
 
-int qemu_set_fd_handler(int fd,
-                        IOHandler *fd_read,
-                        IOHandler *fd_write,
-                        void *opaque)
-{
-    return qemu_set_fd_handler2(fd, NULL, fd_read, fd_write, opaque);
-}
-
 /***********************************************************/
 /* machine registration */
 
@@ -1324,22 +1606,12 @@ void qemu_system_vmstop_request(int reason)
     qemu_notify_event();
 }
 
-void main_loop_wait(int nonblocking)
+static void main_loop_select(int timeout)
 {
     IOHandlerRecord *ioh;
     fd_set rfds, wfds, xfds;
     int ret, nfds;
     struct timeval tv;
-    int timeout;
-
-    if (nonblocking)
-        timeout = 0;
-    else {
-        timeout = qemu_calculate_timeout();
-        qemu_bh_update_timeout(&timeout);
-    }
-
-    os_host_main_loop_wait(&timeout);
 
     /* poll any events */
     /* XXX: separate device handlers from system ones */
@@ -1377,21 +1649,204 @@ void main_loop_wait(int nonblocking)
 
         QLIST_FOREACH_SAFE(ioh, &io_handlers, next, pioh) {
             if (!ioh->deleted && ioh->fd_read && FD_ISSET(ioh->fd, &rfds)) {
-                ioh->fd_read(ioh->opaque);
+                io_handler_call(ioh, ioh->fd_read, &ioh->read_stats);
             }
             if (!ioh->deleted && ioh->fd_write && FD_ISSET(ioh->fd, &wfds)) {
-                ioh->fd_write(ioh->opaque);
+                io_handler_call(ioh, ioh->fd_write, &ioh->write_stats);
             }
 
             /* Do this last in case read/write handlers marked it for deletion */
             if (ioh->deleted) {
                 QLIST_REMOVE(ioh, next);
-                qemu_free(ioh);
+                io_handler_free(ioh);
+            }
+        }
+    }
+
+    slirp_select_poll(&rfds, &wfds, &xfds, (ret < 0));
+}
+
+#ifdef CONFIG_EPOLL
+/* Bring the interest set in line with what slirp wants this time.  Each
+   fd slirp watches costs an fstat to notice that its socket was replaced;
+   only fds whose socket or events changed cost an epoll_ctl. */
+static void slirp_epoll_sync(fd_set *rfds, fd_set *wfds, fd_set *xfds)
+{
+    struct epoll_event ev;
+    struct stat st;
+    int fd, nfds = -1, max_fd, ret;
+
+    slirp_select_fill(&nfds, rfds, wfds, xfds);
+
+    max_fd = MAX(nfds, slirp_max_fd);
+    for (fd = 0; fd <= max_fd; fd++) {
+        uint8_t old = slirp_fd_events[fd];
+        uint8_t new = 0;
+        int op;
+
+        if (fd <= nfds) {
+            new = (FD_ISSET(fd, rfds) ? SLIRP_EV_READ : 0) |
+                  (FD_ISSET(fd, wfds) ? SLIRP_EV_WRITE : 0) |
+                  (FD_ISSET(fd, xfds) ? SLIRP_EV_EXCEPT : 0);
+        }
+        if (old && io_handler_lookup(fd)) {
+            /* slirp closed the socket, which took it out of the interest
+               set, and an io handler has reused the number since.  The
+               registration belongs to the handler now.  */
+            slirp_fd_events[fd] = 0;
+            continue;
+        }
+        if (new) {
+            if (fstat(fd, &st) < 0) {
+                new = 0;
+            } else if (old && st.st_ino != slirp_fd_ino[fd]) {
+                /* slirp closed the socket, which took it out of the
+                   interest set, and opened another one under the number */
+                old = 0;
+            }
+        }
+        if (new == old) {
+            continue;
+        }
+        memset(&ev, 0, sizeof(ev));
+        ev.events = ((new & SLIRP_EV_READ) ? EPOLLIN : 0) |
+                    ((new & SLIRP_EV_WRITE) ? EPOLLOUT : 0) |
+                    ((new & SLIRP_EV_EXCEPT) ? EPOLLPRI : 0);
+        ev.data.fd = fd;
+        op = !old ? EPOLL_CTL_ADD : !new ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        ret = epoll_ctl(io_epoll_fd, op, fd, &ev);
+        if (ret < 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+            /* closed and reopened by slirp under the same number */
+            op = EPOLL_CTL_ADD;
+            ret = epoll_ctl(io_epoll_fd, op, fd, &ev);
+        } else if (ret < 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+            op = EPOLL_CTL_MOD;
+            ret = epoll_ctl(io_epoll_fd, op, fd, &ev);
+        }
+        if (ret < 0 && op == EPOLL_CTL_ADD) {
+            /* could not watch it, keep it out of the interest set */
+            new = 0;
+        }
+        if (new) {
+            slirp_fd_ino[fd] = st.st_ino;
+        }
+        slirp_fd_events[fd] = new;
+    }
+    slirp_max_fd = nfds;
+
+    FD_ZERO(rfds);
+    FD_ZERO(wfds);
+    FD_ZERO(xfds);
+}
+
+static void io_epoll_dispatch(IOHandlerRecord *ioh, uint32_t revents)
+{
+    uint32_t write_mask = EPOLLOUT | EPOLLERR;
+
+    /* nobody reads, so the write handler has to see the hangup */
+    if (!(ioh->events & EPOLLIN)) {
+        write_mask |= EPOLLHUP;
+    }
+    if (!ioh->deleted && ioh->fd_read && (ioh->events & EPOLLIN) &&
+        (revents & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        io_handler_call(ioh, ioh->fd_read, &ioh->read_stats);
+    }
+    if (!ioh->deleted && ioh->fd_write && (ioh->events & EPOLLOUT) &&
+        (revents & write_mask)) {
+        io_handler_call(ioh, ioh->fd_write, &ioh->write_stats);
+    }
+}
+
+static void main_loop_epoll(int timeout)
+{
+    struct epoll_event events[IO_EPOLL_MAX_EVENTS];
+    IOHandlerRecord *ioh, *pioh;
+    fd_set rfds, wfds, xfds;
+    int ret, i, always_ready = 0;
+
+    QLIST_FOREACH(ioh, &io_polled_handlers, poll_next) {
+        io_epoll_update(ioh, io_handler_wanted_events(ioh));
+        if (ioh->no_epoll && ioh->events) {
+            always_ready = 1;
+        }
+    }
+    if (always_ready) {
+        timeout = 0;
+    }
+
+    slirp_epoll_sync(&rfds, &wfds, &xfds);
+
+    qemu_mutex_unlock_iothread();
+    ret = epoll_wait(io_epoll_fd, events, IO_EPOLL_MAX_EVENTS, timeout);
+    qemu_mutex_lock_iothread();
+
+    for (i = 0; i < ret; i++) {
+        int fd = events[i].data.fd;
+        uint32_t revents = events[i].events;
+
+        if (fd < FD_SETSIZE && slirp_fd_events[fd]) {
+            if (revents & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                FD_SET(fd, &rfds);
+            }
+            if (revents & (EPOLLOUT | EPOLLERR)) {
+                FD_SET(fd, &wfds);
+            }
+            if (revents & EPOLLPRI) {
+                FD_SET(fd, &xfds);
+            }
+            continue;
+        }
+        ioh = io_handler_lookup(fd);
+        if (ioh) {
+            io_epoll_dispatch(ioh, revents);
+        }
+    }
+
+    if (always_ready) {
+        QLIST_FOREACH_SAFE(ioh, &io_polled_handlers, poll_next, pioh) {
+            if (ioh->no_epoll) {
+                io_epoll_dispatch(ioh, EPOLLIN | EPOLLOUT);
+            }
+        }
+    }
+
+    /* Do this last in case read/write handlers marked them for deletion */
+    if (io_handlers_deleted) {
+        io_handlers_deleted = 0;
+        QLIST_FOREACH_SAFE(ioh, &io_handlers, next, pioh) {
+            if (ioh->deleted) {
+                QLIST_REMOVE(ioh, next);
+                io_handler_free(ioh);
             }
         }
     }
 
     slirp_select_poll(&rfds, &wfds, &xfds, (ret < 0));
+}
+#endif
+
+void main_loop_wait(int nonblocking)
+{
+    int timeout;
+
+    if (nonblocking)
+        timeout = 0;
+    else {
+        timeout = qemu_calculate_timeout();
+        qemu_bh_update_timeout(&timeout);
+    }
+
+    os_host_main_loop_wait(&timeout);
+
+#ifdef CONFIG_EPOLL
+    io_epoll_init();
+    if (io_epoll_fd >= 0) {
+        main_loop_epoll(timeout);
+    } else
+#endif
+    {
+        main_loop_select(timeout);
+    }
 
     qemu_run_all_timers();
 
@@ -1969,6 +2424,7 @@ int main(int argc, char **argv, char **envp)
     for (i = 0; i < MAX_NODES; i++) {
         node_mem[i] = 0;
         node_cpumask[i] = 0;
+        node_host[i] = -1;
     }
 
     nb_numa_nodes = 0;
@@ -2304,14 +2760,28 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_mempath:
                 mem_path = optarg;
                 break;
-#ifdef MAP_POPULATE
             case QEMU_OPTION_mem_prealloc:
                 mem_prealloc = 1;
                 break;
-#endif
+            case QEMU_OPTION_mem_prealloc_threads: {
+                char *end;
+                mem_prealloc_threads = strtol(optarg, &end, 10);
+                if (*end || mem_prealloc_threads < 1) {
+                    fprintf(stderr, "qemu: invalid thread count: %s\n",
+                            optarg);
+                    exit(1);
+                }
+                break;
+            }
             case QEMU_OPTION_d:
                 set_cpu_log(optarg);
                 break;
+            case QEMU_OPTION_vcpu_affinity:
+                set_vcpu_affinity(optarg);
+                break;
+            case QEMU_OPTION_iothread_affinity:
+                set_iothread_affinity(optarg);
+                break;
             case QEMU_OPTION_s:
                 gdbstub_dev = "tcp::" DEFAULT_GDBSTUB_PORT;
                 break;
@@ -2588,6 +3058,12 @@ int main(int argc, char **argv, char **envp)
                 display_remote++;
 		vnc_display = optarg;
 		break;
+#ifndef _WIN32
+            case QEMU_OPTION_shm_display:
+                display_remote++;
+                shm_display = optarg;
+                break;
+#endif
             case QEMU_OPTION_no_acpi:
                 acpi_enabled = 0;
                 break;
@@ -2678,6 +3154,32 @@ int main(int argc, char **argv, char **envp)
                 if (tb_size < 0)
                     tb_size = 0;
                 break;
+            case QEMU_OPTION_halt_poll_ns: {
+#ifdef CONFIG_IOTHREAD
+                char *end;
+
+                errno = 0;
+                halt_poll_max_ns = strtoll(optarg, &end, 0);
+                if (end == optarg || *end || errno ||
+                    halt_poll_max_ns < 0 || halt_poll_max_ns > 1000000000) {
+                    fprintf(stderr, "qemu: invalid halt polling time: %s\n",
+                            optarg);
+                    exit(1);
+                }
+#else
+                fprintf(stderr, "-halt-poll-ns requires the I/O thread\n");
+                exit(1);
+#endif
+                break;
+            }
+            case QEMU_OPTION_tcg_vcpu_threads:
+#ifdef CONFIG_IOTHREAD
+                tcg_vcpu_threads = 1;
+#else
+                fprintf(stderr, "-tcg-vcpu-threads requires the I/O thread\n");
+                exit(1);
+#endif
+                break;
             case QEMU_OPTION_icount:
                 icount_option = optarg;
                 break;
@@ -3022,6 +3524,7 @@ int main(int argc, char **argv, char **envp)
     os_setup_signal_handling();
 
     set_numa_modes();
+    qemu_ram_numa_check();
 
     current_machine = machine;
 
@@ -3089,6 +3592,11 @@ int main(int argc, char **argv, char **envp)
         qemu_spice_display_init(ds);
     }
 #endif
+#ifndef _WIN32
+    if (shm_display && shm_display_init(ds, shm_display) < 0) {
+        exit(1);
+    }
+#endif
 
     /* display setup */
     dpy_resize(ds);